@@ -0,0 +1,84 @@
+// * Indexes ROM libraries into a catalog, or lists a catalog.
+
+#include <catalog.h>
+#include <cart.h>
+#include <string.h>
+
+/**
+ * Prints the entries of a catalog, one ROM per line.
+ *
+ * @param catalog The catalog.
+ */
+static void printCatalog(const catalog_t *catalog) {
+    for (u32 i = 0; i < catalog->count; i++) {
+        const catalogEntry_t *entry = &catalog->entries[i];
+
+        ROMHeader_t header = {0};
+        header.oldLICCode = entry->oldLICCode;
+        printf("%s%-16.16s%s %-24s %s%5d%s KiB  %s%s%s %s%s%s  %-24s %s%s%s\n",
+               CBLU, entry->title, CRST, getCartridgeTypeName(entry->type),
+               CYEL, 32 << entry->ROMSize, CRST,
+               entry->flags & CATALOG_HEADER_OK ? CGRN : CRED,
+               entry->flags & CATALOG_HEADER_OK ? "HDR" : "hdr", CRST,
+               entry->flags & CATALOG_GLOBAL_OK ? CGRN : CRED,
+               entry->flags & CATALOG_GLOBAL_OK ? "GLB" : "glb", CRST,
+               getLicenseeName(&header), CCYN, getCatalogPath(catalog, entry),
+               CRST);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %sgbcatalog <catalog_file> [--threads <count>] "
+               "[<rom_directory>...]%s\n",
+               CMAG, CRST);
+        printf("Without directories, the catalog is listed.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Parse optional arguments
+    const char *directories[argc];
+    int count = 0;
+    int threads = 0;
+    for (int arg = 2; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+            threads = strtol(argv[++arg], NULL, 10);
+        } else {
+            directories[count++] = argv[arg];
+        }
+    }
+
+    // A missing or outdated catalog is rebuilt from scratch
+    catalog_t catalog;
+    bool loaded = loadCatalog(&catalog, argv[1]);
+    if (!count) {
+        if (!loaded) {
+            printf("%sERR:%s Failed to read catalog: %s%s%s\n", CRED, CRST,
+                   CCYN, argv[1], CRST);
+            return EXIT_FAILURE;
+        }
+
+        printCatalog(&catalog);
+        freeCatalog(&catalog);
+        return EXIT_SUCCESS;
+    }
+
+    int read = scanCatalog(&catalog, directories, count, threads);
+    if (read < 0) {
+        printf("%sERR:%s Failed to scan the ROM directories.\n", CRED, CRST);
+        freeCatalog(&catalog);
+        return EXIT_FAILURE;
+    }
+
+    if (!saveCatalog(&catalog, argv[1])) {
+        printf("%sERR:%s Failed to write catalog: %s%s%s\n", CRED, CRST, CCYN,
+               argv[1], CRST);
+        freeCatalog(&catalog);
+        return EXIT_FAILURE;
+    }
+
+    printf("Catalogued %s%u%s ROMs in %s%s%s (%s%d%s read).\n", CYEL,
+           catalog.count, CRST, CCYN, argv[1], CRST, CYEL, read, CRST);
+    freeCatalog(&catalog);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,5 @@
+// * Entrypoint for the Game Boy emulator without a window, for batch runs.
+
+#include <emu.h>
+
+int main(int argc, char **argv) { return runHeadless(argc, argv); }
\ No newline at end of file
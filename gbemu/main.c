@@ -1,5 +1,5 @@
 // * Entrypoint for the Game Boy emulator.
 
-#include <emu.h>
+#include <ui.h>
 
 int main(int argc, char **argv) { return runEmulator(argc, argv); }
\ No newline at end of file
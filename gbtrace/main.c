@@ -0,0 +1,54 @@
+// * Decodes instruction trace dumps written by the emulator.
+
+#include <trace.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %sgbtrace <trace_file>%s\n", CMAG, CRST);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        printf("%sERR:%s Failed to open trace file: %s%s%s\n", CRED, CRST,
+               CMAG, argv[1], CRST);
+        return EXIT_FAILURE;
+    }
+
+    // Check that the dump is one this build understands
+    traceFileHeader_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        printf("%sERR:%s Not a trace file: %s%s%s\n", CRED, CRST, CMAG,
+               argv[1], CRST);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    if (header.version != TRACE_VERSION ||
+        header.recordSize != sizeof(traceRecord_t)) {
+        printf("%sERR:%s Unsupported trace version %s%u%s (record size "
+               "%s%u%s).\n",
+               CRED, CRST, CYEL, header.version, CRST, CYEL, header.recordSize,
+               CRST);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    traceRecord_t record;
+    char line[256];
+    for (u64 i = 0; i < header.count; i++) {
+        if (fread(&record, sizeof(record), 1, file) != 1) {
+            printf("%sERR:%s Trace file is truncated after %s%llu%s "
+                   "records.\n",
+                   CRED, CRST, CYEL, (unsigned long long)i, CRST);
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+        traceRecordToString(&record, line, sizeof(line));
+        printf("%s\n", line);
+    }
+
+    fclose(file);
+    return EXIT_SUCCESS;
+}
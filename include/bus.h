@@ -2,34 +2,72 @@
 
 #include <common.h>
 
+// Handlers for pages that aren't plain memory
+typedef u8 (*BUS_READ)(gb_t *gb, u16 address);
+typedef void (*BUS_WRITE)(gb_t *gb, u16 address, u8 value);
+
+// Bus context - Contains the memory map, with one entry per 256-byte page
+typedef struct {
+    const u8 *readPages[0x100];      // Memory the page is read from, or NULL
+    u8 *writePages[0x100];           // Memory the page is written to, or NULL
+    BUS_READ readHandlers[0x100];    // Reads pages without readPages
+    BUS_WRITE writeHandlers[0x100];  // Writes pages without writePages
+} busContext_t;
+
+/**
+ * Builds the memory map. Called after the cartridge is loaded.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeBus(gb_t *gb);
+
+/**
+ * Maps a range of pages to host memory or handlers. Mapping new memory over a
+ * range (e.g. when switching banks) replaces the previous mapping.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The first address of the range, aligned to 256 bytes.
+ * @param size The size of the range, a multiple of 256 bytes.
+ * @param read The memory read from, or NULL to use readHandler.
+ * @param write The memory written to, or NULL to use writeHandler.
+ * @param readHandler The handler for reads if read is NULL.
+ * @param writeHandler The handler for writes if write is NULL.
+ */
+void mapBusPages(gb_t *gb, u16 address, u32 size, const u8 *read, u8 *write,
+                 BUS_READ readHandler, BUS_WRITE writeHandler);
+
 /**
  * Reads a byte from the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the bus.
  */
-u8 readBus(u16 address);
+u8 readBus(gb_t *gb, u16 address);
 
 /**
  * Reads 16 bits from the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The 16 bits read from the bus.
  */
-u16 readBus16(u16 address);
+u16 readBus16(gb_t *gb, u16 address);
 
 /**
  * Writes a byte to the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeBus(u16 address, u8 value);
+void writeBus(gb_t *gb, u16 address, u8 value);
 
 /**
  * Writes 16 bits to the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The 16 bits to write.
  */
-void writeBus16(u16 address, u16 value);
\ No newline at end of file
+void writeBus16(gb_t *gb, u16 address, u16 value);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 // Cartridge structure for ease of use
 typedef struct {
@@ -21,35 +23,159 @@ typedef struct {
     u16 global_checksum;  // Sum of all bytes in ROM, excluding last two
 } ROMHeader_t;
 
+// Memory bank controllers, decoded from the cartridge type
+typedef enum {
+    MBC_NONE,  // ROM only, or an unsupported controller
+    MBC_1,
+    MBC_2,
+    MBC_3,
+    MBC_5,
+} mapperType_t;
+
 // Cartridge context
 typedef struct {
     char filename[1024];  // File name of the cartridge (ROM file)
     u32 ROMSize;          // ROM Sizing (in bytes)
-    u8 *ROMData;          // Maximal size: 2MB
-    ROMHeader_t *header;  // Header information
+    u32 mappedSize;       // Size of the read-only mapping of the ROM
+    const u8 *ROMData;    // ROM file, mapped read-only - Maximal size: 8MB
+    ROMHeader_t header;   // Copy of the header information
+
+    mapperType_t mapper;  // Memory bank controller
+    u16 ROMBanks;         // Number of 16 KiB banks in the mapped ROM
+    u8 *RAM;              // Cartridge RAM, or NULL if there is none
+    u32 RAMSize;          // Size of the cartridge RAM (in bytes)
+    u32 RAMBufferSize;    // Size of the RAM buffer, padded to be mappable
+    bool battery;         // Whether the RAM is battery-backed
+    bool hasRTC;          // Whether the MBC3 has a real-time clock
+    u8 *saveData;         // Mapped save file (RAM, then the clock footer)
+    u32 saveSize;         // Size of the mapped save file
+    char savePath[1024];  // Save file for battery-backed RAM and the clock
+    bool RAMEnabled;      // Whether the RAM is enabled for reads and writes
+    u16 ROMBank;          // ROM bank register (lower 5 bits for MBC1)
+    u8 RAMBank;           // RAM bank register (upper ROM bits for MBC1)
+    bool bankingMode;     // MBC1 mode select - Banks 0x0000 - 0x3FFF and RAM
+
+    // Banks mapped into the bus, recomputed when a bank register is written
+    u16 lowBank;          // ROM bank mapped to 0x0000 - 0x3FFF
+    u16 highBank;         // ROM bank mapped to 0x4000 - 0x7FFF
+    const u8 *lowROM;     // ROM mapped to 0x0000 - 0x3FFF
+    const u8 *highROM;    // ROM mapped to 0x4000 - 0x7FFF
+    u8 *mappedRAM;        // RAM mapped to 0xA000 - 0xBFFF, or NULL for handlers
+
+    // Whether the RAM may have been written since the last flush, and whether
+    // it can be written right now. Writes don't mark the RAM dirty themselves,
+    // as they go straight to the save file's pages.
+    _Atomic bool saveDirty;
+    _Atomic bool saveWritable;
+
+    // Background thread flushing battery-backed RAM to the save file
+    pthread_t saver;
+    pthread_mutex_t saverLock;
+    pthread_cond_t saverWake;
+    bool saverRunning;
 } cartContext_t;
 
+/**
+ * Gets the name of a cartridge's licensee code.
+ *
+ * @param header The cartridge header.
+ * @return The name of the licensee code.
+ */
+const char *getLicenseeName(const ROMHeader_t *header);
+
+/**
+ * Gets the name of a cartridge type.
+ *
+ * @param type The cartridge type, from the header.
+ * @return The name of the cartridge type.
+ */
+const char *getCartridgeTypeName(u8 type);
+
+/**
+ * Computes the header checksum over 0x0134 - 0x014C, as the boot ROM does.
+ *
+ * @param rom The ROM, at least 0x150 bytes.
+ * @return The checksum, which should match the header's.
+ */
+u8 computeHeaderChecksum(const u8 *rom);
+
+/**
+ * Computes the global checksum: the sum of every byte of the ROM except the
+ * checksum itself, at 0x014E - 0x014F.
+ *
+ * @param rom The ROM, at least 0x150 bytes.
+ * @param size The size of the ROM.
+ * @return The checksum, which should match the header's (big-endian) one.
+ */
+u16 computeGlobalChecksum(const u8 *rom, u32 size);
+
 /**
  * Loads a cartridge into the emulator based on filename.
- * This function will load the ROM data into memory and verify the checksum.
+ * The ROM file is mapped read-only, so that every emulator loading the same
+ * file shares one copy of it, and the checksum is verified.
  *
+ * @param gb The Game Boy instance.
  * @param filename The filename of the cartridge to load.
  * @return Whether the cartridge was loaded successfully.
  */
-bool loadCartridge(char *filename);
+bool loadCartridge(gb_t *gb, char *filename);
+
+/**
+ * Unmaps the loaded cartridge and frees its RAM, if there is one.
+ * Battery-backed RAM is flushed to the save file first.
+ *
+ * @param gb The Game Boy instance.
+ */
+void unloadCartridge(gb_t *gb);
+
+/**
+ * Writes battery-backed RAM to the save file, if it may have changed since
+ * the last flush. Waits for the disk, so the emulation thread only calls
+ * this on exit - A background thread flushes periodically.
+ *
+ * @param gb The Game Boy instance.
+ */
+void flushCartridgeRAM(gb_t *gb);
 
 /**
  * Reads a byte from the cartridge at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the cartridge.
  */
-u8 readCartridge(u16 address);
+u8 readCartridge(gb_t *gb, u16 address);
 
 /**
  * Writes a byte to the cartridge at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToCartridge(u16 address, u8 value);
\ No newline at end of file
+void writeToCartridge(gb_t *gb, u16 address, u8 value);
+
+/**
+ * Gets the ROM bank mapped at an address.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address (0x0000 - 0x7FFF).
+ * @return The ROM bank number.
+ */
+u16 getCartridgeROMBank(gb_t *gb, u16 address);
+
+/**
+ * Resets the bank registers, as when the Game Boy is turned on. The banks are
+ * mapped again by the next mapCartridge().
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetCartridge(gb_t *gb);
+
+/**
+ * Maps the selected ROM and RAM banks into the bus, so that they are read
+ * directly. Called again whenever a bank register is written.
+ *
+ * @param gb The Game Boy instance.
+ */
+void mapCartridge(gb_t *gb);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <common.h>
+
+// Identifies a ROM catalog file
+#define CATALOG_MAGIC "GBCATLG"
+#define CATALOG_VERSION 1
+
+// Entry flags
+#define CATALOG_HEADER_OK 0x01  // The header checksum matches
+#define CATALOG_GLOBAL_OK 0x02  // The global checksum matches
+
+// A catalogued ROM - fixed size, 48 bytes
+typedef struct {
+    u64 size;            // Size of the ROM file
+    u64 mtime;           // Modification time of the file, in nanoseconds
+    u32 pathOffset;      // Offset of the file's path in the catalog strings
+    char title[16];      // Title from the header, null-terminated if shorter
+    u16 newLICCode;      // Header fields, as in ROMHeader_t
+    u8 type;
+    u8 ROMSize;
+    u8 RAMSize;
+    u8 oldLICCode;
+    u8 version;
+    u8 flags;            // CATALOG_HEADER_OK and CATALOG_GLOBAL_OK
+    u16 globalChecksum;  // Global checksum computed from the ROM
+    u8 reserved[2];      // Padding, always 0
+} catalogEntry_t;
+
+// Header of a catalog file, followed by the entries (sorted by path) and the
+// null-terminated paths they point to
+typedef struct {
+    char magic[8];    // CATALOG_MAGIC, null-terminated
+    u32 version;      // CATALOG_VERSION
+    u32 entrySize;    // sizeof(catalogEntry_t)
+    u32 count;        // Number of entries
+    u32 stringsSize;  // Size of the paths, in bytes
+} catalogFileHeader_t;
+
+// A catalog of ROMs, sorted by path
+typedef struct {
+    catalogEntry_t *entries;  // Catalogued ROMs
+    u32 count;                // Number of entries
+    char *strings;            // Paths of the entries
+    u32 stringsSize;          // Size of the paths, in bytes
+} catalog_t;
+
+/**
+ * Loads a catalog file.
+ *
+ * @param catalog The catalog to load into - Empty if loading fails.
+ * @param path The catalog file.
+ * @return Whether the catalog was loaded.
+ */
+bool loadCatalog(catalog_t *catalog, const char *path);
+
+/**
+ * Writes a catalog to a file, replacing it atomically.
+ *
+ * @param catalog The catalog.
+ * @param path The catalog file.
+ * @return Whether the catalog was written.
+ */
+bool saveCatalog(const catalog_t *catalog, const char *path);
+
+/**
+ * Scans directories for ROMs (.gb and .gbc files) and updates a catalog with
+ * them. Only files whose size or modification time changed are read again,
+ * on a pool of threads.
+ *
+ * @param catalog The catalog to update - Files that are gone are removed.
+ * @param directories The directories to scan, recursively.
+ * @param count The number of directories.
+ * @param threads The number of threads, or 0 for one per CPU.
+ * @return The number of ROMs that were read, or -1 if scanning failed.
+ */
+int scanCatalog(catalog_t *catalog, const char **directories, int count,
+                int threads);
+
+/**
+ * Finds the entry of a ROM in a catalog.
+ *
+ * @param catalog The catalog.
+ * @param path The path of the ROM, as scanned.
+ * @return The entry, or NULL if the ROM isn't catalogued.
+ */
+const catalogEntry_t *findCatalogEntry(const catalog_t *catalog,
+                                       const char *path);
+
+/**
+ * Gets the path of a catalogued ROM.
+ *
+ * @param catalog The catalog.
+ * @param entry The entry.
+ * @return The path of the ROM.
+ */
+const char *getCatalogPath(const catalog_t *catalog,
+                           const catalogEntry_t *entry);
+
+/**
+ * Frees a catalog's entries and paths, leaving it empty.
+ *
+ * @param catalog The catalog.
+ */
+void freeCatalog(catalog_t *catalog);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <common.h>
+#include <stdatomic.h>
+
+// Bytes kept between the producer's and consumer's indices, so that they
+// never share a cache line
+#define CHANNEL_PADDING 64
+
+// Channel - A lock-free ring of fixed-size messages from one producer thread
+// to one consumer thread. Each index is only written by one side, and each
+// side keeps a copy of the other's index, which it only loads again when the
+// ring looks full or empty.
+typedef struct {
+    u8 *messages;  // Ring of messages
+    u32 capacity;  // Number of messages in the ring, a power of two
+    u32 size;      // Size of a message, in bytes
+
+    u8 producerPadding[CHANNEL_PADDING];
+    _Atomic u32 head;  // Count of messages sent, written by the producer
+    u32 cachedTail;    // Producer's copy of tail
+    u64 dropped;       // Messages not sent because the ring was full
+
+    u8 consumerPadding[CHANNEL_PADDING];
+    _Atomic u32 tail;  // Count of messages received, written by the consumer
+    u32 cachedHead;    // Consumer's copy of head
+} channel_t;
+
+/**
+ * Creates a channel.
+ *
+ * @param ch The channel.
+ * @param capacity The number of messages it holds, a power of two.
+ * @param size The size of a message, in bytes.
+ * @return Whether the ring could be allocated.
+ */
+bool createChannel(channel_t *ch, u32 capacity, u32 size);
+
+/**
+ * Destroys a channel, once neither thread uses it. Channels that were never
+ * created (zeroed) may be destroyed too.
+ *
+ * @param ch The channel.
+ */
+void destroyChannel(channel_t *ch);
+
+/**
+ * Sends a message. Only called by the producer thread; never blocks.
+ *
+ * @param ch The channel.
+ * @param message The message, of the channel's message size.
+ * @return Whether the message was sent, or false (and counted as dropped)
+ * if the ring is full.
+ */
+bool sendMessage(channel_t *ch, const void *message);
+
+/**
+ * Receives the oldest message. Only called by the consumer thread; never
+ * blocks.
+ *
+ * @param ch The channel.
+ * @param message The message to fill in, of the channel's message size.
+ * @return Whether a message was received, or false if the ring is empty.
+ */
+bool receiveMessage(channel_t *ch, void *message);
+
+/**
+ * Checks whether there is nothing to receive. Only called by the consumer
+ * thread.
+ *
+ * @param ch The channel.
+ * @return Whether the ring is empty.
+ */
+bool isChannelEmpty(channel_t *ch);
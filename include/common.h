@@ -11,6 +11,16 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+// * Game Boy instance, defined in gb.h and passed to every emulator function
+typedef struct gb gb_t;
+
+// * Compiler hints
+#if defined(_MSC_VER)
+#define ALWAYS_INLINE __forceinline
+#else
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
 // * Color codes
 #define CRED "\e[0;31m"  // For errors
 #define CGRN "\e[0;32m"  // For success
@@ -70,10 +80,3 @@ static inline u8 SETBIT(u8 a, u8 n, bool on) {
  * @return Whether the value is between the two bounds.
  */
 static inline bool BETWEEN(u8 a, u8 b, u8 c) { return (a >= b) && (a <= c); }
-
-/**
- * Delays the processor for a given number of milliseconds.
- *
- * @param ms The number of milliseconds to delay.
- */
-void delay(u32 ms);
@@ -2,31 +2,93 @@
 
 #include <common.h>
 #include <instructions.h>
+#include <bus.h>
+#include <emu.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Available instruction dispatch cores
+typedef enum {
+    CORE_GENERIC,  // fetchData() and getProcessorForInstructionType()
+    CORE_TABLE,    // Per-opcode handlers generated from instructions.def
+    CORE_BLOCK,    // Cached blocks of pre-decoded opcode handlers
+    CORE_JIT       // Hot cached blocks recompiled to native x86-64 code
+} cpuCore_t;
+
+// Available cycle models
+typedef enum {
+    CYCLES_ACCURATE,  // Emulated at each bus access within an instruction
+    CYCLES_FAST       // Emulated once per instruction, from a static table
+} cycleMode_t;
+
+// A 16-bit register pair, aliased by its two 8-bit registers in host order
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define REGISTER_PAIR(hi, lo) \
+    union {                   \
+        u16 hi##lo;           \
+        struct {              \
+            u8 hi;            \
+            u8 lo;            \
+        };                    \
+    }
+#else
+#define REGISTER_PAIR(hi, lo) \
+    union {                   \
+        u16 hi##lo;           \
+        struct {              \
+            u8 lo;            \
+            u8 hi;            \
+        };                    \
+    }
+#endif
 
 // CPU register structure - Contains all registers and their values
 typedef struct {
-    u8 a;    // Accumulator
-    u8 f;    // Flags
-    u8 b;    // General purpose register
-    u8 c;    // Combines with B for BC register
-    u8 d;    // General purpose register
-    u8 e;    // Combines with D for DE register
-    u8 h;    // General purpose register
-    u8 l;    // Combines with H for HL register
-    u16 pc;  // Program counter
-    u16 sp;  // Stack pointer
+    REGISTER_PAIR(a, f);  // Accumulator and flags
+    REGISTER_PAIR(b, c);  // General purpose registers
+    REGISTER_PAIR(d, e);  // General purpose registers
+    REGISTER_PAIR(h, l);  // General purpose registers, usually an address
+    u16 pc;               // Program counter
+    u16 sp;               // Stack pointer
 } cpuRegisters_t;
 
+// Operations whose flags are evaluated lazily
+typedef enum {
+    FLAGS_NONE,  // The F register is up to date
+    FLAGS_ADD,   // 8-bit ADD and ADC
+    FLAGS_SUB,   // SUB, SBC and CP
+    FLAGS_AND,   // AND
+    FLAGS_OR,    // OR and XOR
+    FLAGS_INC,   // 8-bit INC, keeps the carry flag
+    FLAGS_DEC    // 8-bit DEC, keeps the carry flag
+} lazyFlagsOp_t;
+
+// Lazy flags structure - The last ALU operation whose flags weren't computed
+typedef struct {
+    u8 op;      // Operation (lazyFlagsOp_t)
+    u8 left;    // Left operand
+    u8 right;   // Right operand
+    u8 carry;   // Carry into the operation
+    u8 result;  // 8-bit result of the operation
+} lazyFlags_t;
+
 // CPU context structure - Contains all CPU state
 typedef struct {
+    gb_t *gb;                  // Instance the CPU belongs to
     cpuRegisters_t registers;  // Registers and their values
+    lazyFlags_t lazyFlags;     // Flags not yet written to the F register
     u16 fetchedData;  // Current data fetched from instruction (immediate)
 
     u16 memoryDestination;     // Memory destination for current processing
     bool destinationIsMemory;  // Is the destination a memory location?
 
-    u8 currentOpcode;                   // Current instruction opcode
-    instruction_t *currentInstruction;  // Current instruction
+    u8 currentOpcode;                         // Current instruction opcode
+    const instruction_t *currentInstruction;  // Current instruction
+    cpuCore_t core;                           // Dispatch core in use
+    cycleMode_t cycleMode;                    // Cycle model in use
+    const u8 *fetchCycles;  // CPU cycles emulated when fetching each opcode
+    u64 runUntil;           // Emulator tick at which runCPUFor() checks events
+    _Atomic bool stopping;  // Whether stopCPU() was called and not honored yet
 
     bool halted;    // Is the CPU halted?
     bool stepping;  // Stepping mode (DBG)
@@ -35,11 +97,152 @@ typedef struct {
     bool enablingIME;             // Whether IME is currently being enabled
     u8 interruptEnableRegister;   // Interrupt enable register
     u8 interruptFlags;            // Interrupt flags register
+    u8 pendingInterrupts;         // IE & IF while IME is set, else 0
 } cpuContext_t;
 
 // Function pointer for instruction processing
 typedef void (*IN_PROC)(cpuContext_t *);
 
+// Function pointer for a compiled block, given the block cache's invalidation
+// count so that it can stop once its own code is overwritten. Returns false,
+// without running, if the slice may end before the block does.
+typedef bool (*JIT_PROC)(cpuContext_t *, const u32 *);
+
+// Maximum number of instructions in a block
+#define BLOCK_MAX_INSTRUCTIONS 32
+// Number of blocks held by the cache - must be a power of two
+#define BLOCK_CACHE_SIZE 2048
+// Number of RAM bytes that blocks can be decoded from (WRAM, then HRAM)
+#define BLOCK_RAM_SIZE (0x2000 + 0x7F)
+// Number of 256-byte pages of those RAM bytes
+#define BLOCK_RAM_PAGES ((BLOCK_RAM_SIZE + 0xFF) / 0x100)
+
+// A pre-decoded instruction of a block
+typedef struct {
+    IN_PROC handler;  // Generated handler for the opcode
+    u8 opcode;        // Opcode of the instruction
+} blockInstruction_t;
+
+// A run of instructions ending at a branch, RET, RST or HALT
+typedef struct {
+    bool valid;      // Whether the block can be executed
+    u16 bank;        // ROM bank the block was decoded from (0 outside banks)
+    u16 start;       // Address of the first instruction
+    u16 end;         // Address after the last byte of the block
+    u8 count;        // Number of instructions in the block
+    u16 executions;  // Number of times the block was executed
+    JIT_PROC code;   // Compiled block, NULL until the block is hot
+    blockInstruction_t instructions[BLOCK_MAX_INSTRUCTIONS];
+} block_t;
+
+// Block cache context - Contains the cached blocks, keyed by (bank, PC)
+typedef struct {
+    block_t blocks[BLOCK_CACHE_SIZE];  // Direct-mapped blocks
+    u16 ramCoverage[BLOCK_RAM_SIZE];   // Number of blocks covering RAM bytes
+    u32 invalidations;                 // Number of invalidations so far
+    // Bitmaps of the slots of the blocks on each RAM page
+    u64 ramPageSlots[BLOCK_RAM_PAGES][BLOCK_CACHE_SIZE / 64];
+} blockCacheContext_t;
+
+// Number of loops remembered - must be a power of two
+#define IDLE_LOOP_SLOTS 64
+
+// A loop ending in a backward jump
+typedef struct {
+    bool valid;            // Whether the slot holds a loop
+    bool polling;          // Whether the loop only reads memory
+    u16 bank;              // ROM bank the loop was decoded from
+    u16 head;              // Address jumped back to
+    u16 end;               // Address after the jump
+    u16 addressRegisters;  // Registers used as addresses (1 << registerType)
+} idleLoop_t;
+
+// Idle loop context - Contains the loops jumped back to
+typedef struct {
+    idleLoop_t loops[IDLE_LOOP_SLOTS];  // Loops, by head address
+    bool iterating;  // Whether an iteration is being run by skipIdleLoop()
+} idleLoopContext_t;
+
+// JIT context - Contains the executable memory and the emitting position
+typedef struct {
+    u8 *code;     // Executable memory, allocated on first use
+    u32 used;     // Number of bytes emitted into the executable memory
+    bool failed;  // Whether executable memory couldn't be allocated
+} jitContext_t;
+
+// ===== Flag functions ========================================================
+
+/**
+ * Computes the flags of the last lazily evaluated operation into the F
+ * register.
+ *
+ * @param ctx The CPU context.
+ */
+void evaluateLazyFlags(cpuContext_t *ctx);
+
+/**
+ * Brings the F register up to date. Called wherever the flags are observed.
+ *
+ * @param ctx The CPU context.
+ */
+static inline void materializeCPUFlags(cpuContext_t *ctx) {
+    if (ctx->lazyFlags.op != FLAGS_NONE) {
+        evaluateLazyFlags(ctx);
+    }
+}
+
+// ===== Cycle functions =======================================================
+
+/**
+ * Gets the number of CPU cycles emulated when fetching an opcode. With
+ * accurate cycles, that is the fetch itself; with fast cycles, it is the whole
+ * instruction with conditional branches not taken.
+ *
+ * @param ctx The CPU context.
+ * @param opcode The opcode.
+ * @return The number of CPU cycles.
+ */
+static inline u8 getFetchCycles(cpuContext_t *ctx, u8 opcode) {
+    return ctx->fetchCycles[opcode];
+}
+
+/**
+ * Checks whether stopCPU() was called, for the dispatch loops to leave
+ * between instructions. runCPUFor() honors and clears the stop.
+ *
+ * @param ctx The CPU context.
+ * @return Whether the CPU is stopping.
+ */
+static inline bool isCPUStopping(cpuContext_t *ctx) {
+    return atomic_load_explicit(&ctx->stopping, memory_order_relaxed);
+}
+
+/**
+ * Emulates the cycles of a bus access or internal delay within an
+ * instruction. Fast cycles already counted them when fetching the opcode.
+ *
+ * @param ctx The CPU context.
+ * @param cycles The number of CPU cycles.
+ */
+static inline void emulateAccessCycles(cpuContext_t *ctx, u64 cycles) {
+    if (ctx->cycleMode == CYCLES_ACCURATE) {
+        emulateCPUCycles(ctx->gb, cycles);
+    }
+}
+
+/**
+ * Emulates cycles missing from the cycle table: taken conditional branches
+ * and CB operations on (HL). Accurate cycles count them as accesses instead.
+ *
+ * @param ctx The CPU context.
+ * @param cycles The number of CPU cycles.
+ */
+static inline void emulateExtraCycles(cpuContext_t *ctx, u64 cycles) {
+    if (ctx->cycleMode == CYCLES_FAST) {
+        emulateCPUCycles(ctx->gb, cycles);
+    }
+}
+
 // ===== Bit functions =========================================================
 
 /**
@@ -49,6 +252,7 @@ typedef void (*IN_PROC)(cpuContext_t *);
  * @return The zero bit.
  */
 static inline bool CPUFLAG_ZEROBIT(cpuContext_t *ctx) {
+    materializeCPUFlags(ctx);
     return BIT(ctx->registers.f, 7);
 }
 
@@ -59,6 +263,7 @@ static inline bool CPUFLAG_ZEROBIT(cpuContext_t *ctx) {
  * @return The negative bit.
  */
 static inline bool CPUFLAG_NEGATIVEBIT(cpuContext_t *ctx) {
+    materializeCPUFlags(ctx);
     return BIT(ctx->registers.f, 6);
 }
 
@@ -69,6 +274,7 @@ static inline bool CPUFLAG_NEGATIVEBIT(cpuContext_t *ctx) {
  * @return The half-carry bit.
  */
 static inline bool CPUFLAG_HALFCARRYBIT(cpuContext_t *ctx) {
+    materializeCPUFlags(ctx);
     return BIT(ctx->registers.f, 5);
 }
 
@@ -79,15 +285,157 @@ static inline bool CPUFLAG_HALFCARRYBIT(cpuContext_t *ctx) {
  * @return The carry bit.
  */
 static inline bool CPUFLAG_CARRYBIT(cpuContext_t *ctx) {
+    materializeCPUFlags(ctx);
     return BIT(ctx->registers.f, 4);
 }
 
+// ===== Register access functions =============================================
+
+// Offsets of the registers in cpuRegisters_t, indexed by register type
+static const u8 REGISTER_OFFSETS[] = {
+    [RT_A] = offsetof(cpuRegisters_t, a),
+    [RT_F] = offsetof(cpuRegisters_t, f),
+    [RT_B] = offsetof(cpuRegisters_t, b),
+    [RT_C] = offsetof(cpuRegisters_t, c),
+    [RT_D] = offsetof(cpuRegisters_t, d),
+    [RT_E] = offsetof(cpuRegisters_t, e),
+    [RT_H] = offsetof(cpuRegisters_t, h),
+    [RT_L] = offsetof(cpuRegisters_t, l),
+    [RT_AF] = offsetof(cpuRegisters_t, af),
+    [RT_BC] = offsetof(cpuRegisters_t, bc),
+    [RT_DE] = offsetof(cpuRegisters_t, de),
+    [RT_HL] = offsetof(cpuRegisters_t, hl),
+    [RT_SP] = offsetof(cpuRegisters_t, sp),
+    [RT_PC] = offsetof(cpuRegisters_t, pc)};
+
+/**
+ * Gets a pointer to a one byte register of a CPU context.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type, from RT_A to RT_L.
+ * @return The register.
+ */
+static ALWAYS_INLINE u8 *getRegister8(cpuContext_t *ctx,
+                                      registerType_t registerType) {
+    return (u8 *)&ctx->registers + REGISTER_OFFSETS[registerType];
+}
+
+/**
+ * Gets a pointer to a two byte register of a CPU context.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type, from RT_AF to RT_PC.
+ * @return The register.
+ */
+static ALWAYS_INLINE u16 *getRegister16(cpuContext_t *ctx,
+                                        registerType_t registerType) {
+    return (u16 *)((u8 *)&ctx->registers + REGISTER_OFFSETS[registerType]);
+}
+
+/**
+ * Reads a register from a CPU context. Inlined so that a constant register
+ * type resolves at compile time in the generated opcode handlers.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type.
+ * @return The value of the register.
+ */
+static ALWAYS_INLINE u16 readRegister(cpuContext_t *ctx,
+                                      registerType_t registerType) {
+    if (registerType == RT_NONE) {
+        return 0;
+    }
+
+    if (registerType == RT_F || registerType == RT_AF) {
+        materializeCPUFlags(ctx);
+    }
+
+    if (registerType < RT_AF) {
+        return *getRegister8(ctx, registerType);
+    }
+    return *getRegister16(ctx, registerType);
+}
+
+/**
+ * Writes a value to a register of a CPU context.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type.
+ * @param value The value to write.
+ */
+static ALWAYS_INLINE void setRegister(cpuContext_t *ctx,
+                                      registerType_t registerType, u16 value) {
+    if (registerType == RT_NONE) {
+        return;
+    }
+
+    // Pending flags would overwrite the new value
+    if (registerType == RT_F || registerType == RT_AF) {
+        ctx->lazyFlags.op = FLAGS_NONE;
+    }
+
+    if (registerType < RT_AF) {
+        *getRegister8(ctx, registerType) = value & 0xFF;
+    } else {
+        *getRegister16(ctx, registerType) = value;
+    }
+}
+
+/**
+ * Reads a one byte register of a CPU context, where RT_HL refers to the byte
+ * in memory at HL. Only used for CB operations.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type.
+ * @return The value of the register.
+ */
+static ALWAYS_INLINE u8 readRegister8(cpuContext_t *ctx,
+                                      registerType_t registerType) {
+    if (registerType == RT_HL) {
+        return readBus(ctx->gb, ctx->registers.hl);
+    }
+
+    if (registerType == RT_NONE || registerType >= RT_AF) {
+        printf("%sERR:%s Invalid read for register 8 (type %d).\n", CRED,
+               CRST, registerType);
+        exit(EXIT_FAILURE);
+    }
+
+    return readRegister(ctx, registerType);
+}
+
+/**
+ * Writes a one byte register of a CPU context, where RT_HL refers to the byte
+ * in memory at HL. Only used for CB operations.
+ *
+ * @param ctx The CPU context.
+ * @param registerType The register type.
+ * @param value The value to write.
+ */
+static ALWAYS_INLINE void setRegister8(cpuContext_t *ctx,
+                                       registerType_t registerType, u8 value) {
+    if (registerType == RT_HL) {
+        writeBus(ctx->gb, ctx->registers.hl, value);
+        return;
+    }
+
+    if (registerType == RT_NONE || registerType >= RT_AF) {
+        printf("%sERR:%s Invalid set for register 8 (type %d).\n", CRED,
+               CRST, registerType);
+        exit(EXIT_FAILURE);
+    }
+
+    setRegister(ctx, registerType, value);
+}
+
 // ===== CPU fetch functions ===================================================
 
 /**
  * Fetches data for the current instruction.
+ *
+ * @param gb The Game Boy instance.
  */
-void fetchData();
+void fetchData(gb_t *gb);
 
 // ===== CPU processor functions ===============================================
 
@@ -99,88 +447,247 @@ void fetchData();
  */
 IN_PROC getProcessorForInstructionType(instructionType_t type);
 
+/**
+ * Gets the generated handler for an opcode. A handler fetches the operands
+ * and executes the instruction in one call, with the addressing mode and
+ * registers resolved at compile time.
+ *
+ * @param opcode The opcode.
+ * @return The handler function pointer.
+ */
+IN_PROC getHandlerForOpcode(u8 opcode);
+
+// ===== CPU block cache functions =============================================
+
+/**
+ * Empties the block cache.
+ *
+ * @param gb The Game Boy instance.
+ */
+void clearCPUBlocks(gb_t *gb);
+
+/**
+ * Invalidates the cached blocks covering an address. Called for every write
+ * to WRAM or HRAM, so that code copied to or patched in RAM is decoded again.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address written to.
+ */
+void invalidateCPUBlocks(gb_t *gb, u16 address);
+
+/**
+ * Executes the cached block at the program counter, decoding it first if it
+ * isn't cached. Returns early once the runCPUFor() budget is spent, the CPU
+ * halts, the block is invalidated by a write or stopCPU() is called. With the
+ * JIT core, hot blocks are compiled into native code that returns early in
+ * the same places. Neither runs while tracing, which records every
+ * instruction through stepCPU().
+ *
+ * @param gb The Game Boy instance.
+ */
+void executeCPUBlock(gb_t *gb);
+
+// ===== CPU idle loop functions ===============================================
+
+/**
+ * Forgets all loops, e.g. when a new cartridge is run.
+ *
+ * @param gb The Game Boy instance.
+ */
+void clearIdleLoops(gb_t *gb);
+
+/**
+ * Called after a backward jump to the program counter. If the jump closes a
+ * polling loop, runs one iteration; when it comes back to the head with the
+ * registers unchanged, skips as many further iterations as fit before the
+ * runCPUFor() deadline. The loop then runs normally up to the deadline, so the
+ * state is the same as if every iteration was run.
+ *
+ * @param gb The Game Boy instance.
+ * @param end The address after the jump.
+ */
+void skipIdleLoop(gb_t *gb, u16 end);
+
+// ===== CPU JIT functions =====================================================
+
+/**
+ * Checks whether blocks can be compiled on this platform.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the JIT is available.
+ */
+bool isJITAvailable(gb_t *gb);
+
+/**
+ * Discards all compiled blocks.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetJIT(gb_t *gb);
+
+/**
+ * Frees the executable memory of the compiled blocks.
+ *
+ * @param gb The Game Boy instance.
+ */
+void freeJIT(gb_t *gb);
+
+/**
+ * Compiles a block of instructions into native code. Loads, stores, ALU
+ * operations and the final JR or JP are emitted inline, the rest call their
+ * opcode handler. Cycles are added to the ticks before they can be observed,
+ * and the block leaves after any instruction where the block core would, so
+ * both stop at the same tick. Blocks that may not finish within the
+ * runCPUFor() slice return false before running, for the block core to run.
+ *
+ * @param gb The Game Boy instance.
+ * @param pc The address of the first instruction.
+ * @param count The number of instructions in the block.
+ * @param fetchCycles The CPU cycles emulated when fetching each opcode.
+ * @return The compiled block, or NULL if the executable memory is full.
+ */
+JIT_PROC compileJITBlock(gb_t *gb, u16 pc, u8 count, const u8 *fetchCycles);
+
 // ===== CPU utility functions =================================================
 
 /**
  * Reads a CPU register.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  */
-u16 readCPURegister(registerType_t registerType);
+u16 readCPURegister(gb_t *gb, registerType_t registerType);
 
 /**
  * Writes a value to a CPU register.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @param val The value to write.
  */
-void setCPURegister(registerType_t registerType, u16 value);
+void setCPURegister(gb_t *gb, registerType_t registerType, u16 value);
 
 /**
  * Gets the registers from the CPU.
  *
+ * @param gb The Game Boy instance.
  * @return The CPU registers.
  */
-cpuRegisters_t *getCPURegisters();
+cpuRegisters_t *getCPURegisters(gb_t *gb);
 
 /**
  * Reads the CPU Interrupt Enable (IE) register.
  *
+ * @param gb The Game Boy instance.
  * @return The value of the IE register.
  */
-u8 readCPUIERegister();
+u8 readCPUIERegister(gb_t *gb);
 
 /**
  * Writes a value to the CPU Interrupt Enable (IE) register.
  *
+ * @param gb The Game Boy instance.
  * @param value The value to write.
  */
-void setCPUIERegister(u8 value);
+void setCPUIERegister(gb_t *gb, u8 value);
 
 /**
  * Reads a CPU register of one byte only.
  * Only used for CB operations.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @return The value of the register.
  */
-u8 readCPURegister8(registerType_t registerType);
+u8 readCPURegister8(gb_t *gb, registerType_t registerType);
 
 /**
  * Writes a value to a CPU register of one byte only.
  * Only used for CB operations.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @param value The value to write.
  */
-void setCPURegister8(registerType_t registerType, u8 value);
+void setCPURegister8(gb_t *gb, registerType_t registerType, u8 value);
 
 /**
  * Reads the CPU Interrupt Flags register.
  *
+ * @param gb The Game Boy instance.
  * @return The value of the IF register.
  */
-u8 getCPUInterruptFlags();
+u8 getCPUInterruptFlags(gb_t *gb);
 
 /**
  * Writes a value to the CPU Interrupt Flags register.
  *
+ * @param gb The Game Boy instance.
  * @param flags The flags to set.
  */
-void setCPUInterruptFlags(u8 flags);
-
-// ===== Instruction utility functions =========================================
-
-void instructionToString(cpuContext_t *ctx, char *str);
+void setCPUInterruptFlags(gb_t *gb, u8 flags);
 
 // ===== CPU functions =========================================================
 
 /**
  * Initializes the CPU.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeCPU(gb_t *gb);
+
+/**
+ * Selects the core used to dispatch instructions.
+ *
+ * @param gb The Game Boy instance.
+ * @param core The dispatch core.
+ */
+void setCPUCore(gb_t *gb, cpuCore_t core);
+
+/**
+ * Selects the cycle model. Fast cycles emulate a whole instruction when its
+ * opcode is fetched, so its bus accesses all see the time after it.
+ *
+ * @param gb The Game Boy instance.
+ * @param mode The cycle model.
  */
-void initializeCPU();
+void setCPUCycleMode(gb_t *gb, cycleMode_t mode);
 
 /**
  * Steps the CPU by one instruction.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stepCPU(gb_t *gb);
+
+/**
+ * Runs the CPU for a budget of CPU cycles. The table core uses a threaded
+ * dispatch loop and the block core runs cached blocks; the generic core and
+ * tracing step one instruction at a time. The CPU runs freely up to the next
+ * scheduled event, whose handler runs before the CPU continues. Returns early,
+ * after the instruction it is running, once stopCPU() is called.
+ *
+ * @param gb The Game Boy instance.
+ * @param cycles The number of CPU cycles to run for.
+ * @return The number of CPU cycles actually run.
+ */
+u64 runCPUFor(gb_t *gb, u64 cycles);
+
+/**
+ * Requests that runCPUFor() returns, from any thread or event handler. A
+ * running runCPUFor() returns after the instruction it is running, once the
+ * events then due are handled; otherwise the next call returns without
+ * running.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stopCPU(gb_t *gb);
+
+/**
+ * Makes a running runCPUFor() handle scheduled events by the given tick.
+ * Instructions aren't interrupted, so events may run a few ticks late.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick.
  */
-void stepCPU();
+void limitCPURun(gb_t *gb, u64 ticks);
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cpu.h>
+#include <bus.h>
+#include <emu.h>
+
+// ===== Fetching data =========================================================
+
+/**
+ * Fetches the operands of an instruction into the CPU context.
+ * Shared by fetchData() and the generated opcode handlers, which pass a
+ * constant instruction so that the addressing mode resolves at compile time.
+ *
+ * @param ctx The CPU context.
+ * @param instruction The instruction being executed.
+ * @param opcode The opcode of the instruction, for error reporting.
+ */
+static ALWAYS_INLINE void fetchOperands(cpuContext_t *ctx,
+                                        const instruction_t *instruction,
+                                        u8 opcode) {
+    ctx->memoryDestination = 0;
+    ctx->destinationIsMemory = false;
+
+    // Handle different instruction modalities
+    switch (instruction->mode) {
+        // Implied - Nothing to read after this
+        case AM_IMP:
+            return;
+
+        // Single register
+        case AM_R:
+            ctx->fetchedData = readRegister(ctx, instruction->register1);
+            return;
+
+        // Register into register
+        case AM_R_R:
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+
+            return;
+
+        // 8-bit bus data into register
+        case AM_R_D8:
+            ctx->fetchedData = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+
+            return;
+
+        // 16-bit bus data into register
+        case AM_R_D16: {
+            // Separated for cycle accuracy
+            u16 lo = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);
+            u16 hi = readBus(ctx->gb, ctx->registers.pc + 1);
+            emulateAccessCycles(ctx, 1);
+
+            ctx->fetchedData = lo | (hi << 8);
+            ctx->registers.pc += 2;
+
+            return;
+        }
+
+        // 8-bit address into register
+        case AM_R_A8: {
+            ctx->fetchedData = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+            return;
+        }
+
+        // 16-bit address into register
+        case AM_R_A16: {
+            // Separated for cycle accuracy
+            u16 lo = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);
+            u16 hi = readBus(ctx->gb, ctx->registers.pc + 1);
+            emulateAccessCycles(ctx, 1);
+
+            u16 addr = lo | (hi << 8);
+
+            ctx->registers.pc += 2;
+            ctx->fetchedData = readBus(ctx->gb, addr);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            return;
+        }
+
+        // Memory location into register
+        case AM_R_MR: {
+            u16 addr = readRegister(ctx, instruction->register2);
+
+            if (instruction->register2 == RT_C) {
+                addr |= 0xFF00;
+            }
+
+            ctx->fetchedData = readBus(ctx->gb, addr);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+
+            return;
+        }
+
+        // HL register into register, then increment
+        case AM_R_HLI: {
+            ctx->fetchedData =
+                readBus(ctx->gb, readRegister(ctx, instruction->register2));
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.hl++;
+            return;
+        }
+
+        // HL register into register, then decrement
+        case AM_R_HLD: {
+            ctx->fetchedData =
+                readBus(ctx->gb, readRegister(ctx, instruction->register2));
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.hl--;
+            return;
+        }
+
+        // Memory location (reference in register)
+        case AM_MR: {
+            ctx->memoryDestination = readRegister(ctx, instruction->register1);
+            ctx->destinationIsMemory = true;
+            ctx->fetchedData =
+                readBus(ctx->gb, readRegister(ctx, instruction->register1));
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            return;
+        }
+
+        // Register into memory location (reference in register)
+        case AM_MR_R: {
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+            ctx->memoryDestination = readRegister(ctx, instruction->register1);
+            ctx->destinationIsMemory = true;
+
+            if (instruction->register1 == RT_C) {
+                ctx->memoryDestination |= 0xFF00;
+            }
+
+            return;
+        }
+
+        // 8-bit data into memory location (reference in register)
+        case AM_MR_D8: {
+            ctx->fetchedData = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+            ctx->memoryDestination = readRegister(ctx, instruction->register1);
+            ctx->destinationIsMemory = true;
+            return;
+        }
+
+        // Stack pointer into HL register, increment by R8
+        case AM_HL_SPR: {
+            ctx->fetchedData = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+            return;
+        }
+
+        // Register into HL register, then increment
+        case AM_HLI_R: {
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+            ctx->memoryDestination = readRegister(ctx, instruction->register1);
+            ctx->destinationIsMemory = true;
+            ctx->registers.hl++;
+            return;
+        }
+
+        // Register into HL register, then decrement
+        case AM_HLD_R: {
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+            ctx->memoryDestination = readRegister(ctx, instruction->register1);
+            ctx->destinationIsMemory = true;
+            ctx->registers.hl--;
+            return;
+        }
+
+        // 8-bit data
+        case AM_D8:
+            ctx->fetchedData = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+            return;
+
+        // 16-bit data
+        case AM_D16: {
+            // Separated for cycle accuracy
+            u16 lo = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);
+            u16 hi = readBus(ctx->gb, ctx->registers.pc + 1);
+            emulateAccessCycles(ctx, 1);
+
+            ctx->fetchedData = lo | (hi << 8);
+            ctx->registers.pc += 2;
+
+            return;
+        }
+
+        // Register into 16-bit address
+        case AM_D16_R: {
+            u16 lo = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);
+            u16 hi = readBus(ctx->gb, ctx->registers.pc + 1);
+            emulateAccessCycles(ctx, 1);
+
+            ctx->memoryDestination = lo | (hi << 8);
+            ctx->destinationIsMemory = true;
+
+            ctx->registers.pc += 2;
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+            return;
+        }
+
+        // Register into 8-bit address
+        case AM_A8_R: {
+            ctx->memoryDestination =
+                readBus(ctx->gb, ctx->registers.pc) | 0xFF00;
+            ctx->destinationIsMemory = true;
+            emulateAccessCycles(ctx, 1);  // 1 CPU cycle for bus reading
+            ctx->registers.pc++;
+            return;
+        }
+
+        // Register to 16-bit address
+        case AM_A16_R: {
+            // Separated for cycle accuracy
+            u16 lo = readBus(ctx->gb, ctx->registers.pc);
+            emulateAccessCycles(ctx, 1);
+            u16 hi = readBus(ctx->gb, ctx->registers.pc + 1);
+            emulateAccessCycles(ctx, 1);
+
+            ctx->memoryDestination = lo | (hi << 8);
+            ctx->destinationIsMemory = true;
+
+            ctx->registers.pc += 2;
+            ctx->fetchedData = readRegister(ctx, instruction->register2);
+            return;
+        }
+
+        default:
+            printf("%sERR:%s Unknown addressing mode! %s%d%s (%s0x%02X%s)\n",
+                   CRED, CRST, CYEL, instruction->mode, CRST, CMAG, opcode,
+                   CRST);
+            exit(EXIT_FAILURE);
+    }
+}
@@ -2,12 +2,24 @@
 
 #include <common.h>
 
+// Debug context - Contains the message sent over the serial port
+typedef struct {
+    char message[1024];  // Characters received so far
+    int size;            // Number of characters received
+    int printedSize;     // Message size at the last debugPrint()
+} dbgContext_t;
+
 /**
- * Updates the debug message with the latest serial data.
+ * Appends a byte received over the serial port to the debug message.
+ *
+ * @param gb The Game Boy instance.
+ * @param c The byte that was received.
  */
-void debugUpdate();
+void debugUpdate(gb_t *gb, u8 c);
 
 /**
- * Prints the current debug message.
+ * Prints the current debug message, if it changed since the last print.
+ *
+ * @param gb The Game Boy instance.
  */
-void debugPrint();
\ No newline at end of file
+void debugPrint(gb_t *gb);
\ No newline at end of file
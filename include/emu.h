@@ -1,36 +1,175 @@
 #pragma once
 
 #include <common.h>
+#include <channel.h>
+#include <pthread.h>
 
-// Emulator context object, which keeps track of the emulator's state
+// Messages the emulator's channels hold
+#define EMU_COMMAND_CAPACITY 64
+#define EMU_REPORT_CAPACITY 256
+
+// Joypad buttons, as bits of a button mask
+typedef enum {
+    BUTTON_RIGHT = 0x01,
+    BUTTON_LEFT = 0x02,
+    BUTTON_UP = 0x04,
+    BUTTON_DOWN = 0x08,
+    BUTTON_A = 0x10,
+    BUTTON_B = 0x20,
+    BUTTON_SELECT = 0x40,
+    BUTTON_START = 0x80,
+} button_t;
+
+// Commands sent from the UI thread to the CPU thread
+typedef enum {
+    CMD_PAUSE,    // Pause after the current frame
+    CMD_RESUME,   // Resume a paused emulator
+    CMD_STOP,     // Stop the CPU thread after the current frame
+    CMD_BUTTONS,  // Change the pressed buttons
+} commandType_t;
+
+// Command - Sent to the CPU thread, which handles it before its next frame
+typedef struct {
+    commandType_t type;  // What to do
+    u8 buttons;          // Pressed buttons, for CMD_BUTTONS
+    u64 sent;            // Monotonic time the command was sent at, in ns
+} command_t;
+
+// Frame report - Sent from the CPU thread after every frame
+typedef struct {
+    u64 frame;         // Frames run since the CPU thread started
+    u64 ticks;         // Emulator tick at the end of the frame
+    u64 time;          // Monotonic time the frame ended at, in ns
+    u64 inputLatency;  // Longest wait of a command handled before the frame
+} frameReport_t;
+
+// Emulator context object, which keeps track of the emulator's state. The CPU
+// and UI threads only share it through lock-free channels and the exit flag.
+// The mutex is only taken to wake a paused CPU thread.
 typedef struct {
-    bool paused;   // Whether the emulator is paused
-    bool running;  // Whether the emulator is running
-    bool die;      // Whether the emulator should exit
-    u64 ticks;     // Processor ticks
+    channel_t commands;  // UI thread to CPU thread, of command_t
+    channel_t reports;   // CPU thread to UI thread, of frameReport_t
+    _Atomic bool die;    // Whether the emulator should exit
+
+    _Atomic bool sleeping;  // Whether the paused CPU thread waits for commands
+    pthread_mutex_t lock;   // Guards waking the sleeping CPU thread
+    pthread_cond_t wake;    // Signaled when a command is sent while sleeping
+
+    // Owned by the CPU thread once it runs
+    bool paused;     // Whether the emulator is paused
+    bool running;    // Whether the emulator is running
+    u8 buttons;      // Pressed joypad buttons
+    u64 frames;      // Frames run since the CPU thread started
+    u64 ticks;       // Processor ticks (T-cycles, 4 per CPU cycle)
+    u64 cycleLimit;  // CPU cycles to run before exiting, or 0 for no limit
 } emuContext_t;
 
 /**
  * Gets the emulator's context object.
  *
+ * @param gb The Game Boy instance.
  * @return The emulator's context object.
  */
-emuContext_t *getEMUContext();
+emuContext_t *getEMUContext(gb_t *gb);
+
+/**
+ * Creates an instance from the command line, parsing the optional arguments
+ * and loading the ROM file.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The instance, or NULL if the arguments or the ROM file are invalid.
+ */
+gb_t *openEmulator(int argc, char **argv);
+
+/**
+ * Runs the CPU until the emulator stops running or reaches its cycle limit,
+ * which makes it exit. Handles commands, then publishes and reports each
+ * frame, sleeps while paused and waits for the pacer. Used as the CPU thread
+ * by the windowed emulator.
+ *
+ * @param ptr The Game Boy instance to run.
+ * @return NULL.
+ */
+void *runCPU(void *ptr);
 
 /**
- * Runs the emulator system with the given arguments.
- * Acts as a secondary entry point to the emulator.
+ * Runs the emulator without a window, as fast as the host allows, on the
+ * calling thread. Runs until the cycle limit is reached, if one is given.
  *
  * @param argc The number of arguments.
  * @param argv The arguments.
  * @return The exit code.
  */
-int runEmulator(int argc, char **argv);
+int runHeadless(int argc, char **argv);
 
 /**
  * Emulates a given number of CPU cycles.
  * This function is used to emulate elapsed time caused by CPU instructions.
  *
+ * @param gb The Game Boy instance.
  * @param cpuCycles The number of CPU cycles to emulate.
  */
-void emulateCPUCycles(int cpuCycles);
\ No newline at end of file
+void emulateCPUCycles(gb_t *gb, u64 cpuCycles);
+
+/**
+ * Pauses the CPU thread once it finishes its current frame. It sleeps until
+ * resumed or stopped. Commands are only sent from one (the UI) thread.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool pauseEmulator(gb_t *gb);
+
+/**
+ * Resumes a paused CPU thread. Frames are paced from the time it resumes.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool resumeEmulator(gb_t *gb);
+
+/**
+ * Stops the CPU thread, cutting its current frame short, even if paused.
+ * Also requests that the emulator exits, which the CPU thread checks after
+ * every frame, so it stops even if the channel is full.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool stopEmulator(gb_t *gb);
+
+/**
+ * Changes the pressed joypad buttons, from the next frame on.
+ *
+ * @param gb The Game Boy instance.
+ * @param buttons The pressed buttons, a mask of button_t.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool setEmulatorButtons(gb_t *gb, u8 buttons);
+
+/**
+ * Receives the oldest report of a frame the CPU thread finished. Only called
+ * by one (the UI) thread.
+ *
+ * @param gb The Game Boy instance.
+ * @param report The report to fill in.
+ * @return Whether there was a report.
+ */
+bool receiveFrameReport(gb_t *gb, frameReport_t *report);
+
+/**
+ * Requests that the emulator exits, e.g. when the window is closed or the
+ * cycle limit is reached.
+ *
+ * @param gb The Game Boy instance.
+ */
+void exitEmulator(gb_t *gb);
+
+/**
+ * Checks whether the emulator should exit.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether exitEmulator() was called.
+ */
+bool isEmulatorExiting(gb_t *gb);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <common.h>
+#include <stdatomic.h>
+
+// Size of the Game Boy's screen, in pixels
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 144
+
+// Color of a blank screen (shade 0), as ARGB8888
+#define FRAME_BLANK_COLOR 0xFFE0F8D0
+
+// Bytes kept between the core's and the presenter's fields, so that they
+// never share a cache line
+#define FRAME_PADDING 64
+
+// Frame exchange context - Triple buffers the screen between the CPU thread,
+// which draws frames, and the presenter, which shows them. The core draws into
+// its buffer and publishes it by swapping it with the shared one; the
+// presenter takes the newest frame by swapping its buffer with the shared one.
+// Neither side copies a frame or waits for the other.
+typedef struct {
+    u32 pixels[3][FRAME_HEIGHT * FRAME_WIDTH];  // ARGB8888, row by row
+
+    _Atomic u8 shared;  // Buffer between the sides, and whether it is new
+
+    u8 corePadding[FRAME_PADDING];
+    u8 drawing;     // Buffer the core draws into
+    u64 published;  // Frames published by the core
+    u64 dropped;    // Frames replaced before the presenter took them
+
+    u8 presenterPadding[FRAME_PADDING];
+    u8 showing;     // Buffer the presenter shows
+    u64 presented;  // New frames taken by the presenter
+    u64 repeated;   // Times the presenter found no new frame
+} frameContext_t;
+
+/**
+ * Blanks the three buffers. Called when the instance is created, before
+ * either side uses them.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeFrames(gb_t *gb);
+
+/**
+ * Gets the buffer the core draws the current frame into. Only called by the
+ * CPU thread.
+ *
+ * @param gb The Game Boy instance.
+ * @return The pixels (FRAME_WIDTH * FRAME_HEIGHT, ARGB8888).
+ */
+u32 *getDrawingFrame(gb_t *gb);
+
+/**
+ * Publishes the frame that was drawn, then starts drawing into a free buffer.
+ * Only called by the CPU thread.
+ *
+ * @param gb The Game Boy instance.
+ */
+void publishFrame(gb_t *gb);
+
+/**
+ * Takes the newest published frame, or shows the last one again if there is
+ * none. Only called by the presenter thread.
+ *
+ * @param gb The Game Boy instance.
+ * @param fresh Set to whether the frame wasn't shown before, if not NULL.
+ * @return The pixels (FRAME_WIDTH * FRAME_HEIGHT, ARGB8888), which stay
+ * valid until the next call.
+ */
+const u32 *takeFrame(gb_t *gb, bool *fresh);
+
+/**
+ * Prints how many frames were published, presented, dropped and repeated,
+ * once neither side runs.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printFrameStats(gb_t *gb);
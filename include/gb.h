@@ -0,0 +1,82 @@
+#pragma once
+
+#include <common.h>
+#include <emu.h>
+#include <cpu.h>
+#include <bus.h>
+#include <ram.h>
+#include <ppu.h>
+#include <io.h>
+#include <cart.h>
+#include <timer.h>
+#include <rtc.h>
+#include <scheduler.h>
+#include <pacer.h>
+#include <frame.h>
+#include <trace.h>
+#include <dbg.h>
+
+/**
+ * A Game Boy instance owns all of the emulator's state, so a process can run
+ * any number of independent instances, each on its own thread. Every emulator
+ * function takes the instance it acts on; the only state shared between
+ * instances is read-only (instruction tables) or the crash handlers' list of
+ * trace rings.
+ */
+
+// Game Boy instance - Contains the state of every component
+struct gb {
+    emuContext_t emu;              // Emulator state and tick counter
+    cpuContext_t cpu;              // CPU registers and dispatch state
+    blockCacheContext_t blocks;    // Pre-decoded blocks of the block core
+    idleLoopContext_t idleLoops;   // Polling loops skipped by the CPU
+    jitContext_t jit;              // Executable memory of the JIT core
+    busContext_t bus;              // Memory map
+    ramContext_t ram;              // Working and high RAM
+    ppuContext_t ppu;              // Video RAM and OAM
+    ioContext_t io;                // I/O register table and serial port
+    cartContext_t cart;            // Cartridge ROM, RAM and bank registers
+    timerContext_t timer;          // DIV, TIMA, TMA and TAC
+    rtcContext_t rtc;              // MBC3 real-time clock
+    schedulerContext_t scheduler;  // Pending device events
+    pacerContext_t pacer;          // Real-time frame deadlines
+    frameContext_t frames;         // Screen buffers shared with the presenter
+    traceContext_t trace;          // Ring of recently executed instructions
+    dbgContext_t dbg;              // Message received over the serial port
+};
+
+/**
+ * Checks whether instructions are being recorded. Tested before every
+ * instruction, so it is inlined here rather than in trace.h, which can't see
+ * the instance.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether tracing is enabled.
+ */
+static inline bool isTraceEnabled(gb_t *gb) {
+    return gb->trace.records != NULL;
+}
+
+/**
+ * Creates a Game Boy instance, in its state after the boot ROM and without a
+ * cartridge.
+ *
+ * @return The instance, or NULL if it couldn't be allocated.
+ */
+gb_t *createGB();
+
+/**
+ * Resets an instance to its state after the boot ROM, keeping the cartridge
+ * and the selected cores.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetGB(gb_t *gb);
+
+/**
+ * Destroys a Game Boy instance, unloading its cartridge (which flushes
+ * battery-backed RAM) and dumping its trace, if it is tracing.
+ *
+ * @param gb The Game Boy instance, or NULL.
+ */
+void destroyGB(gb_t *gb);
@@ -131,6 +131,14 @@ typedef struct {
  */
 instruction_t *getInstructionFromOpcode(u8 opcode);
 
+/**
+ * Gets the number of bytes taken by an instruction and its operands.
+ *
+ * @param instruction The instruction.
+ * @return The length of the instruction.
+ */
+u8 getInstructionLength(const instruction_t *instruction);
+
 /**
  * Gets a human-readable instruction name from an instruction type.
  *
@@ -138,3 +146,13 @@ instruction_t *getInstructionFromOpcode(u8 opcode);
  * @return The instruction name
  */
 char *getInstructionName(instructionType_t instructionType);
+
+/**
+ * Gets a human-readable instruction string from an opcode and the two bytes
+ * that follow it in memory.
+ *
+ * @param opcode The opcode.
+ * @param operands The two bytes following the opcode.
+ * @param str The string to write to.
+ */
+void instructionToString(u8 opcode, const u8 *operands, char *str);
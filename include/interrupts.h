@@ -11,7 +11,15 @@ typedef enum {
 } interruptType_t;
 
 /**
- * Handles interrupts for the CPU.
+ * Recomputes the mask of interrupts waiting to be serviced. Called whenever
+ * IE, IF or IME change, so the CPU only checks the mask between instructions.
+ *
+ * @param ctx The CPU context.
+ */
+void updateCPUInterrupts(cpuContext_t *ctx);
+
+/**
+ * Services the pending interrupt with the highest priority, if there is one.
  *
  * @param ctx The CPU context.
  */
@@ -2,18 +2,76 @@
 
 #include <common.h>
 
+// Handlers for I/O registers
+typedef u8 (*IO_READ)(gb_t *gb, u16 address);
+typedef void (*IO_WRITE)(gb_t *gb, u16 address, u8 value);
+
+// An I/O register, as registered by the module that owns it
+typedef struct {
+    IO_READ read;    // Reads the register, or NULL if it isn't readable
+    IO_WRITE write;  // Writes the register, or NULL if it isn't writable
+    u8 unusedBits;   // Bits that always read as 1
+} ioRegister_t;
+
+// I/O context - Contains the register table for 0xFF00 - 0xFF7F
+typedef struct {
+    ioRegister_t registers[0x80];  // Handlers, by address - 0xFF00
+    u32 unhandledReads[0x80];      // Reads without a handler, by register
+    u32 unhandledWrites[0x80];     // Writes without a handler, by register
+    u8 serial[2];                  // Serial data (SB) and control (SC)
+} ioContext_t;
+
+/**
+ * Clears the register table and registers the serial port and interrupt
+ * flags. Other modules register their own registers once this has run.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeIO(gb_t *gb);
+
+/**
+ * Registers the handlers for an I/O register, replacing any previous ones.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the register (0xFF00 - 0xFF7F).
+ * @param unusedBits The bits that always read as 1.
+ * @param read The read handler, or NULL if the register isn't readable.
+ * @param write The write handler, or NULL if the register isn't writable.
+ */
+void mapIORegister(gb_t *gb, u16 address, u8 unusedBits, IO_READ read,
+                   IO_WRITE write);
+
+/**
+ * Gets the number of reads and writes of an I/O register without a handler.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the register (0xFF00 - 0xFF7F).
+ * @return The number of unhandled accesses.
+ */
+u32 getUnhandledIOCount(gb_t *gb, u16 address);
+
+/**
+ * Prints the I/O registers that were accessed without a handler, and how
+ * often.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printUnhandledIO(gb_t *gb);
+
 /**
  * Reads a byte from the I/O registers at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the I/O registers.
  */
-u8 readIO(u16 address);
+u8 readIO(gb_t *gb, u16 address);
 
 /**
  * Writes a byte to the I/O registers at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeIO(u16 address, u8 value);
\ No newline at end of file
+void writeIO(gb_t *gb, u16 address, u8 value);
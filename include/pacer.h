@@ -0,0 +1,77 @@
+#pragma once
+
+#include <common.h>
+
+// Frame pacer context - Keeps the CPU thread to the Game Boy's frame rate of
+// 59.7275 Hz (17556 CPU cycles at 1048576 Hz). Deadlines are kept in whole
+// nanoseconds plus a remainder, so they never drift from the exact rate.
+typedef struct {
+    bool enabled;    // Whether frames are paced to real time
+    u64 deadline;    // Monotonic time the next frame is due at, in ns
+    u32 remainder;   // Fraction of a nanosecond of the deadline, in 2^-20 ns
+
+    u64 frames;               // Frames waited for
+    u64 lateFrames;           // Frames already past their deadline
+    u64 resyncs;              // Times the deadlines were restarted
+    double jitterSum;         // Sum of frame jitters, in ns
+    double jitterSumSquares;  // Sum of squared frame jitters, in ns^2
+    u64 maxJitter;            // Largest frame jitter, in ns
+} pacerContext_t;
+
+// Frame pacing statistics. Jitter is how long after its deadline a frame was
+// delivered, in microseconds.
+typedef struct {
+    u64 frames;           // Frames waited for
+    u64 lateFrames;       // Frames already past their deadline
+    u64 resyncs;          // Times the deadlines were restarted
+    double meanJitter;    // Mean jitter
+    double stdDevJitter;  // Standard deviation of the jitter
+    double maxJitter;     // Largest jitter
+} pacerStats_t;
+
+/**
+ * Gets the monotonic time, which frame deadlines are measured in.
+ *
+ * @return The time, in nanoseconds.
+ */
+u64 getMonotonicTime();
+
+/**
+ * Enables or disables pacing frames to real time. Disabled pacers don't wait.
+ *
+ * @param gb The Game Boy instance.
+ * @param enabled Whether to pace frames.
+ */
+void setFramePacing(gb_t *gb, bool enabled);
+
+/**
+ * Starts pacing from now, making the next frame due a frame from now. Called
+ * when the CPU starts running and after it was paused.
+ *
+ * @param gb The Game Boy instance.
+ */
+void startPacer(gb_t *gb);
+
+/**
+ * Waits for the deadline of the frame that was just emulated. Sleeps until
+ * shortly before it, then spins, since sleeps only wake up to the scheduler's
+ * precision.
+ *
+ * @param gb The Game Boy instance.
+ */
+void waitForFrame(gb_t *gb);
+
+/**
+ * Gets the frame pacing statistics since the pacer was enabled.
+ *
+ * @param gb The Game Boy instance.
+ * @param stats The statistics to fill in.
+ */
+void getPacerStats(gb_t *gb, pacerStats_t *stats);
+
+/**
+ * Prints the frame pacing statistics, if any frames were paced.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printPacerStats(gb_t *gb);
@@ -2,5 +2,37 @@
 
 #include <common.h>
 
-void initializePPU();
-void tickPPU();
+// PPU context - Contains all PPU state
+typedef struct {
+    u8 vram[0x2000];  // Video RAM (tile data and maps)
+    u8 oam[0xA0];     // Object attribute memory
+} ppuContext_t;
+
+void initializePPU(gb_t *gb);
+void tickPPU(gb_t *gb);
+
+/**
+ * Gets the video RAM, for mapping it into the bus.
+ *
+ * @param gb The Game Boy instance.
+ * @return The video RAM (0x2000 bytes).
+ */
+u8 *getVideoRAM(gb_t *gb);
+
+/**
+ * Reads a byte from the given address in the object attribute memory.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from.
+ * @return The byte read from the OAM.
+ */
+u8 readOAM(gb_t *gb, u16 address);
+
+/**
+ * Writes a byte to the given address in the object attribute memory.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to.
+ * @param value The value to write.
+ */
+void writeToOAM(gb_t *gb, u16 address, u8 value);
@@ -11,31 +11,43 @@ typedef struct {
 /**
  * Reads a byte from the given address in the working RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the working RAM.
  */
-u8 readWorkingRAM(u16 address);
+u8 readWorkingRAM(gb_t *gb, u16 address);
 
 /**
  * Writes a byte to the given address in the working RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToWorkingRAM(u16 address, u8 value);
+void writeToWorkingRAM(gb_t *gb, u16 address, u8 value);
 
 /**
  * Reads a byte from the given address in the high RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the high RAM.
  */
-u8 readHighRAM(u16 address);
+u8 readHighRAM(gb_t *gb, u16 address);
 
 /**
  * Writes a byte to the given address in the high RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToHighRAM(u16 address, u8 value);
\ No newline at end of file
+void writeToHighRAM(gb_t *gb, u16 address, u8 value);
+
+/**
+ * Gets the working RAM, for mapping it into the bus.
+ *
+ * @param gb The Game Boy instance.
+ * @return The working RAM (0x2000 bytes).
+ */
+u8 *getWorkingRAM(gb_t *gb);
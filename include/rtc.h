@@ -0,0 +1,91 @@
+#pragma once
+
+#include <common.h>
+
+// Size of the clock footer appended to MBC3 save files
+#define RTC_FOOTER_SIZE 48
+
+// Clocks the real-time clock can follow
+typedef enum {
+    RTC_CLOCK_HOST,      // Host wall time, which also passes while not running
+    RTC_CLOCK_EMULATED,  // Emulator ticks, for deterministic runs
+} rtcClock_t;
+
+// Real-time clock context - Contains the MBC3 clock state. The registers
+// aren't counted every second, but worked out from the clock when latched.
+typedef struct {
+    rtcClock_t clock;  // Clock the counter follows
+    u64 seconds;       // Counter, in seconds, as of stamp
+    u64 stamp;         // Clock reading the counter was brought up to date at
+    bool halted;       // Whether the counter is stopped
+    bool carry;        // Whether the day counter overflowed
+    u8 latched[5];     // Seconds, minutes, hours, day low and day high
+    u8 latch;          // Last value written to the latch register
+} rtcContext_t;
+
+/**
+ * Sets the clock the real-time clock follows, keeping its current time.
+ *
+ * @param gb The Game Boy instance.
+ * @param clock The clock to follow.
+ */
+void setRTCClock(gb_t *gb, rtcClock_t clock);
+
+/**
+ * Initializes the real-time clock for a reset of the instance, which the
+ * clock runs through on its own battery. Called before the emulator tick is
+ * reset.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeRTC(gb_t *gb);
+
+/**
+ * Resets the real-time clock to day 0, for cartridges without a saved clock.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetRTC(gb_t *gb);
+
+/**
+ * Loads the real-time clock from a save file footer. With the host clock,
+ * the time since the footer was saved is added.
+ *
+ * @param gb The Game Boy instance.
+ * @param footer The footer (RTC_FOOTER_SIZE bytes).
+ */
+void loadRTC(gb_t *gb, const u8 *footer);
+
+/**
+ * Saves the real-time clock to a save file footer.
+ *
+ * @param gb The Game Boy instance.
+ * @param footer The footer (RTC_FOOTER_SIZE bytes).
+ */
+void saveRTC(gb_t *gb, u8 *footer);
+
+/**
+ * Writes the latch register. Writing 0 then 1 latches the clock registers.
+ *
+ * @param gb The Game Boy instance.
+ * @param value The value to write.
+ */
+void latchRTC(gb_t *gb, u8 value);
+
+/**
+ * Reads a latched clock register.
+ *
+ * @param gb The Game Boy instance.
+ * @param reg The register (0x08 - 0x0C).
+ * @return The value of the register.
+ */
+u8 readRTC(gb_t *gb, u8 reg);
+
+/**
+ * Writes a clock register, setting the counter.
+ *
+ * @param gb The Game Boy instance.
+ * @param reg The register (0x08 - 0x0C).
+ * @param value The value to write.
+ */
+void writeRTC(gb_t *gb, u8 reg, u8 value);
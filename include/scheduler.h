@@ -0,0 +1,81 @@
+#pragma once
+
+#include <common.h>
+
+// Devices that schedule events - each has at most one pending event
+typedef enum {
+    EVENT_PPU,     // PPU mode change
+    EVENT_TIMER,   // TIMA overflow
+    EVENT_SERIAL,  // Serial transfer complete
+    EVENT_DMA,     // OAM DMA byte
+    EVENT_COUNT
+} eventType_t;
+
+// Function pointer for event handling, given the tick the event was due at
+typedef void (*EVENT_PROC)(gb_t *gb, u64 ticks);
+
+// A pending event
+typedef struct {
+    u64 ticks;        // Emulator tick the event is due at
+    EVENT_PROC proc;  // Handler run once the event is due
+    int heapIndex;    // Position in the heap, or -1 if not scheduled
+} event_t;
+
+// Scheduler context - Contains the events, kept in a min-heap by due tick
+typedef struct {
+    event_t events[EVENT_COUNT];    // Events by type
+    eventType_t heap[EVENT_COUNT];  // Scheduled event types, earliest first
+    int size;                       // Number of scheduled events
+} schedulerContext_t;
+
+/**
+ * Removes all scheduled events.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeScheduler(gb_t *gb);
+
+/**
+ * Schedules a device's event, replacing its pending event if there is one.
+ * A running runCPUFor() returns to the scheduler by the time the event is due.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device scheduling the event.
+ * @param ticks The emulator tick the event is due at.
+ * @param proc The handler run once the event is due.
+ */
+void scheduleEvent(gb_t *gb, eventType_t type, u64 ticks, EVENT_PROC proc);
+
+/**
+ * Removes a device's pending event, if there is one.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device.
+ */
+void cancelEvent(gb_t *gb, eventType_t type);
+
+/**
+ * Checks whether a device has a pending event.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device.
+ * @return Whether the event is scheduled.
+ */
+bool isEventScheduled(gb_t *gb, eventType_t type);
+
+/**
+ * Gets the tick the earliest pending event is due at.
+ *
+ * @param gb The Game Boy instance.
+ * @return The tick, or UINT64_MAX if no events are scheduled.
+ */
+u64 getNextEventTicks(gb_t *gb);
+
+/**
+ * Runs the handlers of all events due by the given tick, earliest first.
+ * Handlers may schedule further events, which also run if they are due.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The current emulator tick.
+ */
+void runScheduledEvents(gb_t *gb, u64 ticks);
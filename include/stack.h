@@ -5,27 +5,31 @@
 /**
  * Pushes a byte onto the stack.
  *
+ * @param gb The Game Boy instance.
  * @param data The data to push.
  */
-void pushStack(u8 data);
+void pushStack(gb_t *gb, u8 data);
 
 /**
  * Pops a byte from the stack.
  *
+ * @param gb The Game Boy instance.
  * @return The popped value.
  */
-u8 popStack();
+u8 popStack(gb_t *gb);
 
 /**
  * Pushes a 16-bit value onto the stack.
  *
+ * @param gb The Game Boy instance.
  * @param data The data to push.
  */
-void pushStack16(u16 data);
+void pushStack16(gb_t *gb, u16 data);
 
 /**
  * Pops a 16-bit value from the stack.
  *
+ * @param gb The Game Boy instance.
  * @return The popped value.
  */
-u16 popStack16();
\ No newline at end of file
+u16 popStack16(gb_t *gb);
\ No newline at end of file
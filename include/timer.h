@@ -2,5 +2,40 @@
 
 #include <common.h>
 
-void initializeTimer();
-void tickTimer();
+// Timer context - Contains all timer state. DIV and TIMA aren't counted every
+// cycle, but computed from the emulator tick when they're read or written.
+typedef struct {
+    u64 divOffset;    // Added to the emulator tick to get the divider counter
+    u64 timaTicks;    // Emulator tick TIMA was last brought up to date at
+    u64 reloadTicks;  // Emulator tick TIMA was (or will be) reloaded from TMA
+    bool reloading;   // Whether TIMA overflowed and awaits its reload
+    u8 tima;          // Timer counter (TIMA)
+    u8 tma;           // Timer modulo (TMA)
+    u8 tac;           // Timer control (TAC)
+} timerContext_t;
+
+/**
+ * Initializes the timer to its state after the boot ROM and registers its I/O
+ * registers. Called once the emulator tick is reset.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeTimer(gb_t *gb);
+
+/**
+ * Reads a timer register (DIV, TIMA, TMA or TAC).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from (0xFF04-0xFF07).
+ * @return The value of the register.
+ */
+u8 readTimer(gb_t *gb, u16 address);
+
+/**
+ * Writes a timer register (DIV, TIMA, TMA or TAC).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to (0xFF04-0xFF07).
+ * @param value The value to write.
+ */
+void writeTimer(gb_t *gb, u16 address, u8 value);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <common.h>
+#include <cpu.h>
+#include <stdatomic.h>
+
+// Default file the trace ring is dumped to
+#define TRACE_DEFAULT_PATH "gbemu.trace"
+
+// Identifies a trace dump file
+#define TRACE_MAGIC "GBTRACE"
+#define TRACE_VERSION 1
+
+// A single traced instruction - fixed size, 24 bytes
+typedef struct {
+    u64 ticks;       // Emulator ticks when the instruction was fetched
+    u16 pc;          // Address of the instruction
+    u16 sp;          // Stack pointer
+    u8 opcode;       // Instruction opcode
+    u8 operands[2];  // The two bytes following the opcode
+    u8 a;            // Registers before the instruction executed
+    u8 f;
+    u8 b;
+    u8 c;
+    u8 d;
+    u8 e;
+    u8 h;
+    u8 l;
+    u8 reserved;  // Padding, always 0
+} traceRecord_t;
+
+// Header of a trace dump file, followed by the records (oldest first)
+typedef struct {
+    char magic[8];   // TRACE_MAGIC, null-terminated
+    u32 version;     // TRACE_VERSION
+    u32 recordSize;  // sizeof(traceRecord_t)
+    u64 count;       // Number of records in the file
+} traceFileHeader_t;
+
+// Trace context - Contains the ring and where to dump it
+typedef struct {
+    traceRecord_t *records;  // Ring of records, NULL while tracing is off
+    u32 mask;                // Ring capacity - 1 (capacity is a power of two)
+    _Atomic u64 head;        // Total records written; next slot is head & mask
+    char path[1024];         // File the ring is dumped to
+} traceContext_t;
+
+/**
+ * Starts recording instructions into a ring holding the most recent ones.
+ * The ring is dumped to the given path when the instance is destroyed, or if
+ * the emulator crashes or exits first.
+ *
+ * @param gb The Game Boy instance.
+ * @param records The number of instructions to keep (rounded up to a power
+ * of two).
+ * @param path The file to dump the ring to, or NULL for TRACE_DEFAULT_PATH.
+ * @return Whether tracing was started.
+ */
+bool startTrace(gb_t *gb, u32 records, const char *path);
+
+/**
+ * Stops recording instructions and frees the ring.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stopTrace(gb_t *gb);
+
+// isTraceEnabled() is inlined in gb.h, once the instance is defined
+
+/**
+ * Records the instruction the CPU is about to execute. Its bytes are read
+ * without side effects, so those on I/O pages are recorded as 0.
+ *
+ * @param cpu The CPU context, before the instruction is fetched.
+ */
+void recordTrace(cpuContext_t *cpu);
+
+/**
+ * Writes the contents of the ring to a file, oldest record first.
+ * Only uses async-signal-safe calls, so that it can run from a crash handler.
+ *
+ * @param gb The Game Boy instance.
+ * @param path The file to write, or NULL for the path given to startTrace().
+ * @return Whether the dump was written.
+ */
+bool dumpTrace(gb_t *gb, const char *path);
+
+/**
+ * Renders a trace record in the emulator's text trace format.
+ *
+ * @param record The record to render.
+ * @param str The string to write to.
+ * @param size The size of the string buffer.
+ */
+void traceRecordToString(const traceRecord_t *record, char *str, size_t size);
@@ -6,6 +6,14 @@
 static const int SCREEN_WIDTH = 1024;
 static const int SCREEN_HEIGHT = 768;
 
+// Longest wait for a UI event while paused, which bounds how late the UI
+// notices the CPU thread exiting
+static const int UI_EVENT_TIMEOUT_MS = 100;
+
+// Longest wait for a UI event while running, under a frame, so that new frames
+// are presented promptly
+static const int UI_FRAME_TIMEOUT_MS = 16;
+
 /**
  * Delays the processor for a given number of milliseconds.
  *
@@ -21,6 +29,20 @@ void delay(u32 ms);
 void initializeUI();
 
 /**
- * Handles UI events.
+ * Waits for UI events, for up to UI_FRAME_TIMEOUT_MS (or UI_EVENT_TIMEOUT_MS
+ * while paused), and handles them. Then presents the newest frame and handles
+ * the CPU thread's frame reports.
+ *
+ * @param gb The Game Boy instance shown by the UI.
+ */
+void handleUIEvents(gb_t *gb);
+
+/**
+ * Runs the emulator system with the given arguments, in a window.
+ * Acts as a secondary entry point to the emulator.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The exit code.
  */
-void handleUIEvents();
\ No newline at end of file
+int runEmulator(int argc, char **argv);
@@ -4,7 +4,9 @@
 #include <cart.h>
 #include <cpu.h>
 #include <ram.h>
+#include <ppu.h>
 #include <io.h>
+#include <gb.h>
 
 // * Memory map
 // 0x0000 - 0x3FFF : ROM Bank 0
@@ -21,49 +23,171 @@
 // 0xFF00 - 0xFF7F : I/O Registers
 // 0xFF80 - 0xFFFE : Zero Page (high RAM)
 
+// ===== Page handlers =========================================================
+
+/**
+ * Writes a byte to the working RAM, through its echo at 0xE000 - 0xFDFF too.
+ * Cached CPU blocks covering the byte are invalidated.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to.
+ * @param value The value to write.
+ */
+static void writeWorkingRAMPage(gb_t *gb, u16 address, u8 value) {
+    if (address >= 0xE000) {  // Reserved - Echo RAM
+        address -= 0x2000;
+    }
+
+    invalidateCPUBlocks(gb, address);
+    writeToWorkingRAM(gb, address, value);
+}
+
+/**
+ * Reads a byte from the OAM page.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from.
+ * @return The byte read.
+ */
+static u8 readOAMPage(gb_t *gb, u16 address) {
+    if (address < 0xFEA0) {  // Object Attribute Memory
+        return readOAM(gb, address);
+    }
+
+    return 0;  // Reserved - Unusable
+}
+
+/**
+ * Writes a byte to the OAM page.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to.
+ * @param value The value to write.
+ */
+static void writeOAMPage(gb_t *gb, u16 address, u8 value) {
+    if (address < 0xFEA0) {  // Object Attribute Memory
+        writeToOAM(gb, address, value);
+    }
+}
+
+/**
+ * Reads a byte from the last page, holding the I/O registers, high RAM and
+ * the interrupt enable register.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from.
+ * @return The byte read.
+ */
+static u8 readHighPage(gb_t *gb, u16 address) {
+    if (address < 0xFF80) {  // I/O Registers
+        return readIO(gb, address);
+    } else if (address == 0xFFFF) {  // CPU Interrupt Enable Register
+        return readCPUIERegister(gb);
+    }
+
+    return readHighRAM(gb, address);
+}
+
+/**
+ * Writes a byte to the last page, holding the I/O registers, high RAM and
+ * the interrupt enable register.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to.
+ * @param value The value to write.
+ */
+static void writeHighPage(gb_t *gb, u16 address, u8 value) {
+    if (address < 0xFF80) {  // I/O Registers
+        writeIO(gb, address, value);
+    } else if (address == 0xFFFF) {  // CPU Interrupt Enable Register
+        setCPUIERegister(gb, value);
+    } else {
+        invalidateCPUBlocks(gb, address);
+        writeToHighRAM(gb, address, value);
+    }
+}
+
 // ===== Bus functions =========================================================
 
+/**
+ * Maps a range of pages to host memory or handlers. Mapping new memory over a
+ * range (e.g. when switching banks) replaces the previous mapping.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The first address of the range, aligned to 256 bytes.
+ * @param size The size of the range, a multiple of 256 bytes.
+ * @param read The memory read from, or NULL to use readHandler.
+ * @param write The memory written to, or NULL to use writeHandler.
+ * @param readHandler The handler for reads if read is NULL.
+ * @param writeHandler The handler for writes if write is NULL.
+ */
+void mapBusPages(gb_t *gb, u16 address, u32 size, const u8 *read, u8 *write,
+                 BUS_READ readHandler, BUS_WRITE writeHandler) {
+    for (u32 offset = 0; offset < size; offset += 0x100) {
+        u8 page = (address + offset) >> 8;
+
+        gb->bus.readPages[page] = read ? read + offset : NULL;
+        gb->bus.writePages[page] = write ? write + offset : NULL;
+        gb->bus.readHandlers[page] = readHandler;
+        gb->bus.writeHandlers[page] = writeHandler;
+    }
+}
+
+/**
+ * Builds the memory map. Called after the cartridge is loaded.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeBus(gb_t *gb) {
+    // Cartridge ROM and RAM, replaced with direct pages by the cartridge
+    mapBusPages(gb, 0x0000, 0x8000, NULL, NULL, readCartridge,
+                writeToCartridge);
+    mapBusPages(gb, 0xA000, 0x2000, NULL, NULL, readCartridge,
+                writeToCartridge);
+    mapCartridge(gb);
+
+    // Video RAM
+    mapBusPages(gb, 0x8000, 0x2000, getVideoRAM(gb), getVideoRAM(gb), NULL,
+                NULL);
+
+    // Working RAM and its echo. Writes go through a handler so that cached
+    // CPU blocks are invalidated.
+    mapBusPages(gb, 0xC000, 0x2000, getWorkingRAM(gb), NULL, NULL,
+                writeWorkingRAMPage);
+    mapBusPages(gb, 0xE000, 0x1E00, getWorkingRAM(gb), NULL, NULL,
+                writeWorkingRAMPage);
+
+    // Object attribute memory, I/O registers and high RAM
+    mapBusPages(gb, 0xFE00, 0x100, NULL, NULL, readOAMPage, writeOAMPage);
+    mapBusPages(gb, 0xFF00, 0x100, NULL, NULL, readHighPage, writeHighPage);
+}
+
 /**
  * Reads a byte from the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the bus.
  */
-u8 readBus(u16 address) {
-    if (address < 0x8000) {  // ROM data
-        return readCartridge(address);
-    } else if (address < 0xA000) {  // Character/Map data
-        // TODO - Not terminating to test current CPU
-        // NO_IMPLEMENTATION("readBus() for Character/Map data");
-    } else if (address < 0xC000) {  // Cartridge RAM
-        return readCartridge(address);
-    } else if (address < 0xE000) {  // Working RAM
-        return readWorkingRAM(address);
-    } else if (address < 0xFE00) {  // Reserved - Echo RAM
-        return 0;
-    } else if (address < 0xFEA0) {  // Object Attribute Memory
-        // TODO - Not terminating to test current CPU
-        // NO_IMPLEMENTATION("readBus() for Object Attribute Memory");
-    } else if (address < 0xFF00) {  // Reserved - Unusable
-        return 0;
-    } else if (address < 0xFF80) {  // I/O Registers
-        return readIO(address);
-    } else if (address == 0xFFFF) {  // CPU Interrupt Enable Register
-        return readCPUIERegister();
-    } else {  // High RAM
-        return readHighRAM(address);
+u8 readBus(gb_t *gb, u16 address) {
+    const u8 *page = gb->bus.readPages[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
     }
+
+    return gb->bus.readHandlers[address >> 8](gb, address);
 }
 
 /**
  * Reads 16 bits from the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The 16 bits read from the bus.
  */
-u16 readBus16(u16 address) {
-    u16 lo = readBus(address);
-    u16 hi = readBus(address + 1);
+u16 readBus16(gb_t *gb, u16 address) {
+    u16 lo = readBus(gb, address);
+    u16 hi = readBus(gb, address + 1);
 
     return lo | (hi << 8);
 }
@@ -71,42 +195,28 @@ u16 readBus16(u16 address) {
 /**
  * Writes a byte to the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeBus(u16 address, u8 value) {
-    if (address < 0x8000) {  // ROM data
-        return writeToCartridge(address, value);
-    } else if (address < 0xA000) {  // Character/Map data
-        // TODO - Not terminating to test current CPU
-        // NO_IMPLEMENTATION("writeBus() for Character/Map data");
-    } else if (address < 0xC000) {  // Cartridge RAM
-        return writeToCartridge(address, value);
-    } else if (address < 0xE000) {  // Working RAM
-        return writeToWorkingRAM(address, value);
-    } else if (address < 0xFE00) {  // Reserved - Echo RAM
-        return;
-    } else if (address < 0xFEA0) {  // Object Attribute Memory
-        // TODO - Not terminating to test current CPU
-        // NO_IMPLEMENTATION("writeBus() for Object Attribute Memory");
-    } else if (address < 0xFF00) {  // Reserved - Unusable
+void writeBus(gb_t *gb, u16 address, u8 value) {
+    u8 *page = gb->bus.writePages[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
         return;
-    } else if (address < 0xFF80) {  // I/O Registers
-        return writeIO(address, value);
-    } else if (address == 0xFFFF) {  // CPU Interrupt Enable Register
-        return setCPUIERegister(value);
-    } else {
-        return writeToHighRAM(address, value);
     }
+
+    gb->bus.writeHandlers[address >> 8](gb, address, value);
 }
 
 /**
  * Writes 16 bits to the bus at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The 16 bits to write.
  */
-void writeBus16(u16 address, u16 value) {
-    writeBus(address + 1, (value >> 8) & 0xFF);
-    writeBus(address, value & 0xFF);
-}
\ No newline at end of file
+void writeBus16(gb_t *gb, u16 address, u16 value) {
+    writeBus(gb, address + 1, (value >> 8) & 0xFF);
+    writeBus(gb, address, value & 0xFF);
+}
@@ -1,11 +1,29 @@
 // * Contains cartridge functions for loading and reading from the ROM.
 
-#include <cart.h>
+#include <gb.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// ===== Globals ===============================================================
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Smallest ROM mapped into the bus - Two banks of 16 KiB
+#define MIN_ROM_SIZE 0x8000
 
-// Keeps track of the cartridge state
-static cartContext_t ctx;
+// Size of the MBC2's built-in RAM, of 4-bit values
+#define MBC2_RAM_SIZE 0x200
+
+// Seconds between background flushes of battery-backed RAM
+#define SAVE_FLUSH_SECONDS 1
+
+// ===== Globals ===============================================================
 
 // Map lookup for various cartridge types
 static const char *CARTRIDGE_TYPES[] = {
@@ -50,6 +68,9 @@ static const char *CARTRIDGE_TYPES[] = {
     // Excluding $FF HuC1+RAM+BATTERY
 };
 
+// Cartridge RAM sizes (in bytes), by the header's RAM size code
+static const u32 RAM_SIZES[] = {0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000};
+
 // Licensed manufacturer codes map lookup
 static const char *LIC_CODES[0xA5] = {[0x00] = "None",
                                       [0x01] = "Nintendo R&D1",
@@ -113,76 +134,519 @@ static const char *LIC_CODES[0xA5] = {[0x00] = "None",
                                       [0x99] = "Pack in soft",
                                       [0xA4] = "Konami (Yu-Gi-Oh!)"};
 
-// ===== Helper functions ======================================================
+// ===== Header functions ======================================================
 
 /**
- * Gets the name of the cartridge's licensee code.
+ * Gets the name of a cartridge's licensee code.
  *
+ * @param header The cartridge header.
  * @return The name of the licensee code.
  */
-const char *getLicenseeName() {
-    if (ctx.header->newLICCode <= 0xA4) {
-        return LIC_CODES[ctx.header->oldLICCode];
+const char *getLicenseeName(const ROMHeader_t *header) {
+    if (header->oldLICCode <= 0xA4 && LIC_CODES[header->oldLICCode]) {
+        return LIC_CODES[header->oldLICCode];
     }
 
     return "UNKNOWN";
 }
 
 /**
- * Gets the name of the cartridge's type.
+ * Gets the name of a cartridge type.
  *
+ * @param type The cartridge type, from the header.
  * @return The name of the cartridge type.
  */
-const char *getCartridgeType() {
-    if (ctx.header->type <= 0x22) {
-        return CARTRIDGE_TYPES[ctx.header->type];
+const char *getCartridgeTypeName(u8 type) {
+    if (type <= 0x22) {
+        return CARTRIDGE_TYPES[type];
     }
 
     return "UNKNOWN";
 }
 
+/**
+ * Computes the header checksum over 0x0134 - 0x014C, as the boot ROM does.
+ *
+ * @param rom The ROM, at least 0x150 bytes.
+ * @return The checksum, which should match the header's.
+ */
+u8 computeHeaderChecksum(const u8 *rom) {
+    u8 x = 0;
+    for (u16 i = 0x0134; i <= 0x014C; i++) {
+        x = x - rom[i] - 1;
+    }
+
+    return x;
+}
+
+/**
+ * Computes the global checksum: the sum of every byte of the ROM except the
+ * checksum itself, at 0x014E - 0x014F.
+ *
+ * @param rom The ROM, at least 0x150 bytes.
+ * @param size The size of the ROM.
+ * @return The checksum, which should match the header's (big-endian) one.
+ */
+u16 computeGlobalChecksum(const u8 *rom, u32 size) {
+    u64 sum = 0;
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    // Sums of absolute differences against zero add up 16 bytes at a time
+    __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(rom + i));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+    }
+
+    // Stored rather than moved to a register, which 32-bit x86 can't do
+    u64 lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, sums);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for (; i < size; i++) {
+        sum += rom[i];
+    }
+
+    return sum - rom[0x014E] - rom[0x014F];
+}
+
+// ===== Helper functions ======================================================
+
+/**
+ * Gets the memory bank controller of a cartridge type.
+ *
+ * @param type The cartridge type, from the header.
+ * @return The memory bank controller.
+ */
+static mapperType_t getMapper(u8 type) {
+    switch (type) {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+            return MBC_1;
+        case 0x05:
+        case 0x06:
+            return MBC_2;
+        case 0x0F:
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            return MBC_3;
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            return MBC_5;
+        default:
+            return MBC_NONE;
+    }
+}
+
+/**
+ * Works out the ROM and RAM banks selected by the bank registers, and maps
+ * the windows that changed into the bus.
+ *
+ * @param gb The Game Boy instance.
+ * @param force Whether to map every window, even if it didn't change.
+ */
+static void updateBanks(gb_t *gb, bool force) {
+    cartContext_t *ctx = &gb->cart;
+
+    u16 low = 0;
+    u16 high = ctx->ROMBank;
+    u8 ram = ctx->RAMBank;
+
+    switch (ctx->mapper) {
+        case MBC_NONE:
+            high = 1;
+            break;
+        case MBC_1:
+            // The RAM bank register holds bits 5-6 of the ROM bank, and in
+            // mode 1 also switches 0x0000 - 0x3FFF and the RAM bank
+            high |= ctx->RAMBank << 5;
+            low = ctx->bankingMode ? ctx->RAMBank << 5 : 0;
+            ram = ctx->bankingMode ? ctx->RAMBank : 0;
+            break;
+        default:
+            break;
+    }
+
+    // Bank numbers wrap around the banks the ROM actually has
+    ctx->lowBank = low % ctx->ROMBanks;
+    ctx->highBank = high % ctx->ROMBanks;
+    const u8 *lowROM = ctx->ROMData + ctx->lowBank * 0x4000;
+    const u8 *highROM = ctx->ROMData + ctx->highBank * 0x4000;
+
+    // MBC2 RAM, disabled RAM and MBC3 clock registers go through handlers
+    u8 *mappedRAM = NULL;
+    bool clock = ctx->mapper == MBC_3 && ram >= 0x08;
+    if (ctx->RAM && ctx->RAMEnabled && ctx->mapper != MBC_2 && !clock) {
+        u32 banks = ctx->RAMSize > 0x2000 ? ctx->RAMSize / 0x2000 : 1;
+        mappedRAM = ctx->RAM + (ram % banks) * 0x2000;
+    }
+
+    if (force || lowROM != ctx->lowROM) {
+        ctx->lowROM = lowROM;
+        mapBusPages(gb, 0x0000, 0x4000, lowROM, NULL, NULL, writeToCartridge);
+    }
+    if (force || highROM != ctx->highROM) {
+        ctx->highROM = highROM;
+        mapBusPages(gb, 0x4000, 0x4000, highROM, NULL, NULL, writeToCartridge);
+    }
+    // Writes made while the RAM was writable are flushed after it's disabled
+    bool writable = mappedRAM || (ctx->mapper == MBC_2 && ctx->RAMEnabled);
+    if (writable != atomic_load(&ctx->saveWritable)) {
+        atomic_store(&ctx->saveWritable, writable);
+        atomic_store(&ctx->saveDirty, true);
+    }
+
+    if (force || mappedRAM != ctx->mappedRAM) {
+        ctx->mappedRAM = mappedRAM;
+        if (mappedRAM) {
+            mapBusPages(gb, 0xA000, 0x2000, mappedRAM, mappedRAM, NULL, NULL);
+        } else {
+            mapBusPages(gb, 0xA000, 0x2000, NULL, NULL, readCartridge,
+                        writeToCartridge);
+        }
+    }
+}
+
+/**
+ * Checks whether a cartridge type has battery-backed RAM.
+ *
+ * @param type The cartridge type, from the header.
+ * @return Whether the RAM is battery-backed.
+ */
+static bool hasBattery(u8 type) {
+    switch (type) {
+        case 0x03:
+        case 0x06:
+        case 0x09:
+        case 0x0D:
+        case 0x0F:
+        case 0x10:
+        case 0x13:
+        case 0x1B:
+        case 0x1E:
+        case 0x22:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Checks whether a cartridge type has an MBC3 real-time clock.
+ *
+ * @param type The cartridge type, from the header.
+ * @return Whether there is a real-time clock.
+ */
+static bool hasClock(u8 type) { return type == 0x0F || type == 0x10; }
+
+/**
+ * Maps the save file next to the ROM as the cartridge RAM and clock footer,
+ * creating it if needed. Writes to the RAM go to the page cache, so they
+ * survive a crash of the emulator, and are written to disk in the
+ * background.
+ *
+ * @param ctx The cartridge context.
+ * @param savedSize Set to the size of the save file before it was mapped.
+ * @return The mapped save file, or NULL if it couldn't be mapped.
+ */
+static u8 *mapSaveFile(cartContext_t *ctx, u32 *savedSize) {
+    // The save file replaces the ROM's extension with .sav
+    const char *slash = strrchr(ctx->filename, '/');
+    const char *dot = strrchr(ctx->filename, '.');
+    int length = dot && (!slash || dot > slash) ? dot - ctx->filename
+                                                : (int)strlen(ctx->filename);
+    snprintf(ctx->savePath, sizeof(ctx->savePath), "%.*s.sav", length,
+             ctx->filename);
+
+    int fd = open(ctx->savePath, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // New or short save files are extended with zeroes
+    struct stat st;
+    if (fstat(fd, &st) ||
+        (st.st_size < ctx->saveSize && ftruncate(fd, ctx->saveSize))) {
+        close(fd);
+        return NULL;
+    }
+    *savedSize = st.st_size < ctx->saveSize ? st.st_size : ctx->saveSize;
+
+    // Fault the pages in now, so the emulation thread never waits for them
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+
+    u8 *save = mmap(NULL, ctx->saveSize, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+
+    return save == MAP_FAILED ? NULL : save;
+}
+
+/**
+ * Flushes battery-backed RAM every few seconds, until the cartridge is
+ * unloaded.
+ *
+ * @param arg The Game Boy instance.
+ * @return NULL.
+ */
+static void *runSaver(void *arg) {
+    gb_t *gb = arg;
+    cartContext_t *ctx = &gb->cart;
+
+    pthread_mutex_lock(&ctx->saverLock);
+    while (ctx->saverRunning) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += SAVE_FLUSH_SECONDS;
+
+        pthread_cond_timedwait(&ctx->saverWake, &ctx->saverLock, &until);
+        flushCartridgeRAM(gb);
+    }
+    pthread_mutex_unlock(&ctx->saverLock);
+
+    return NULL;
+}
+
+/**
+ * Resets the bank registers to their power-on values: ROM bank 1, RAM bank 0,
+ * banking mode 0 and RAM disabled, unless it has no enable register.
+ *
+ * @param ctx The cartridge context.
+ */
+static void resetBankRegisters(cartContext_t *ctx) {
+    ctx->RAMEnabled = ctx->mapper == MBC_NONE;  // ROM+RAM has no enable
+    ctx->ROMBank = 1;
+    ctx->RAMBank = 0;
+    ctx->bankingMode = false;
+}
+
+/**
+ * Resets the memory bank controller and allocates the cartridge RAM, once
+ * the ROM is mapped.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the RAM could be allocated.
+ */
+static bool initializeMapper(gb_t *gb) {
+    cartContext_t *ctx = &gb->cart;
+
+    ctx->mapper = getMapper(ctx->header.type);
+    ctx->ROMBanks = ctx->mappedSize / 0x4000;
+    resetBankRegisters(ctx);
+
+    // The MBC2 has its own RAM, whatever the header says
+    if (ctx->mapper == MBC_2) {
+        ctx->RAMSize = MBC2_RAM_SIZE;
+    } else if (ctx->header.RAMSize < sizeof(RAM_SIZES) / sizeof(*RAM_SIZES)) {
+        ctx->RAMSize = RAM_SIZES[ctx->header.RAMSize];
+    } else {
+        ctx->RAMSize = 0;
+    }
+
+    // Smaller RAM is padded to a full bank, so that it can be mapped. MBC2
+    // RAM is never mapped into the bus.
+    ctx->RAMBufferSize = ctx->mapper == MBC_2 || ctx->RAMSize >= 0x2000 ||
+                                 !ctx->RAMSize
+                             ? ctx->RAMSize
+                             : 0x2000;
+    ctx->battery = hasBattery(ctx->header.type);
+    ctx->hasRTC = ctx->mapper == MBC_3 && hasClock(ctx->header.type);
+    ctx->saveData = NULL;
+    atomic_store(&ctx->saveDirty, false);
+    atomic_store(&ctx->saveWritable, false);
+
+    // The clock is saved in a footer after the RAM
+    u32 footerSize = ctx->hasRTC ? RTC_FOOTER_SIZE : 0;
+    ctx->saveSize = ctx->RAMSize + footerSize > ctx->RAMBufferSize
+                        ? ctx->RAMSize + footerSize
+                        : ctx->RAMBufferSize;
+
+    u32 savedSize = 0;
+    if (ctx->battery && ctx->saveSize) {
+        ctx->saveData = mapSaveFile(ctx, &savedSize);
+        if (!ctx->saveData) {
+            printf("%sWARN:%s Could not map save file %s%s%s, the game "
+                   "won't be saved\n",
+                   CYEL, CRST, CCYN, ctx->savePath, CRST);
+        } else {
+            ctx->RAM = ctx->RAMSize ? ctx->saveData : NULL;
+            pthread_mutex_init(&ctx->saverLock, NULL);
+            pthread_cond_init(&ctx->saverWake, NULL);
+
+            // Set before the saver starts, which reads it straight away
+            ctx->saverRunning = true;
+            if (pthread_create(&ctx->saver, NULL, runSaver, gb)) {
+                ctx->saverRunning = false;
+            }
+        }
+    }
+
+    // Save files from before the clock was saved start it from day 0
+    if (ctx->hasRTC) {
+        if (ctx->saveData && savedSize >= ctx->RAMSize + RTC_FOOTER_SIZE) {
+            loadRTC(gb, ctx->saveData + ctx->RAMSize);
+        } else {
+            resetRTC(gb);
+        }
+    }
+
+    if (ctx->RAMSize && !ctx->RAM) {
+        ctx->RAM = calloc(1, ctx->RAMBufferSize);
+        if (!ctx->RAM) {
+            return false;
+        }
+    }
+
+    ctx->lowROM = NULL;
+    ctx->highROM = NULL;
+    ctx->mappedRAM = NULL;
+    updateBanks(gb, true);
+    return true;
+}
+
+/**
+ * Checks whether the MBC3 clock registers are selected in place of the RAM.
+ *
+ * @param ctx The cartridge context.
+ * @return Whether 0xA000 - 0xBFFF accesses a clock register.
+ */
+static bool isClockSelected(cartContext_t *ctx) {
+    return ctx->hasRTC && ctx->RAMEnabled && ctx->RAMBank >= 0x08 &&
+           ctx->RAMBank <= 0x0C;
+}
+
+/**
+ * Saves the clock to the save file footer, after the game changed it.
+ *
+ * @param gb The Game Boy instance.
+ */
+static void saveClock(gb_t *gb) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (ctx->saveData) {
+        saveRTC(gb, ctx->saveData + ctx->RAMSize);
+        atomic_store(&ctx->saveDirty, true);
+    }
+}
+
+/**
+ * Maps a ROM file read-only. Mappings of the same file share the page cache,
+ * so the ROM is neither copied nor duplicated between emulators. ROMs smaller
+ * than two banks are padded with zeroes.
+ *
+ * @param fd The ROM file.
+ * @param size The size of the ROM file.
+ * @param mappedSize Set to the size of the mapping.
+ * @return The mapping, or NULL if the file couldn't be mapped.
+ */
+static const u8 *mapROMFile(int fd, u32 size, u32 *mappedSize) {
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;  // Fault the whole ROM in now, not while running
+#endif
+
+    if (size >= MIN_ROM_SIZE) {
+        u8 *rom = mmap(NULL, size, PROT_READ, flags, fd, 0);
+        if (rom == MAP_FAILED) {
+            return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(rom, size, MADV_HUGEPAGE);  // Only a hint for file mappings
+#endif
+        *mappedSize = size;
+        return rom;
+    }
+
+    // Reserve zeroes for both banks, then map the file over the start
+    u8 *rom = mmap(NULL, MIN_ROM_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+    if (rom == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (mmap(rom, size, PROT_READ, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(rom, MIN_ROM_SIZE);
+        return NULL;
+    }
+
+    *mappedSize = MIN_ROM_SIZE;
+    return rom;
+}
+
 // ===== Cartridge functions ===================================================
 
 /**
  * Loads a cartridge into the emulator based on filename.
- * This function will load the ROM data into memory and verify the checksum.
+ * The ROM file is mapped read-only, so that every emulator loading the same
+ * file shares one copy of it, and the checksum is verified.
  *
+ * @param gb The Game Boy instance.
  * @param filename The filename of the cartridge to load.
  * @return Whether the cartridge was loaded successfully.
  */
-bool loadCartridge(char *filename) {
-    snprintf(ctx.filename, sizeof(ctx.filename), "%s", filename);
+bool loadCartridge(gb_t *gb, char *filename) {
+    cartContext_t *ctx = &gb->cart;
+
+    unloadCartridge(gb);
+    snprintf(ctx->filename, sizeof(ctx->filename), "%s", filename);
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         return false;
     }
 
-    // Determine maximal cartridge size
-    fseek(fp, 0, SEEK_END);
-    ctx.ROMSize = ftell(fp);
+    // The ROM has to hold at least the header
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < 0x150 || st.st_size > UINT32_MAX) {
+        close(fd);
+        return false;
+    }
 
-    // Now reset back to the beginning
-    rewind(fp);
+    // The mapping holds its own reference to the file
+    ctx->ROMSize = st.st_size;
+    ctx->ROMData = mapROMFile(fd, ctx->ROMSize, &ctx->mappedSize);
+    close(fd);
+    if (!ctx->ROMData) {
+        return false;
+    }
 
-    // Read in all ROM data
-    ctx.ROMData = malloc(ctx.ROMSize);
-    fread(ctx.ROMData, ctx.ROMSize, 1, fp);
-    fclose(fp);
+    // Parse a copy of the header, so the ROM itself is never written
+    memcpy(&ctx->header, ctx->ROMData + 0x100, sizeof(ctx->header));
+    ctx->header.title[15] = 0;  // Ensure title names are null-terminated
 
-    ctx.header = (ROMHeader_t *)(ctx.ROMData + 0x100);
-    ctx.header->title[15] = 0;  // Ensure title names are null-terminated
+    if (!initializeMapper(gb)) {
+        unloadCartridge(gb);
+        return false;
+    }
 
-    printf("Cartridge Loaded from file %s%s%s:\n", CCYN, ctx.filename, CRST);
-    printf("\tTitle    : %s%s%s\n", CBLU, ctx.header->title, CRST);
-    printf("\tType     : %s0x%2.2X%s (%s)\n", CMAG, ctx.header->type, CRST,
-           getCartridgeType());
-    printf("\tROM Size : %s0x%2.2X%s (%s%d%s KiB)\n", CMAG, ctx.header->ROMSize,
-           CRST, CYEL, 32 << ctx.header->ROMSize, CRST);
+    printf("Cartridge Loaded from file %s%s%s:\n", CCYN, ctx->filename, CRST);
+    printf("\tTitle    : %s%s%s\n", CBLU, ctx->header.title, CRST);
+    printf("\tType     : %s0x%2.2X%s (%s)\n", CMAG, ctx->header.type, CRST,
+           getCartridgeTypeName(ctx->header.type));
+    if (ctx->mapper == MBC_NONE && ctx->header.type != 0x00 &&
+        ctx->header.type != 0x08 && ctx->header.type != 0x09) {
+        printf("%sWARN:%s Unsupported cartridge type, running as ROM ONLY\n",
+               CYEL, CRST);
+    }
+    printf("\tROM Size : %s0x%2.2X%s (%s%d%s KiB)\n", CMAG, ctx->header.ROMSize,
+           CRST, CYEL, 32 << ctx->header.ROMSize, CRST);
 
     // Calculate and return RAM sizing
-    printf("\tRAM Size : %s0x%2.2X%s ", CMAG, ctx.header->RAMSize, CRST);
-    switch (ctx.header->RAMSize) {
+    printf("\tRAM Size : %s0x%2.2X%s ", CMAG, ctx->header.RAMSize, CRST);
+    switch (ctx->header.RAMSize) {
         case 0x00:
             printf("(No RAM)\n");
             break;
@@ -208,18 +672,13 @@ bool loadCartridge(char *filename) {
             printf("(%sUnknown RAM flag%s)\n", CRED, CRST);
     }
 
-    printf("\tLIC Code : %s0x%2.2X%s (%s)\n", CMAG, ctx.header->oldLICCode,
-           CRST, getLicenseeName());
-    printf("\tROM Vers : %s0x%2.2X%s\n", CMAG, ctx.header->version, CRST);
+    printf("\tLIC Code : %s0x%2.2X%s (%s)\n", CMAG, ctx->header.oldLICCode,
+           CRST, getLicenseeName(&ctx->header));
+    printf("\tROM Vers : %s0x%2.2X%s\n", CMAG, ctx->header.version, CRST);
 
-    // Perform checksum algorithm
-    u16 x = 0;
-    for (u16 i = 0x0134; i <= 0x014C; i++) {
-        x = x - ctx.ROMData[i] - 1;
-    }
     // Verify checksum of ROM
-    printf("\tChecksum : %s0x%2.2X%s (", CMAG, ctx.header->checksum, CRST);
-    if (x & 0xFF)
+    printf("\tChecksum : %s0x%2.2X%s (", CMAG, ctx->header.checksum, CRST);
+    if (computeHeaderChecksum(ctx->ROMData) == ctx->header.checksum)
         printf("%sPASSED%s)\n", CGRN, CRST);
     else
         printf("%sFAILED%s)\n", CRED, CRST);
@@ -228,23 +687,231 @@ bool loadCartridge(char *filename) {
 }
 
 /**
- * Reads a byte from the cartridge at the given address.
+ * Unmaps the loaded cartridge and frees its RAM, if there is one.
  *
+ * @param gb The Game Boy instance.
+ */
+void unloadCartridge(gb_t *gb) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (!ctx->ROMData) {
+        return;
+    }
+
+    // Nothing may read the ROM or RAM through the bus any more
+    mapBusPages(gb, 0x0000, 0x8000, NULL, NULL, readCartridge,
+                writeToCartridge);
+    mapBusPages(gb, 0xA000, 0x2000, NULL, NULL, readCartridge,
+                writeToCartridge);
+
+    // Stop the saver, then flush whatever it didn't
+    if (ctx->saverRunning) {
+        pthread_mutex_lock(&ctx->saverLock);
+        ctx->saverRunning = false;
+        pthread_cond_signal(&ctx->saverWake);
+        pthread_mutex_unlock(&ctx->saverLock);
+        pthread_join(ctx->saver, NULL);
+    }
+
+    if (ctx->saveData) {
+        if (ctx->hasRTC) {
+            saveRTC(gb, ctx->saveData + ctx->RAMSize);
+        }
+
+        atomic_store(&ctx->saveDirty, true);
+        flushCartridgeRAM(gb);
+        munmap(ctx->saveData, ctx->saveSize);
+        ctx->saveData = NULL;
+
+        pthread_cond_destroy(&ctx->saverWake);
+        pthread_mutex_destroy(&ctx->saverLock);
+    } else {
+        free(ctx->RAM);
+    }
+    ctx->RAM = NULL;
+    ctx->RAMSize = 0;
+    ctx->RAMBufferSize = 0;
+
+    munmap((void *)ctx->ROMData, ctx->mappedSize);
+    ctx->ROMData = NULL;
+    ctx->lowROM = NULL;
+    ctx->highROM = NULL;
+    ctx->mappedRAM = NULL;
+    ctx->ROMSize = 0;
+    ctx->mappedSize = 0;
+}
+
+/**
+ * Writes battery-backed RAM to the save file, if it may have changed since
+ * the last flush. Waits for the disk, so the emulation thread only calls
+ * this on exit - A background thread flushes periodically.
+ *
+ * @param gb The Game Boy instance.
+ */
+void flushCartridgeRAM(gb_t *gb) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (!ctx->saveData) {
+        return;
+    }
+
+    // Only pages the kernel saw written are written back
+    bool dirty = atomic_exchange(&ctx->saveDirty, false);
+    if (dirty || atomic_load(&ctx->saveWritable)) {
+        msync(ctx->saveData, ctx->saveSize, MS_SYNC);
+    }
+}
+
+/**
+ * Reads a byte from the cartridge at the given address. Only used for what
+ * isn't mapped into the bus: MBC2 RAM, and RAM that is disabled or missing.
+ *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the cartridge.
  */
-u8 readCartridge(u16 address) {
-    // For now, ROM ONLY supported
-    return ctx.ROMData[address];
+u8 readCartridge(gb_t *gb, u16 address) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (address < 0x8000) {
+        if (!ctx->ROMData) {
+            return 0xFF;
+        }
+
+        const u8 *rom = address < 0x4000 ? ctx->lowROM : ctx->highROM;
+        return rom[address & 0x3FFF];
+    }
+
+    // MBC2 RAM holds 4-bit values, repeated over the window
+    if (ctx->mapper == MBC_2 && ctx->RAMEnabled) {
+        return ctx->RAM[address & (MBC2_RAM_SIZE - 1)] | 0xF0;
+    }
+
+    if (isClockSelected(ctx)) {
+        return readRTC(gb, ctx->RAMBank);
+    }
+
+    return 0xFF;
 }
 
 /**
- * Writes a byte to the cartridge at the given address.
+ * Writes a byte to the cartridge at the given address. Writes to the ROM set
+ * the bank registers, and remap the banks into the bus.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToCartridge(u16 address, u8 value) {
-    // For now, ROM ONLY supported
-    NO_IMPLEMENTATION("writeToCartridge()");
-}
\ No newline at end of file
+void writeToCartridge(gb_t *gb, u16 address, u8 value) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (address >= 0x8000) {
+        if (ctx->mapper == MBC_2 && ctx->RAMEnabled) {
+            ctx->RAM[address & (MBC2_RAM_SIZE - 1)] = value & 0x0F;
+        } else if (isClockSelected(ctx)) {
+            writeRTC(gb, ctx->RAMBank, value);
+            saveClock(gb);
+        }
+        return;
+    }
+
+    switch (ctx->mapper) {
+        case MBC_NONE:
+            return;
+        case MBC_1:
+            switch (address >> 13) {
+                case 0:  // 0x0000 - 0x1FFF : RAM enable
+                    ctx->RAMEnabled = (value & 0x0F) == 0x0A;
+                    break;
+                case 1:  // 0x2000 - 0x3FFF : ROM bank, where 0 selects 1
+                    ctx->ROMBank = (value & 0x1F) ? value & 0x1F : 1;
+                    break;
+                case 2:  // 0x4000 - 0x5FFF : RAM bank or upper ROM bank
+                    ctx->RAMBank = value & 0x03;
+                    break;
+                default:  // 0x6000 - 0x7FFF : Banking mode select
+                    ctx->bankingMode = value & 0x01;
+                    break;
+            }
+            break;
+        case MBC_2:
+            // Bit 8 of the address selects the register
+            if (address >= 0x4000) {
+                return;
+            } else if (address & 0x100) {
+                ctx->ROMBank = (value & 0x0F) ? value & 0x0F : 1;
+            } else {
+                ctx->RAMEnabled = (value & 0x0F) == 0x0A;
+            }
+            break;
+        case MBC_3:
+            switch (address >> 13) {
+                case 0:  // 0x0000 - 0x1FFF : RAM and clock enable
+                    ctx->RAMEnabled = (value & 0x0F) == 0x0A;
+                    break;
+                case 1:  // 0x2000 - 0x3FFF : ROM bank, where 0 selects 1
+                    ctx->ROMBank = (value & 0x7F) ? value & 0x7F : 1;
+                    break;
+                case 2:  // 0x4000 - 0x5FFF : RAM bank or clock register
+                    ctx->RAMBank = value & 0x0F;
+                    break;
+                default:  // 0x6000 - 0x7FFF : Clock latch
+                    if (ctx->hasRTC) {
+                        latchRTC(gb, value);
+                        saveClock(gb);
+                    }
+                    return;
+            }
+            break;
+        case MBC_5:
+            if (address < 0x2000) {  // RAM enable
+                ctx->RAMEnabled = (value & 0x0F) == 0x0A;
+            } else if (address < 0x3000) {  // Lower 8 bits of the ROM bank
+                ctx->ROMBank = (ctx->ROMBank & 0x100) | value;
+            } else if (address < 0x4000) {  // Bit 8 of the ROM bank
+                ctx->ROMBank = (ctx->ROMBank & 0xFF) | (value & 0x01) << 8;
+            } else if (address < 0x6000) {  // RAM bank
+                ctx->RAMBank = value & 0x0F;
+            } else {
+                return;
+            }
+            break;
+    }
+
+    updateBanks(gb, false);
+}
+
+/**
+ * Gets the ROM bank mapped at an address.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address (0x0000 - 0x7FFF).
+ * @return The ROM bank number.
+ */
+u16 getCartridgeROMBank(gb_t *gb, u16 address) {
+    return address < 0x4000 ? gb->cart.lowBank : gb->cart.highBank;
+}
+
+/**
+ * Resets the bank registers, as when the Game Boy is turned on. The banks are
+ * mapped again by the next mapCartridge().
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetCartridge(gb_t *gb) { resetBankRegisters(&gb->cart); }
+
+/**
+ * Maps the selected ROM and RAM banks into the bus, so that they are read
+ * directly. Called again whenever a bank register is written.
+ *
+ * @param gb The Game Boy instance.
+ */
+void mapCartridge(gb_t *gb) {
+    cartContext_t *ctx = &gb->cart;
+
+    if (!ctx->ROMData) {
+        return;
+    }
+
+    updateBanks(gb, true);
+}
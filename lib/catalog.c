@@ -0,0 +1,423 @@
+// * Indexes ROM libraries into a catalog of their headers.
+
+#include <catalog.h>
+#include <cart.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A ROM file found while scanning
+typedef struct {
+    char *path;             // Path of the file
+    u64 size;               // Size of the file
+    u64 mtime;              // Modification time of the file, in nanoseconds
+    catalogEntry_t *entry;  // Catalogued header, or NULL if it's out of date
+    catalogEntry_t parsed;  // Header read from the file by the workers
+    bool valid;             // Whether the file is a ROM with a header
+} romFile_t;
+
+// A list of ROM files found while scanning
+typedef struct {
+    romFile_t *files;  // Files found
+    u32 count;         // Number of files found
+    u32 capacity;      // Number of files there's room for
+} romFileList_t;
+
+// Work shared by the scanning threads
+typedef struct {
+    romFile_t **queue;  // Files to read
+    u32 count;          // Number of files to read
+    _Atomic u32 next;   // Index of the next file to read
+} scanContext_t;
+
+// ===== Helper functions ======================================================
+
+/**
+ * Compares entries by path, for sorting and searching.
+ *
+ * @param a The first ROM file.
+ * @param b The second ROM file.
+ * @return The order of the files.
+ */
+static int compareFiles(const void *a, const void *b) {
+    return strcmp(((const romFile_t *)a)->path, ((const romFile_t *)b)->path);
+}
+
+/**
+ * Checks whether a file name has a ROM extension.
+ *
+ * @param name The file name.
+ * @return Whether the file is a ROM.
+ */
+static bool isROMName(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (!strcasecmp(dot, ".gb") || !strcasecmp(dot, ".gbc"));
+}
+
+/**
+ * Adds the ROM files in a directory and its subdirectories to a list.
+ *
+ * @param list The list.
+ * @param directory The directory.
+ * @return Whether the directory could be read.
+ */
+static bool findROMs(romFileList_t *list, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        return false;
+    }
+
+    struct dirent *dirent;
+    while ((dirent = readdir(dir))) {
+        if (dirent->d_name[0] == '.') {  // Hidden files, . and ..
+            continue;
+        }
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", directory, dirent->d_name);
+
+        // Symbolic links are skipped, so that loops can't be followed
+        struct stat st;
+        if (lstat(path, &st)) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            findROMs(list, path);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || !isROMName(dirent->d_name)) {
+            continue;
+        }
+
+        if (list->count == list->capacity) {
+            list->capacity = list->capacity ? list->capacity * 2 : 256;
+            list->files =
+                realloc(list->files, list->capacity * sizeof(romFile_t));
+        }
+
+        romFile_t *file = &list->files[list->count++];
+        memset(file, 0, sizeof(*file));
+        file->path = strdup(path);
+        file->size = st.st_size;
+        file->mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+    }
+
+    closedir(dir);
+    return true;
+}
+
+/**
+ * Reads the header of a ROM file and checks its checksums.
+ *
+ * @param file The ROM file - Sets its parsed entry and whether it's valid.
+ */
+static void parseROM(romFile_t *file) {
+    int fd = open(file->path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    // Files too small to hold a header aren't ROMs
+    const u8 *rom = NULL;
+    if (file->size >= 0x150 && file->size <= UINT32_MAX) {
+        rom = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (!rom || rom == MAP_FAILED) {
+        return;
+    }
+
+    ROMHeader_t header;
+    memcpy(&header, rom + 0x100, sizeof(header));
+
+    catalogEntry_t *entry = &file->parsed;
+    memcpy(entry->title, header.title, sizeof(entry->title));
+    entry->newLICCode = header.newLICCode;
+    entry->type = header.type;
+    entry->ROMSize = header.ROMSize;
+    entry->RAMSize = header.RAMSize;
+    entry->oldLICCode = header.oldLICCode;
+    entry->version = header.version;
+
+    // The global checksum is stored big-endian
+    entry->globalChecksum = computeGlobalChecksum(rom, file->size);
+    if (computeHeaderChecksum(rom) == header.checksum) {
+        entry->flags |= CATALOG_HEADER_OK;
+    }
+    if (entry->globalChecksum == (rom[0x014E] << 8 | rom[0x014F])) {
+        entry->flags |= CATALOG_GLOBAL_OK;
+    }
+
+    munmap((void *)rom, file->size);
+    file->valid = true;
+}
+
+/**
+ * Reads ROM files from the shared queue until it's empty.
+ *
+ * @param arg The scan context.
+ * @return NULL.
+ */
+static void *runScanWorker(void *arg) {
+    scanContext_t *scan = arg;
+
+    u32 index;
+    while ((index = atomic_fetch_add(&scan->next, 1)) < scan->count) {
+        parseROM(scan->queue[index]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads ROM files on a pool of threads.
+ *
+ * @param queue The files to read.
+ * @param count The number of files.
+ * @param threads The number of threads.
+ */
+static void parseROMs(romFile_t **queue, u32 count, int threads) {
+    scanContext_t scan = {queue, count, 0};
+    if (threads > (int)count) {
+        threads = count;
+    }
+
+    // The calling thread is one of the workers
+    pthread_t workers[threads > 1 ? threads - 1 : 1];
+    int started = 0;
+    for (int i = 0; i < threads - 1; i++) {
+        if (!pthread_create(&workers[started], NULL, runScanWorker, &scan)) {
+            started++;
+        }
+    }
+
+    runScanWorker(&scan);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+// ===== Catalog functions =====================================================
+
+/**
+ * Loads a catalog file.
+ *
+ * @param catalog The catalog to load into - Empty if loading fails.
+ * @param path The catalog file.
+ * @return Whether the catalog was loaded.
+ */
+bool loadCatalog(catalog_t *catalog, const char *path) {
+    memset(catalog, 0, sizeof(*catalog));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    // Check that the catalog is one this build understands
+    catalogFileHeader_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CATALOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CATALOG_VERSION ||
+        header.entrySize != sizeof(catalogEntry_t)) {
+        fclose(file);
+        return false;
+    }
+
+    catalog->entries = malloc((size_t)header.count * sizeof(catalogEntry_t));
+    catalog->strings = malloc(header.stringsSize);
+    catalog->count = header.count;
+    catalog->stringsSize = header.stringsSize;
+
+    bool ok = catalog->entries && catalog->strings &&
+              fread(catalog->entries, sizeof(catalogEntry_t), header.count,
+                    file) == header.count &&
+              fread(catalog->strings, 1, header.stringsSize, file) ==
+                  header.stringsSize;
+    fclose(file);
+
+    // Every path has to be within the strings, and terminated
+    for (u32 i = 0; ok && i < catalog->count; i++) {
+        u32 offset = catalog->entries[i].pathOffset;
+        ok = offset < catalog->stringsSize &&
+             memchr(catalog->strings + offset, 0,
+                    catalog->stringsSize - offset);
+    }
+
+    if (!ok) {
+        freeCatalog(catalog);
+    }
+    return ok;
+}
+
+/**
+ * Writes a catalog to a file, replacing it atomically.
+ *
+ * @param catalog The catalog.
+ * @param path The catalog file.
+ * @return Whether the catalog was written.
+ */
+bool saveCatalog(const catalog_t *catalog, const char *path) {
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) {
+        return false;
+    }
+
+    catalogFileHeader_t header = {CATALOG_MAGIC, CATALOG_VERSION,
+                                  sizeof(catalogEntry_t), catalog->count,
+                                  catalog->stringsSize};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(catalog->entries, sizeof(catalogEntry_t), catalog->count,
+                     file) == catalog->count &&
+              fwrite(catalog->strings, 1, catalog->stringsSize, file) ==
+                  catalog->stringsSize;
+    ok = !fclose(file) && ok;
+
+    // Readers see either the old catalog or the new one
+    if (!ok || rename(temporary, path)) {
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Scans directories for ROMs (.gb and .gbc files) and updates a catalog with
+ * them. Only files whose size or modification time changed are read again,
+ * on a pool of threads.
+ *
+ * @param catalog The catalog to update - Files that are gone are removed.
+ * @param directories The directories to scan, recursively.
+ * @param count The number of directories.
+ * @param threads The number of threads, or 0 for one per CPU.
+ * @return The number of ROMs that were read, or -1 if scanning failed.
+ */
+int scanCatalog(catalog_t *catalog, const char **directories, int count,
+                int threads) {
+    romFileList_t list = {0};
+    for (int i = 0; i < count; i++) {
+        if (!findROMs(&list, directories[i])) {
+            for (u32 j = 0; j < list.count; j++) {
+                free(list.files[j].path);
+            }
+            free(list.files);
+            return -1;
+        }
+    }
+
+    // Files that are unchanged keep their catalogued header
+    qsort(list.files, list.count, sizeof(romFile_t), compareFiles);
+    romFile_t **queue = malloc((list.count ? list.count : 1) *
+                               sizeof(romFile_t *));
+    u32 queued = 0;
+    for (u32 i = 0; i < list.count; i++) {
+        romFile_t *file = &list.files[i];
+        catalogEntry_t *entry =
+            (catalogEntry_t *)findCatalogEntry(catalog, file->path);
+        if (entry && entry->size == file->size &&
+            entry->mtime == file->mtime) {
+            file->entry = entry;
+            file->valid = true;
+        } else {
+            queue[queued++] = file;
+        }
+    }
+
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    parseROMs(queue, queued, threads > 0 ? threads : 1);
+    free(queue);
+
+    // Build the new catalog in path order
+    catalog_t updated = {0};
+    updated.entries = malloc((list.count ? list.count : 1) *
+                             sizeof(catalogEntry_t));
+    for (u32 i = 0; i < list.count; i++) {
+        updated.stringsSize += strlen(list.files[i].path) + 1;
+    }
+    updated.strings = malloc(updated.stringsSize ? updated.stringsSize : 1);
+
+    u32 offset = 0;
+    for (u32 i = 0; i < list.count; i++) {
+        romFile_t *file = &list.files[i];
+        if (file->valid) {
+            catalogEntry_t *entry = &updated.entries[updated.count++];
+            *entry = file->entry ? *file->entry : file->parsed;
+            entry->size = file->size;
+            entry->mtime = file->mtime;
+            entry->pathOffset = offset;
+
+            u32 length = strlen(file->path) + 1;
+            memcpy(updated.strings + offset, file->path, length);
+            offset += length;
+        }
+        free(file->path);
+    }
+    updated.stringsSize = offset;
+    free(list.files);
+
+    freeCatalog(catalog);
+    *catalog = updated;
+    return queued;
+}
+
+/**
+ * Finds the entry of a ROM in a catalog.
+ *
+ * @param catalog The catalog.
+ * @param path The path of the ROM, as scanned.
+ * @return The entry, or NULL if the ROM isn't catalogued.
+ */
+const catalogEntry_t *findCatalogEntry(const catalog_t *catalog,
+                                       const char *path) {
+    // Entries are sorted by path
+    u32 low = 0;
+    u32 high = catalog->count;
+    while (low < high) {
+        u32 middle = low + (high - low) / 2;
+        const catalogEntry_t *entry = &catalog->entries[middle];
+        int order = strcmp(getCatalogPath(catalog, entry), path);
+        if (!order) {
+            return entry;
+        } else if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Gets the path of a catalogued ROM.
+ *
+ * @param catalog The catalog.
+ * @param entry The entry.
+ * @return The path of the ROM.
+ */
+const char *getCatalogPath(const catalog_t *catalog,
+                           const catalogEntry_t *entry) {
+    return catalog->strings + entry->pathOffset;
+}
+
+/**
+ * Frees a catalog's entries and paths, leaving it empty.
+ *
+ * @param catalog The catalog.
+ */
+void freeCatalog(catalog_t *catalog) {
+    free(catalog->entries);
+    free(catalog->strings);
+    memset(catalog, 0, sizeof(*catalog));
+}
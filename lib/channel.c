@@ -0,0 +1,115 @@
+// * Passes messages between two threads through lock-free rings.
+
+#include <channel.h>
+#include <string.h>
+
+/**
+ * Channels are single-producer, single-consumer rings. The producer writes a
+ * message, then publishes it by storing head with release ordering; the
+ * consumer loads head with acquire ordering before reading the message, and
+ * frees its slot by storing tail the same way. Indices count messages and
+ * wrap around, so head - tail is the number of messages in the ring.
+ */
+
+// ===== Channel functions =====================================================
+
+/**
+ * Creates a channel.
+ *
+ * @param ch The channel.
+ * @param capacity The number of messages it holds, a power of two.
+ * @param size The size of a message, in bytes.
+ * @return Whether the ring could be allocated.
+ */
+bool createChannel(channel_t *ch, u32 capacity, u32 size) {
+    memset(ch, 0, sizeof(channel_t));
+
+    ch->messages = calloc(capacity, size);
+    if (!ch->messages) {
+        return false;
+    }
+
+    ch->capacity = capacity;
+    ch->size = size;
+    atomic_init(&ch->head, 0);
+    atomic_init(&ch->tail, 0);
+
+    return true;
+}
+
+/**
+ * Destroys a channel, once neither thread uses it. Channels that were never
+ * created (zeroed) may be destroyed too.
+ *
+ * @param ch The channel.
+ */
+void destroyChannel(channel_t *ch) {
+    free(ch->messages);
+    ch->messages = NULL;
+}
+
+/**
+ * Sends a message. Only called by the producer thread; never blocks.
+ *
+ * @param ch The channel.
+ * @param message The message, of the channel's message size.
+ * @return Whether the message was sent, or false (and counted as dropped)
+ * if the ring is full.
+ */
+bool sendMessage(channel_t *ch, const void *message) {
+    u32 head = atomic_load_explicit(&ch->head, memory_order_relaxed);
+
+    // Only look at the consumer's index when the ring seems full
+    if (head - ch->cachedTail == ch->capacity) {
+        ch->cachedTail = atomic_load_explicit(&ch->tail, memory_order_acquire);
+        if (head - ch->cachedTail == ch->capacity) {
+            ch->dropped++;
+            return false;
+        }
+    }
+
+    memcpy(ch->messages + (head & (ch->capacity - 1)) * ch->size, message,
+           ch->size);
+    atomic_store_explicit(&ch->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ * Receives the oldest message. Only called by the consumer thread; never
+ * blocks.
+ *
+ * @param ch The channel.
+ * @param message The message to fill in, of the channel's message size.
+ * @return Whether a message was received, or false if the ring is empty.
+ */
+bool receiveMessage(channel_t *ch, void *message) {
+    if (isChannelEmpty(ch)) {
+        return false;
+    }
+
+    u32 tail = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    memcpy(message, ch->messages + (tail & (ch->capacity - 1)) * ch->size,
+           ch->size);
+    atomic_store_explicit(&ch->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ * Checks whether there is nothing to receive. Only called by the consumer
+ * thread.
+ *
+ * @param ch The channel.
+ * @return Whether the ring is empty.
+ */
+bool isChannelEmpty(channel_t *ch) {
+    u32 tail = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+
+    // Only look at the producer's index when the ring seems empty
+    if (tail == ch->cachedHead) {
+        ch->cachedHead = atomic_load_explicit(&ch->head, memory_order_acquire);
+    }
+
+    return tail == ch->cachedHead;
+}
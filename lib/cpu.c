@@ -1,121 +1,240 @@
 // * Emulates the Game Boy CPU (LR35902).
 
-#include <cpu.h>
-#include <bus.h>
-#include <emu.h>
+#include <gb.h>
 #include <interrupts.h>
-#include <dbg.h>
 
 // ===== Globals ===============================================================
 
-// The CPU context object - contains all CPU state
-cpuContext_t ctx = {0};
+// CPU cycles of each instruction, with conditional branches not taken
+static const u8 INSTRUCTION_CYCLES[0x100] = {
+#define INSTRUCTION(opcode, type, mode, register1, register2, cond, param, \
+                    cycles)                                                \
+    [opcode] = cycles,
+#include <instructions.def>
+#undef INSTRUCTION
+};
+
+// CPU cycles of fetching an opcode, with the rest emulated at each access
+static const u8 FETCH_CYCLES[0x100] = {
+#define INSTRUCTION(opcode, ...) [opcode] = 1,
+#include <instructions.def>
+#undef INSTRUCTION
+};
 
 // ===== Helper functions ======================================================
 
 /**
  * Fetches the next instruction from memory.
+ *
+ * @param ctx The CPU context.
  */
-static void fetchInstruction() {
-    ctx.currentOpcode = readBus(ctx.registers.pc++);
-    ctx.currentInstruction = getInstructionFromOpcode(ctx.currentOpcode);
+static void fetchInstruction(cpuContext_t *ctx) {
+    ctx->currentOpcode = readBus(ctx->gb, ctx->registers.pc++);
+    ctx->currentInstruction = getInstructionFromOpcode(ctx->currentOpcode);
 }
 
 /**
  * Executes the current instruction.
+ *
+ * @param ctx The CPU context.
  */
-static void execute() {
-    IN_PROC proc = getProcessorForInstructionType(ctx.currentInstruction->type);
+static void execute(cpuContext_t *ctx) {
+    IN_PROC proc =
+        getProcessorForInstructionType(ctx->currentInstruction->type);
 
     if (!proc) {
         NO_IMPLEMENTATION("execute() without processor");
     }
 
-    proc(&ctx);
+    proc(ctx);
+}
+
+/**
+ * Gets the number of CPU cycles a halted CPU can skip. Only scheduled events
+ * raise interrupts while halted, so the CPU skips straight to the next event
+ * (or the end of the runCPUFor() budget) instead of spinning cycle by cycle.
+ *
+ * @param gb The Game Boy instance.
+ * @return The number of CPU cycles to skip, at least 1.
+ */
+static u64 getHaltedCycles(gb_t *gb) {
+    cpuContext_t *ctx = &gb->cpu;
+
+    u64 ticks = gb->emu.ticks;
+    u64 until = getNextEventTicks(gb);
+    if (ctx->runUntil < until) {
+        until = ctx->runUntil;
+    }
+
+    if (ctx->interruptEnableRegister & ctx->interruptFlags & 0x1F ||
+        until <= ticks) {
+        return 1;
+    }
+
+    // Wake on the first CPU cycle at or after the deadline
+    return (until - ticks + 3) / 4;
+}
+
+/**
+ * Fetches and executes the instruction at the program counter.
+ *
+ * @param gb The Game Boy instance.
+ */
+static void runInstruction(gb_t *gb) {
+    cpuContext_t *ctx = &gb->cpu;
+
+    if (isTraceEnabled(gb)) {
+        recordTrace(ctx);
+    }
+
+    // The handler table fetches operands and executes in a single call
+    if (ctx->core != CORE_GENERIC) {
+        ctx->currentOpcode = readBus(gb, ctx->registers.pc++);
+        emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));
+
+        getHandlerForOpcode(ctx->currentOpcode)(ctx);
+        debugPrint(gb);
+        return;
+    }
+
+    fetchInstruction(ctx);
+    emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));
+    fetchData(gb);
+
+    if (ctx->currentInstruction == NULL) {
+        printf("%sERR:%s Unknown instruction encountered! %s0x%02X%s\n", CRED,
+               CRST, CMAG, ctx->currentOpcode, CRST);
+        exit(EXIT_FAILURE);
+    }
+
+    execute(ctx);
+    debugPrint(gb);
 }
 
 // ===== CPU functions =========================================================
 
 /**
  * Initializes the CPU.
+ *
+ * @param gb The Game Boy instance.
  */
-void initializeCPU() {
+void initializeCPU(gb_t *gb) {
+    cpuContext_t *ctx = &gb->cpu;
+
     // Set the program counter to the entrypoint
-    ctx.registers.pc = 0x100;
+    ctx->registers.pc = 0x100;
     // Default value for registers
-    *((short *)&ctx.registers.a) = 0xB001;
-    *((short *)&ctx.registers.b) = 0x1300;
-    *((short *)&ctx.registers.d) = 0xD800;
-    *((short *)&ctx.registers.h) = 0x4D01;
+    ctx->registers.af = 0x01B0;
+    ctx->lazyFlags.op = FLAGS_NONE;
+    ctx->registers.bc = 0x0013;
+    ctx->registers.de = 0x00D8;
+    ctx->registers.hl = 0x014D;
     // Default value for stack pointer
-    ctx.registers.sp = 0xFFFE;
+    ctx->registers.sp = 0xFFFE;
 
     // Default values for interrupts
-    ctx.masterInterruptEnabled = false;
-    ctx.enablingIME = false;
-    ctx.interruptEnableRegister = 0;
-    ctx.interruptFlags = 0;
+    ctx->masterInterruptEnabled = false;
+    ctx->enablingIME = false;
+    ctx->interruptEnableRegister = 0;
+    ctx->interruptFlags = 0;
+    ctx->pendingInterrupts = 0;
+
+    // Leave HALT and any run in progress behind
+    ctx->halted = false;
+    ctx->stepping = false;
+    ctx->runUntil = 0;
+    atomic_store_explicit(&ctx->stopping, false, memory_order_relaxed);
+
+    clearCPUBlocks(gb);
+    clearIdleLoops(gb);
 }
 
 /**
- * Steps the CPU by one instruction.
+ * Selects the core used to dispatch instructions.
+ *
+ * @param gb The Game Boy instance.
+ * @param core The dispatch core.
  */
-void stepCPU() {
-    // If the CPU is running, fetch an instruction
-    if (!ctx.halted) {
-        u16 pc = ctx.registers.pc;
-
-        fetchInstruction();
-        emulateCPUCycles(1);  // 1 CPU cycle to fetch
-        fetchData();
-
-        char instruction[16];
-        instructionToString(&ctx, instruction);
-        printf("PC %s%08X%s: %s%-16s%s (%s%02X%s %s%02X %02X%s) | ", CMAG, pc,
-               CRST, CBLU, instruction, CRST, CCYN, ctx.currentOpcode, CRST,
-               CMAG, readBus(pc + 1), readBus(pc + 2), CRST);
-        printf(
-            "A=%s%02X%s BC=%s%02X%02X%s DE=%s%02X%02X%s HL=%s%02X%02X%s "
-            "SP=%s%04X%s | ",
-            CMAG, ctx.registers.a, CRST, CMAG, ctx.registers.b, ctx.registers.c,
-            CRST, CMAG, ctx.registers.d, ctx.registers.e, CRST, CMAG,
-            ctx.registers.h, ctx.registers.l, CRST, CMAG, ctx.registers.sp,
-            CRST);
-        char flags[5];
-        sprintf(flags, "%c%c%c%c", BIT(ctx.registers.f, 7) ? 'Z' : '-',
-                BIT(ctx.registers.f, 6) ? 'N' : '-',
-                BIT(ctx.registers.f, 5) ? 'H' : '-',
-                BIT(ctx.registers.f, 4) ? 'C' : '-');
-        printf("F=%s%02X%s (%s%s%s) | ", CMAG, ctx.registers.f, CRST, CBLU,
-               flags, CRST);
-        // Also print emulator clock cycles
-        printf("(t=%08lx)\n", getEMUContext()->ticks);
-
-        if (ctx.currentInstruction == NULL) {
-            printf("%sERR:%s Unknown instruction encountered! %s0x%02X%s\n",
-                   CRED, CRST, CMAG, ctx.currentOpcode, CRST);
-            exit(EXIT_FAILURE);
-        }
+void setCPUCore(gb_t *gb, cpuCore_t core) { gb->cpu.core = core; }
 
-        debugUpdate();
-        debugPrint();
+/**
+ * Selects the cycle model. Fast cycles emulate a whole instruction when its
+ * opcode is fetched, so its bus accesses all see the time after it.
+ *
+ * @param gb The Game Boy instance.
+ * @param mode The cycle model.
+ */
+void setCPUCycleMode(gb_t *gb, cycleMode_t mode) {
+    cpuContext_t *ctx = &gb->cpu;
 
-        execute();
-    } else {
-        // If the CPU is halted...
-        emulateCPUCycles(1);  // Halting causes cycles to occur
+    ctx->cycleMode = mode;
+    ctx->fetchCycles =
+        mode == CYCLES_FAST ? INSTRUCTION_CYCLES : FETCH_CYCLES;
 
-        if (ctx.interruptFlags) {
-            ctx.halted = false;
-        }
+    // Compiled blocks have the cycles of the previous model built in
+    clearCPUBlocks(gb);
+}
 
-        if (ctx.masterInterruptEnabled) {
-            handleCPUInterrupt(&ctx);
-            ctx.enablingIME = false;
-        }
+/**
+ * Requests that runCPUFor() returns, from any thread or event handler. A
+ * running runCPUFor() returns after the instruction it is running, once the
+ * events then due are handled; otherwise the next call returns without
+ * running.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stopCPU(gb_t *gb) {
+    cpuContext_t *ctx = &gb->cpu;
+
+    atomic_store_explicit(&ctx->stopping, true, memory_order_release);
+}
+
+/**
+ * Makes a running runCPUFor() handle scheduled events by the given tick.
+ * Instructions aren't interrupted, so events may run a few ticks late.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick.
+ */
+void limitCPURun(gb_t *gb, u64 ticks) {
+    cpuContext_t *ctx = &gb->cpu;
 
-        if (ctx.enablingIME) {
-            ctx.masterInterruptEnabled = true;
+    if (ticks < ctx->runUntil) {
+        ctx->runUntil = ticks;
+    }
+}
+
+/**
+ * Steps the CPU by one instruction.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stepCPU(gb_t *gb) {
+    cpuContext_t *ctx = &gb->cpu;
+
+    // Pending interrupts are serviced between instructions
+    if (ctx->pendingInterrupts) {
+        handleCPUInterrupt(ctx);
+        return;
+    }
+
+    if (ctx->halted) {
+        // Halting causes cycles to occur
+        emulateCPUCycles(gb, getHaltedCycles(gb));
+
+        // Requested interrupts wake the CPU, even if IME is off
+        if (ctx->interruptEnableRegister & ctx->interruptFlags & 0x1F) {
+            ctx->halted = false;
         }
+        return;
+    }
+
+    // EI sets IME after the instruction following it, unless that's DI
+    bool enablingIME = ctx->enablingIME;
+    runInstruction(gb);
+    if (enablingIME && ctx->enablingIME) {
+        ctx->enablingIME = false;
+        ctx->masterInterruptEnabled = true;
+        updateCPUInterrupts(ctx);
     }
 }
@@ -0,0 +1,305 @@
+// * Caches pre-decoded basic blocks of instructions for the block core.
+
+#include <gb.h>
+#include <string.h>
+
+// Number of executions after which the JIT core compiles a block
+#define BLOCK_HOT_EXECUTIONS 16
+
+// ===== Helper functions ======================================================
+
+/**
+ * Gets the index of an address in the RAM coverage counts.
+ *
+ * @param address The address.
+ * @return The index, or -1 if blocks are not decoded from the address.
+ */
+static int getRAMIndex(u16 address) {
+    if (address >= 0xC000 && address < 0xE000) {  // Working RAM
+        return address - 0xC000;
+    } else if (address >= 0xFF80 && address < 0xFFFF) {  // High RAM
+        return 0x2000 + (address - 0xFF80);
+    }
+
+    return -1;
+}
+
+/**
+ * Gets the end of the memory region containing an address. Blocks never
+ * cross a region, so that a bank switch or RAM write can't go unnoticed.
+ *
+ * @param address The address.
+ * @return The address after the region, or 0 if blocks can't be decoded
+ * from the region.
+ */
+static u32 getRegionEnd(u16 address) {
+    if (address < 0x4000) {  // ROM Bank 0
+        return 0x4000;
+    } else if (address < 0x8000) {  // ROM Bank 1 - Switchable
+        return 0x8000;
+    } else if (address >= 0xC000 && address < 0xE000) {  // Working RAM
+        return 0xE000;
+    } else if (address >= 0xFF80 && address < 0xFFFF) {  // High RAM
+        return 0xFFFF;
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the ROM bank that an address is mapped from.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address.
+ * @return The ROM bank, or 0 if the address isn't in ROM.
+ */
+static u16 getBank(gb_t *gb, u16 address) {
+    if (address < 0x8000) {
+        return getCartridgeROMBank(gb, address);
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the slot of the cache that a block is stored in.
+ *
+ * @param cache The block cache.
+ * @param pc The address of the first instruction.
+ * @param bank The ROM bank the address is mapped from.
+ * @return The slot for the block.
+ */
+static block_t *getSlot(blockCacheContext_t *cache, u16 pc, u16 bank) {
+    return &cache->blocks[(pc ^ (bank << 5)) & (BLOCK_CACHE_SIZE - 1)];
+}
+
+/**
+ * Checks whether an instruction ends a block. These may change the program
+ * counter, halt the CPU or change whether interrupts are handled.
+ *
+ * @param type The instruction type.
+ * @return Whether the instruction ends a block.
+ */
+static bool endsBlock(instructionType_t type) {
+    switch (type) {
+        case IN_JP:
+        case IN_JR:
+        case IN_JPHL:
+        case IN_CALL:
+        case IN_RET:
+        case IN_RETI:
+        case IN_RST:
+        case IN_HALT:
+        case IN_STOP:
+        case IN_DI:
+        case IN_EI:
+        case IN_NONE:
+        case IN_ERR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Adds to the number of blocks covering each RAM byte of a block, and marks
+ * its slot in the bitmaps of the RAM pages it covers, so that writes only
+ * look at the blocks on their page.
+ *
+ * @param cache The block cache.
+ * @param block The block.
+ * @param delta 1 when the block is added, -1 when it is removed.
+ */
+static void coverRAM(blockCacheContext_t *cache, const block_t *block,
+                     int delta) {
+    int index = getRAMIndex(block->start);
+    if (index < 0) {
+        return;
+    }
+
+    u16 size = block->end - block->start;
+    for (u16 i = 0; i < size; i++) {
+        cache->ramCoverage[index + i] += delta;
+    }
+
+    // A slot holds one block at a time, so its bits are set and cleared
+    // along with it
+    int slot = block - cache->blocks;
+    u64 bit = 1ull << (slot & 63);
+    for (int page = index >> 8; page <= (index + size - 1) >> 8; page++) {
+        u64 *word = &cache->ramPageSlots[page][slot >> 6];
+        *word = delta > 0 ? *word | bit : *word & ~bit;
+    }
+}
+
+/**
+ * Removes a block from the cache.
+ *
+ * @param cache The block cache.
+ * @param block The block.
+ */
+static void removeBlock(blockCacheContext_t *cache, block_t *block) {
+    if (block->valid) {
+        coverRAM(cache, block, -1);
+        block->valid = false;
+    }
+}
+
+/**
+ * Decodes the block starting at an address into its slot of the cache.
+ *
+ * @param gb The Game Boy instance.
+ * @param pc The address of the first instruction.
+ * @param bank The ROM bank the address is mapped from.
+ * @return The decoded block, or NULL if no block can start at the address.
+ */
+static block_t *decodeBlock(gb_t *gb, u16 pc, u16 bank) {
+    blockCacheContext_t *cache = &gb->blocks;
+    u32 regionEnd = getRegionEnd(pc);
+    if (!regionEnd) {
+        return NULL;
+    }
+
+    block_t *block = getSlot(cache, pc, bank);
+    removeBlock(cache, block);
+
+    u32 address = pc;
+    u8 count = 0;
+    while (count < BLOCK_MAX_INSTRUCTIONS) {
+        u8 opcode = readBus(gb, address);
+        const instruction_t *instruction = getInstructionFromOpcode(opcode);
+
+        // Leave instructions straddling the region to single stepping
+        u8 length = getInstructionLength(instruction);
+        if (address + length > regionEnd) {
+            break;
+        }
+
+        block->instructions[count].handler = getHandlerForOpcode(opcode);
+        block->instructions[count].opcode = opcode;
+        count++;
+        address += length;
+
+        if (endsBlock(instruction->type)) {
+            break;
+        }
+    }
+
+    if (!count) {
+        return NULL;
+    }
+
+    block->bank = bank;
+    block->start = pc;
+    block->end = address;
+    block->count = count;
+    block->executions = 0;
+    block->code = NULL;
+    block->valid = true;
+    coverRAM(cache, block, 1);
+
+    return block;
+}
+
+// ===== CPU block cache functions =============================================
+
+/**
+ * Empties the block cache.
+ *
+ * @param gb The Game Boy instance.
+ */
+void clearCPUBlocks(gb_t *gb) {
+    memset(&gb->blocks, 0, sizeof(gb->blocks));
+    resetJIT(gb);
+}
+
+/**
+ * Invalidates the cached blocks covering an address. Called for every write
+ * to WRAM or HRAM, so that code copied to or patched in RAM is decoded again.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address written to.
+ */
+void invalidateCPUBlocks(gb_t *gb, u16 address) {
+    blockCacheContext_t *cache = &gb->blocks;
+    int index = getRAMIndex(address);
+    if (index < 0 || !cache->ramCoverage[index]) {
+        return;
+    }
+
+    // Only the blocks on the written page can cover the address
+    u64 *slots = cache->ramPageSlots[index >> 8];
+    for (int i = 0; i < BLOCK_CACHE_SIZE / 64; i++) {
+        for (int bit = 0; bit < 64 && slots[i] >> bit; bit++) {
+            block_t *block = &cache->blocks[i * 64 + bit];
+            if (slots[i] >> bit & 1 && address >= block->start &&
+                address < block->end) {
+                removeBlock(cache, block);
+            }
+        }
+    }
+
+    cache->invalidations++;
+}
+
+/**
+ * Executes the cached block at the program counter, decoding it first if it
+ * isn't cached. Returns early once the runCPUFor() budget is spent, the CPU
+ * halts, the block is invalidated by a write or stopCPU() is called. With the
+ * JIT core, hot blocks are compiled into native code that returns early in
+ * the same places. Neither runs while tracing, which records every
+ * instruction through stepCPU().
+ *
+ * @param gb The Game Boy instance.
+ */
+void executeCPUBlock(gb_t *gb) {
+    blockCacheContext_t *cache = &gb->blocks;
+    cpuContext_t *ctx = &gb->cpu;
+    u16 pc = ctx->registers.pc;
+    u16 bank = getBank(gb, pc);
+
+    block_t *block = getSlot(cache, pc, bank);
+    if (!block->valid || block->start != pc || block->bank != bank) {
+        block = decodeBlock(gb, pc, bank);
+    }
+
+    // Code outside of ROM and RAM isn't cached
+    if (!block) {
+        stepCPU(gb);
+        return;
+    }
+
+    // Hot blocks of the JIT core run as native code
+    if (ctx->core == CORE_JIT && isJITAvailable(gb)) {
+        if (!block->code && ++block->executions >= BLOCK_HOT_EXECUTIONS) {
+            block->code =
+                compileJITBlock(gb, pc, block->count, ctx->fetchCycles);
+
+            // Start over once the executable memory is full
+            if (!block->code) {
+                clearCPUBlocks(gb);
+                return;
+            }
+        }
+
+        // Blocks that may outlast the slice are left to the loop below
+        if (block->code && block->code(ctx, &cache->invalidations)) {
+            return;
+        }
+    }
+
+    emuContext_t *emu = &gb->emu;
+    u32 invalidations = cache->invalidations;
+    for (u8 i = 0; i < block->count; i++) {
+        ctx->currentOpcode = block->instructions[i].opcode;
+        ctx->registers.pc++;
+        emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));
+
+        block->instructions[i].handler(ctx);
+
+        if (emu->ticks >= ctx->runUntil || ctx->halted ||
+            cache->invalidations != invalidations || isCPUStopping(ctx)) {
+            return;
+        }
+    }
+}
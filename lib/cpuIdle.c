@@ -0,0 +1,347 @@
+// * Detects busy-wait polling loops and skips their iterations.
+
+#include <gb.h>
+#include <string.h>
+
+/**
+ * Games often wait for VBlank or a timer by polling a register in a tight
+ * loop (e.g. LDH A,(n) / CP / JR NZ). When such a loop only reads memory and
+ * touches registers, an iteration that leaves the registers unchanged will be
+ * repeated exactly until something else changes the polled memory. Only
+ * scheduled events do that, so whole iterations can be skipped up to the next
+ * event, leaving the CPU in the same state as if it had run them.
+ */
+
+// Maximum size of a loop, in bytes
+#define IDLE_LOOP_MAX_SIZE 32
+
+// ===== Globals ===============================================================
+
+// Registers of the low 3 bits of CB operations (6 is (HL))
+static const registerType_t CB_REGISTERS[8] = {RT_B, RT_C, RT_D, RT_E,
+                                               RT_H, RT_L, RT_HL, RT_A};
+
+// ===== Helper functions ======================================================
+
+/**
+ * Gets the 8-bit registers making up a register, as a mask.
+ *
+ * @param registerType The register type.
+ * @return The mask of 8-bit registers.
+ */
+static u8 getRegisterMask(registerType_t registerType) {
+    switch (registerType) {
+        case RT_A:
+        case RT_AF:
+            return 0x01;
+        case RT_B:
+            return 0x02;
+        case RT_C:
+            return 0x04;
+        case RT_D:
+            return 0x08;
+        case RT_E:
+            return 0x10;
+        case RT_H:
+            return 0x20;
+        case RT_L:
+            return 0x40;
+        case RT_BC:
+            return 0x06;
+        case RT_DE:
+            return 0x18;
+        case RT_HL:
+            return 0x60;
+        case RT_SP:
+            return 0x80;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Checks whether a polled address only changes through the CPU or scheduled
+ * events. DIV, TIMA, the joypad and sound registers change on their own, and
+ * so may LY and STAT, if the PPU derives them from the ticks as the timer
+ * does DIV.
+ *
+ * @param address The address.
+ * @return Whether the address holds a stable value.
+ */
+static bool isStableAddress(u16 address) {
+    if (address < 0xFF00 || address >= 0xFF80) {  // Memory, HRAM and IE
+        return true;
+    }
+
+    switch (address) {
+        case 0xFF01:  // Serial
+        case 0xFF02:
+        case 0xFF06:  // TMA and TAC
+        case 0xFF07:
+        case 0xFF0F:  // Interrupt flags
+            return true;
+        case 0xFF41:  // STAT and LY
+        case 0xFF44:
+            return false;
+        default:  // Other LCD registers
+            return address >= 0xFF40 && address <= 0xFF4B;
+    }
+}
+
+/**
+ * Checks whether an addressing mode only writes a register, reading it from
+ * registers, immediate data or memory.
+ *
+ * @param mode The addressing mode.
+ * @return Whether the destination is a register.
+ */
+static bool writesRegister(addressingMode_t mode) {
+    switch (mode) {
+        case AM_R:
+        case AM_R_R:
+        case AM_R_D8:
+        case AM_R_D16:
+        case AM_R_MR:
+        case AM_R_A16:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Checks whether the instruction at an address only reads memory and touches
+ * registers, and notes the registers it writes and uses as an address.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the instruction.
+ * @param instruction The instruction.
+ * @param writes The mask of 8-bit registers written, added to.
+ * @param addressRegisters The registers used as addresses, added to.
+ * @return Whether the instruction has no side effects.
+ */
+static bool isPollingInstruction(gb_t *gb, u16 address,
+                                 const instruction_t *instruction,
+                                 u8 *writes, u16 *addressRegisters) {
+    switch (instruction->type) {
+        case IN_NOP:
+        case IN_SCF:
+        case IN_CCF:
+        case IN_CP:
+            break;
+        case IN_CPL:
+        case IN_DAA:
+        case IN_RLCA:
+        case IN_RRCA:
+        case IN_RLA:
+        case IN_RRA:
+            *writes |= getRegisterMask(RT_A);
+            break;
+        case IN_LDH:
+            // Only LDH A,(a8) reads - the other way around writes
+            if (instruction->mode != AM_R_A8 ||
+                !isStableAddress(0xFF00 | readBus(gb, address + 1))) {
+                return false;
+            }
+            *writes |= getRegisterMask(RT_A);
+            break;
+        case IN_LD:
+        case IN_INC:
+        case IN_DEC:
+        case IN_ADD:
+        case IN_ADC:
+        case IN_SUB:
+        case IN_SBC:
+        case IN_AND:
+        case IN_XOR:
+        case IN_OR:
+            if (instruction->mode == AM_R_A16 &&
+                !isStableAddress(readBus16(gb, address + 1))) {
+                return false;
+            }
+            if (!writesRegister(instruction->mode)) {
+                return false;
+            }
+            *writes |= getRegisterMask(instruction->register1);
+            break;
+        case IN_CB: {
+            u8 operation = readBus(gb, address + 1);
+            registerType_t registerType = CB_REGISTERS[operation & 0b111];
+
+            // Only BIT leaves its operand as it is
+            if (operation >> 6 != 1) {
+                if (registerType == RT_HL) {
+                    return false;
+                }
+                *writes |= getRegisterMask(registerType);
+            } else if (registerType == RT_HL) {
+                *addressRegisters |= 1 << RT_HL;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+
+    // Memory read through a register
+    if (instruction->mode == AM_R_MR) {
+        *addressRegisters |= 1 << instruction->register2;
+    }
+
+    return true;
+}
+
+/**
+ * Checks whether a loop is a polling loop: straight-line code that only reads
+ * memory and touches registers, ending in the jump back to its head. Registers
+ * used as addresses must not change within the loop.
+ *
+ * @param gb The Game Boy instance.
+ * @param loop The loop, whose head and end are set.
+ * @return Whether the loop is a polling loop.
+ */
+static bool isPollingLoop(gb_t *gb, idleLoop_t *loop) {
+    if (loop->end - loop->head > IDLE_LOOP_MAX_SIZE) {
+        return false;
+    }
+
+    u8 writes = 0;
+    u16 address = loop->head;
+    loop->addressRegisters = 0;
+
+    while (true) {
+        const instruction_t *instruction =
+            getInstructionFromOpcode(readBus(gb, address));
+        u16 next = address + getInstructionLength(instruction);
+
+        // The loop ends with the jump back to its head
+        if (next == loop->end) {
+            if (instruction->type != IN_JR &&
+                (instruction->type != IN_JP || instruction->mode != AM_D16)) {
+                return false;
+            }
+            break;
+        }
+
+        if (next > loop->end ||
+            !isPollingInstruction(gb, address, instruction, &writes,
+                                  &loop->addressRegisters)) {
+            return false;
+        }
+        address = next;
+    }
+
+    // LD A,(C) reads through C, the others through register pairs
+    static const registerType_t ADDRESS_REGISTERS[] = {RT_C, RT_BC, RT_DE,
+                                                       RT_HL};
+    for (int i = 0; i < 4; i++) {
+        registerType_t type = ADDRESS_REGISTERS[i];
+        if (loop->addressRegisters & (1 << type) &&
+            writes & getRegisterMask(type)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Checks whether the addresses a loop reads through registers are stable.
+ *
+ * @param ctx The CPU context.
+ * @param loop The loop.
+ * @return Whether the loop only polls stable addresses.
+ */
+static bool pollsStableAddresses(cpuContext_t *ctx, const idleLoop_t *loop) {
+    cpuRegisters_t *registers = &ctx->registers;
+
+    return (!(loop->addressRegisters & (1 << RT_BC)) ||
+            isStableAddress(registers->bc)) &&
+           (!(loop->addressRegisters & (1 << RT_DE)) ||
+            isStableAddress(registers->de)) &&
+           (!(loop->addressRegisters & (1 << RT_HL)) ||
+            isStableAddress(registers->hl)) &&
+           (!(loop->addressRegisters & (1 << RT_C)) ||
+            isStableAddress(0xFF00 | registers->c));
+}
+
+// ===== CPU idle loop functions ===============================================
+
+/**
+ * Forgets all loops, e.g. when a new cartridge is run.
+ *
+ * @param gb The Game Boy instance.
+ */
+void clearIdleLoops(gb_t *gb) {
+    memset(&gb->idleLoops, 0, sizeof(gb->idleLoops));
+}
+
+/**
+ * Called after a backward jump to the program counter. If the jump closes a
+ * polling loop, runs one iteration; when it comes back to the head with the
+ * registers unchanged, skips as many further iterations as fit before the
+ * runCPUFor() deadline. The loop then runs normally up to the deadline, so the
+ * state is the same as if every iteration was run.
+ *
+ * @param gb The Game Boy instance.
+ * @param end The address after the jump.
+ */
+void skipIdleLoop(gb_t *gb, u16 end) {
+    idleLoopContext_t *idle = &gb->idleLoops;
+    cpuContext_t *ctx = &gb->cpu;
+    u16 head = ctx->registers.pc;
+
+    // Code in RAM may be rewritten, so only loops in ROM are remembered.
+    // Traces show every instruction, so loops aren't skipped while tracing.
+    if (idle->iterating || end > 0x8000 || isTraceEnabled(gb)) {
+        return;
+    }
+
+    u16 bank = getCartridgeROMBank(gb, head);
+    idleLoop_t *loop = &idle->loops[head & (IDLE_LOOP_SLOTS - 1)];
+    if (!loop->valid || loop->head != head || loop->end != end ||
+        loop->bank != bank) {
+        loop->valid = true;
+        loop->head = head;
+        loop->end = end;
+        loop->bank = bank;
+        loop->polling = isPollingLoop(gb, loop);
+    }
+
+    emuContext_t *emu = &gb->emu;
+    if (!loop->polling || emu->ticks >= ctx->runUntil ||
+        !pollsStableAddresses(ctx, loop)) {
+        return;
+    }
+
+    materializeCPUFlags(ctx);
+    cpuRegisters_t registers = ctx->registers;
+    u64 start = emu->ticks;
+
+    // Run one iteration, stopping if it leaves the loop or an event is due
+    idle->iterating = true;
+    do {
+        ctx->currentOpcode = readBus(gb, ctx->registers.pc++);
+        emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));
+
+        getHandlerForOpcode(ctx->currentOpcode)(ctx);
+    } while (ctx->registers.pc > head && ctx->registers.pc < end &&
+             emu->ticks < ctx->runUntil);
+    idle->iterating = false;
+
+    if (ctx->registers.pc != head || emu->ticks >= ctx->runUntil) {
+        return;
+    }
+
+    // Loops that change registers (e.g. delay loops) never settle
+    materializeCPUFlags(ctx);
+    if (memcmp(&registers, &ctx->registers, sizeof(registers))) {
+        loop->polling = false;
+        return;
+    }
+
+    // Nothing changes the polled memory before the deadline, so every
+    // iteration until then is the same
+    u64 period = emu->ticks - start;
+    emulateCPUCycles(gb, (ctx->runUntil - emu->ticks) / period * period / 4);
+}
@@ -0,0 +1,1201 @@
+// * Recompiles hot blocks of instructions into native x86-64 code.
+
+#include <gb.h>
+#include <stddef.h>
+#include <string.h>
+
+// The emitter targets the System V x86-64 calling convention
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// Size of the memory that compiled blocks are emitted into
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+// Upper bound of the code emitted for a block's prologue and epilogue
+#define JIT_BLOCK_OVERHEAD 128
+// Upper bound of the code emitted for a single instruction
+#define JIT_INSTRUCTION_SIZE 384
+// Upper bound of the jumps to the epilogue emitted for a block
+#define JIT_MAX_EXITS (BLOCK_MAX_INSTRUCTIONS * 4)
+
+// Offsets into the CPU context, addressed with 8-bit displacements
+#define OFFSET(field) ((u8)offsetof(cpuContext_t, field))
+_Static_assert(offsetof(cpuContext_t, pendingInterrupts) < 0x80,
+               "CPU context fields must be within reach of a disp8");
+
+// Offsets into the Game Boy instance, addressed with 32-bit displacements
+#define GB_OFFSET(field) ((u32)offsetof(gb_t, field))
+
+// Operation of the lazy flags while a block is compiled, if not known
+#define FLAGS_UNKNOWN -1
+
+// x86-64 registers that operands are loaded into
+typedef enum {
+    RAX,  // Result, and the address of memory accesses
+    RCX,  // Left operand
+    RDX   // Right operand, and the value of memory writes
+} hostRegister_t;
+
+// State of the block being compiled
+typedef struct {
+    jitContext_t *jit;         // Executable memory emitted into
+    gb_t *gb;                  // Instance the block belongs to
+    cycleMode_t cycleMode;     // Cycle model the block is compiled for
+    const u8 *fetchCycles;     // CPU cycles of fetching each opcode
+    u32 pending;               // CPU cycles not yet added to the ticks
+    u32 charged;               // CPU cycles emulated by the block so far
+    bool called;               // Whether the instruction may call into C
+    int flagsOp;               // Lazy flags operation, or FLAGS_UNKNOWN
+    u32 budget;                // Position of the open budget check's cycles
+    u32 budgetCycles;          // CPU cycles the open budget check covers
+    u32 exits[JIT_MAX_EXITS];  // Positions of the jumps to the epilogue
+    u16 exitCount;             // Number of jumps to the epilogue
+} jitBlock_t;
+
+// ===== Emitter functions =====================================================
+
+// Emits the given bytes of code into ctx, one instruction per use
+#define EMIT(...)                             \
+    emitBytes(ctx, (const u8[]){__VA_ARGS__}, \
+              sizeof((const u8[]){__VA_ARGS__}))
+
+/**
+ * Emits bytes of code.
+ *
+ * @param ctx The block being compiled.
+ * @param bytes The bytes.
+ * @param size The number of bytes.
+ */
+static void emitBytes(jitBlock_t *ctx, const u8 *bytes, size_t size) {
+    memcpy(ctx->jit->code + ctx->jit->used, bytes, size);
+    ctx->jit->used += size;
+}
+
+/**
+ * Emits a 16-bit little-endian value.
+ *
+ * @param ctx The block being compiled.
+ * @param value The value.
+ */
+static void emit16(jitBlock_t *ctx, u16 value) {
+    EMIT(value & 0xFF, value >> 8);
+}
+
+/**
+ * Emits a 32-bit little-endian value.
+ *
+ * @param ctx The block being compiled.
+ * @param value The value.
+ */
+static void emit32(jitBlock_t *ctx, u32 value) {
+    emit16(ctx, value & 0xFFFF);
+    emit16(ctx, value >> 16);
+}
+
+/**
+ * Emits a short forward jump, to be patched once its target is emitted.
+ *
+ * @param ctx The block being compiled.
+ * @param opcode The opcode of the jump (JMP or Jcc rel8).
+ * @return The position of the jump's displacement.
+ */
+static u32 emitJump8(jitBlock_t *ctx, u8 opcode) {
+    EMIT(opcode, 0);
+    return ctx->jit->used - 1;
+}
+
+/**
+ * Points a short forward jump at the current position.
+ *
+ * @param ctx The block being compiled.
+ * @param position The position of the jump's displacement.
+ */
+static void patchJump8(jitBlock_t *ctx, u32 position) {
+    ctx->jit->code[position] = ctx->jit->used - (position + 1);
+}
+
+/**
+ * Emits a jump to the epilogue, which leaves the block.
+ *
+ * @param ctx The block being compiled.
+ * @param condition The condition code of the jump (Jcc rel32), or 0 to
+ * always jump.
+ */
+static void emitExit(jitBlock_t *ctx, u8 condition) {
+    if (condition) {
+        EMIT(0x0F, condition);  // jcc epilogue
+    } else {
+        EMIT(0xE9);  // jmp epilogue
+    }
+
+    ctx->exits[ctx->exitCount++] = ctx->jit->used;
+    emit32(ctx, 0);
+}
+
+/**
+ * Emits a call to a function through RAX.
+ *
+ * @param ctx The block being compiled.
+ * @param function The function to call.
+ */
+static void emitCall(jitBlock_t *ctx, const void *function) {
+    EMIT(0x48, 0xB8);  // mov rax, imm64
+    emit32(ctx, (u64)function & 0xFFFFFFFF);
+    emit32(ctx, (u64)function >> 32);
+    EMIT(0xFF, 0xD0);  // call rax
+}
+
+/**
+ * Emits a load of a one byte field of the CPU context.
+ *
+ * @param ctx The block being compiled.
+ * @param reg The register loaded into (its low byte).
+ * @param offset The offset of the field.
+ */
+static void emitLoad8(jitBlock_t *ctx, hostRegister_t reg, u8 offset) {
+    EMIT(0x8A, 0x43 | reg << 3, offset);  // mov r8, [rbx + offset]
+}
+
+/**
+ * Emits a store to a one byte field of the CPU context.
+ *
+ * @param ctx The block being compiled.
+ * @param reg The register stored (its low byte).
+ * @param offset The offset of the field.
+ */
+static void emitStore8(jitBlock_t *ctx, hostRegister_t reg, u8 offset) {
+    EMIT(0x88, 0x43 | reg << 3, offset);  // mov [rbx + offset], r8
+}
+
+/**
+ * Emits a zero-extending load of a two byte field of the CPU context.
+ *
+ * @param ctx The block being compiled.
+ * @param reg The register loaded into.
+ * @param offset The offset of the field.
+ */
+static void emitLoad16(jitBlock_t *ctx, hostRegister_t reg, u8 offset) {
+    EMIT(0x0F, 0xB7, 0x43 | reg << 3, offset);  // movzx r32, [rbx + offset]
+}
+
+/**
+ * Emits a store of a constant to a one byte field of the CPU context.
+ *
+ * @param ctx The block being compiled.
+ * @param offset The offset of the field.
+ * @param value The constant.
+ */
+static void emitStoreImm8(jitBlock_t *ctx, u8 offset, u8 value) {
+    EMIT(0xC6, 0x43, offset, value);  // mov byte [rbx + offset], imm8
+}
+
+/**
+ * Emits a store of the program counter.
+ *
+ * @param ctx The block being compiled.
+ * @param pc The value of the program counter.
+ */
+static void emitStorePC(jitBlock_t *ctx, u16 pc) {
+    EMIT(0x66, 0xC7, 0x43, OFFSET(registers.pc));  // mov word [pc], imm16
+    emit16(ctx, pc);
+}
+
+// ===== Cycle functions =======================================================
+
+/**
+ * Emulates the cycles of fetching an opcode, as the block core does.
+ *
+ * @param ctx The block being compiled.
+ * @param opcode The opcode.
+ */
+static void chargeFetch(jitBlock_t *ctx, u8 opcode) {
+    ctx->pending += ctx->fetchCycles[opcode];
+    ctx->charged += ctx->fetchCycles[opcode];
+}
+
+/**
+ * Emulates the cycles of a bus access, as emulateAccessCycles() does.
+ *
+ * @param ctx The block being compiled.
+ * @param cycles The number of CPU cycles.
+ */
+static void chargeAccess(jitBlock_t *ctx, u32 cycles) {
+    if (ctx->cycleMode == CYCLES_ACCURATE) {
+        ctx->pending += cycles;
+        ctx->charged += cycles;
+    }
+}
+
+/**
+ * Emulates cycles missing from the cycle table, as emulateExtraCycles() does.
+ *
+ * @param ctx The block being compiled.
+ * @param cycles The number of CPU cycles.
+ */
+static void chargeExtra(jitBlock_t *ctx, u32 cycles) {
+    if (ctx->cycleMode == CYCLES_FAST) {
+        ctx->pending += cycles;
+        ctx->charged += cycles;
+    }
+}
+
+/**
+ * Emits the addition of the pending cycles to the emulator's ticks. Cycles
+ * are only added before they can be observed: at bus accesses, calls and
+ * exits.
+ *
+ * @param ctx The block being compiled.
+ */
+static void emitFlush(jitBlock_t *ctx) {
+    if (ctx->pending) {
+        EMIT(0x49, 0x81, 0x07);  // add qword [r15], imm32
+        emit32(ctx, ctx->pending * 4);
+        ctx->pending = 0;
+    }
+}
+
+/**
+ * Emits a jump taken if the runCPUFor() slice is spent by the time the next
+ * instructions run. Their cycles are only known once they are compiled, so
+ * the check stays open until closeBudgetCheck().
+ *
+ * @param ctx The block being compiled.
+ * @param toEpilogue Whether the jump leaves the block, rather than being
+ * patched by the caller.
+ * @return The position of the jump's displacement, if patched by the caller.
+ */
+static u32 emitBudgetCheck(jitBlock_t *ctx, bool toEpilogue) {
+    EMIT(0x49, 0x8B, 0x07);  // mov rax, [r15]
+    EMIT(0x48, 0x05);        // add rax, imm32
+    ctx->budget = ctx->jit->used;
+    ctx->budgetCycles = 0;
+    emit32(ctx, 0);
+    EMIT(0x48, 0x3B, 0x43, OFFSET(runUntil));  // cmp rax, [runUntil]
+
+    if (toEpilogue) {
+        emitExit(ctx, 0x83);  // jae epilogue
+        return 0;
+    }
+
+    EMIT(0x0F, 0x83);  // jae
+    u32 position = ctx->jit->used;
+    emit32(ctx, 0);
+
+    return position;
+}
+
+/**
+ * Closes the open budget check, once the cycles it covers are known.
+ *
+ * @param ctx The block being compiled.
+ */
+static void closeBudgetCheck(jitBlock_t *ctx) {
+    u32 ticks = ctx->budgetCycles * 4;
+    memcpy(&ctx->jit->code[ctx->budget], &ticks, sizeof(ticks));
+}
+
+/**
+ * Emits the checks made after an instruction that called into C, which may
+ * have scheduled an event, requested an interrupt, halted or stopped the CPU
+ * or overwritten cached code. The block leaves where the block core would, or
+ * earlier if the slice can't cover the instructions up to the next check.
+ *
+ * @param ctx The block being compiled.
+ * @param pc The address of the next instruction.
+ */
+static void emitExitChecks(jitBlock_t *ctx, u16 pc) {
+    emitFlush(ctx);
+    emitStorePC(ctx, pc);
+    emitBudgetCheck(ctx, true);
+
+    EMIT(0x80, 0x7B, OFFSET(halted), 0);    // cmp byte [halted], 0
+    emitExit(ctx, 0x85);                    // jne epilogue
+    EMIT(0x80, 0x7B, OFFSET(stopping), 0);  // cmp byte [stopping], 0
+    emitExit(ctx, 0x85);                    // jne epilogue
+    EMIT(0x41, 0x8B, 0x04, 0x24);           // mov eax, [r12]
+    EMIT(0x44, 0x39, 0xE8);                 // cmp eax, r13d
+    emitExit(ctx, 0x85);                    // jne epilogue
+}
+
+// ===== Bus functions =========================================================
+
+/**
+ * Emits a read of the bus at the address in EAX into AL. Plain memory is read
+ * inline, other pages through readBus().
+ *
+ * @param ctx The block being compiled.
+ */
+static void emitRead(jitBlock_t *ctx) {
+    emitFlush(ctx);
+
+    EMIT(0x89, 0xC1);              // mov ecx, eax
+    EMIT(0xC1, 0xE9, 0x08);        // shr ecx, 8
+    EMIT(0x49, 0x8B, 0x94, 0xCE);  // mov rdx, [r14 + rcx * 8 + readPages]
+    emit32(ctx, GB_OFFSET(bus.readPages));
+    EMIT(0x48, 0x85, 0xD2);              // test rdx, rdx
+    u32 handler = emitJump8(ctx, 0x74);  // jz handler
+
+    EMIT(0x0F, 0xB6, 0xC8);           // movzx ecx, al
+    EMIT(0x8A, 0x04, 0x0A);           // mov al, [rdx + rcx]
+    u32 done = emitJump8(ctx, 0xEB);  // jmp done
+
+    patchJump8(ctx, handler);
+    EMIT(0x4C, 0x89, 0xF7);  // mov rdi, r14
+    EMIT(0x89, 0xC6);        // mov esi, eax
+    emitCall(ctx, (const void *)readBus);
+    patchJump8(ctx, done);
+
+    ctx->called = true;
+}
+
+/**
+ * Emits a read of the bus at a constant address into AL. High RAM is read
+ * directly, as its page also holds the I/O registers.
+ *
+ * @param ctx The block being compiled.
+ * @param address The address.
+ */
+static void emitReadConstant(jitBlock_t *ctx, u16 address) {
+    if (address >= 0xFF80 && address < 0xFFFF) {
+        EMIT(0x41, 0x8A, 0x86);  // mov al, [r14 + hram]
+        emit32(ctx, GB_OFFSET(ram.hram) + (address - 0xFF80));
+        return;
+    }
+
+    EMIT(0xB8);  // mov eax, imm32
+    emit32(ctx, address);
+    emitRead(ctx);
+}
+
+/**
+ * Emits a write of DL to the bus at the address in EAX. Working and high RAM
+ * that no cached block was decoded from are written inline, everything else
+ * through writeBus().
+ *
+ * @param ctx The block being compiled.
+ */
+static void emitWrite(jitBlock_t *ctx) {
+    emitFlush(ctx);
+
+    EMIT(0x8D, 0x88);  // lea ecx, [rax - 0xC000]
+    emit32(ctx, -0xC000);
+    EMIT(0x81, 0xF9);  // cmp ecx, 0x2000
+    emit32(ctx, 0x2000);
+    u32 highRAM = emitJump8(ctx, 0x73);  // jae highRAM
+    EMIT(0x66, 0x41, 0x83, 0xBC, 0x4E);  // cmp word [r14 + rcx * 2 + ...], 0
+    emit32(ctx, GB_OFFSET(blocks.ramCoverage));
+    EMIT(0);
+    u32 coveredWRAM = emitJump8(ctx, 0x75);  // jne handler
+    EMIT(0x41, 0x88, 0x94, 0x0E);            // mov [r14 + rcx + wram], dl
+    emit32(ctx, GB_OFFSET(ram.wram));
+    u32 wramDone = emitJump8(ctx, 0xEB);  // jmp done
+
+    patchJump8(ctx, highRAM);
+    EMIT(0x8D, 0x88);  // lea ecx, [rax - 0xFF80]
+    emit32(ctx, -0xFF80);
+    EMIT(0x83, 0xF9, 0x7F);              // cmp ecx, 0x7F
+    u32 other = emitJump8(ctx, 0x73);    // jae handler
+    EMIT(0x66, 0x41, 0x83, 0xBC, 0x4E);  // cmp word [r14 + rcx * 2 + ...], 0
+    emit32(ctx, GB_OFFSET(blocks.ramCoverage[0x2000]));
+    EMIT(0);
+    u32 coveredHRAM = emitJump8(ctx, 0x75);  // jne handler
+    EMIT(0x41, 0x88, 0x94, 0x0E);            // mov [r14 + rcx + hram], dl
+    emit32(ctx, GB_OFFSET(ram.hram));
+    u32 hramDone = emitJump8(ctx, 0xEB);  // jmp done
+
+    patchJump8(ctx, coveredWRAM);
+    patchJump8(ctx, other);
+    patchJump8(ctx, coveredHRAM);
+    EMIT(0x4C, 0x89, 0xF7);  // mov rdi, r14
+    EMIT(0x89, 0xC6);        // mov esi, eax
+    EMIT(0x0F, 0xB6, 0xD2);  // movzx edx, dl
+    emitCall(ctx, (const void *)writeBus);
+    patchJump8(ctx, wramDone);
+    patchJump8(ctx, hramDone);
+
+    ctx->called = true;
+}
+
+// ===== Helper functions ======================================================
+
+/**
+ * Reads the 16-bit operand of an instruction.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the instruction.
+ * @return The operand.
+ */
+static u16 readOperand16(gb_t *gb, u16 address) {
+    return readBus(gb, address + 1) | (readBus(gb, address + 2) << 8);
+}
+
+/**
+ * Gets the offset of a one byte register in the CPU context.
+ *
+ * @param registerType The register type.
+ * @return The offset, or -1 if the register isn't a one byte register.
+ */
+static int getRegister8Offset(registerType_t registerType) {
+    switch (registerType) {
+        case RT_A:
+            return OFFSET(registers.a);
+        case RT_B:
+            return OFFSET(registers.b);
+        case RT_C:
+            return OFFSET(registers.c);
+        case RT_D:
+            return OFFSET(registers.d);
+        case RT_E:
+            return OFFSET(registers.e);
+        case RT_H:
+            return OFFSET(registers.h);
+        case RT_L:
+            return OFFSET(registers.l);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Gets the offset of a two byte register in the CPU context.
+ *
+ * @param registerType The register type.
+ * @return The offset, or -1 if the register isn't BC, DE, HL or SP.
+ */
+static int getRegister16Offset(registerType_t registerType) {
+    switch (registerType) {
+        case RT_BC:
+            return OFFSET(registers.bc);
+        case RT_DE:
+            return OFFSET(registers.de);
+        case RT_HL:
+            return OFFSET(registers.hl);
+        case RT_SP:
+            return OFFSET(registers.sp);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Emits a computation of the flags of the last lazily evaluated operation
+ * into the F register, as materializeCPUFlags() does.
+ *
+ * @param ctx The block being compiled.
+ */
+static void emitMaterializeFlags(jitBlock_t *ctx) {
+    if (ctx->flagsOp == FLAGS_NONE) {
+        return;
+    }
+
+    u32 done = 0;
+    if (ctx->flagsOp == FLAGS_UNKNOWN) {
+        EMIT(0x80, 0x7B, OFFSET(lazyFlags.op), FLAGS_NONE);  // cmp [op], 0
+        done = emitJump8(ctx, 0x74);                         // je done
+    }
+
+    EMIT(0x48, 0x89, 0xDF);  // mov rdi, rbx
+    emitCall(ctx, (const void *)evaluateLazyFlags);
+
+    if (done) {
+        patchJump8(ctx, done);
+    }
+    ctx->flagsOp = FLAGS_NONE;
+}
+
+/**
+ * Emits a load of an 8-bit ALU operand into DL.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @param address The address of the instruction.
+ */
+static void emitOperand(jitBlock_t *ctx, const instruction_t *instruction,
+                        u16 address) {
+    switch (instruction->mode) {
+        case AM_R_R:
+            emitLoad8(ctx, RDX, getRegister8Offset(instruction->register2));
+            return;
+
+        case AM_R_D8:
+            EMIT(0xB2, readBus(ctx->gb, address + 1));  // mov dl, d8
+            chargeAccess(ctx, 1);
+            return;
+
+        default:  // AM_R_MR from (HL)
+            emitLoad16(ctx, RAX, OFFSET(registers.hl));
+            emitRead(ctx);
+            chargeAccess(ctx, 1);
+            EMIT(0x89, 0xC2);  // mov edx, eax
+            return;
+    }
+}
+
+/**
+ * Emits an 8-bit arithmetic or logic operation on the accumulator, with its
+ * flags recorded for lazy evaluation as the opcode handlers do.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @param address The address of the instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitALU(jitBlock_t *ctx, const instruction_t *instruction,
+                    u16 address) {
+    bool fromRegister = instruction->mode == AM_R_R &&
+                        getRegister8Offset(instruction->register2) >= 0;
+    bool fromHL = instruction->mode == AM_R_MR &&
+                  instruction->register2 == RT_HL;
+    if (instruction->register1 != RT_A ||
+        (!fromRegister && !fromHL && instruction->mode != AM_R_D8)) {
+        return false;
+    }
+
+    instructionType_t type = instruction->type;
+    bool withCarry = type == IN_ADC || type == IN_SBC;
+    if (withCarry) {
+        // Calls clobber the operand, so the carry is brought up to date first
+        emitMaterializeFlags(ctx);
+    }
+
+    emitOperand(ctx, instruction, address);
+
+    if (type == IN_AND || type == IN_XOR || type == IN_OR) {
+        emitLoad8(ctx, RAX, OFFSET(registers.a));
+        if (type == IN_AND) {
+            EMIT(0x20, 0xD0);  // and al, dl
+        } else if (type == IN_XOR) {
+            EMIT(0x30, 0xD0);  // xor al, dl
+        } else {
+            EMIT(0x08, 0xD0);  // or al, dl
+        }
+        emitStore8(ctx, RAX, OFFSET(registers.a));
+
+        ctx->flagsOp = type == IN_AND ? FLAGS_AND : FLAGS_OR;
+        emitStore8(ctx, RAX, OFFSET(lazyFlags.result));
+        emitStoreImm8(ctx, OFFSET(lazyFlags.op), ctx->flagsOp);
+        return true;
+    }
+
+    bool addition = type == IN_ADD || type == IN_ADC;
+    emitLoad8(ctx, RCX, OFFSET(registers.a));
+    EMIT(0x88, 0xC8);                    // mov al, cl
+    EMIT(addition ? 0x00 : 0x28, 0xD0);  // add/sub al, dl
+    if (withCarry) {
+        EMIT(0x44, 0x0F, 0xB6, 0x43, OFFSET(registers.f));  // movzx r8d, [f]
+        EMIT(0x41, 0xC1, 0xE8, 0x04);                       // shr r8d, 4
+        EMIT(0x41, 0x83, 0xE0, 0x01);                       // and r8d, 1
+        EMIT(0x44, addition ? 0x00 : 0x28, 0xC0);           // add/sub al, r8b
+        EMIT(0x44, 0x88, 0x43, OFFSET(lazyFlags.carry));    // mov [carry], r8b
+    } else {
+        emitStoreImm8(ctx, OFFSET(lazyFlags.carry), 0);
+    }
+    if (type != IN_CP) {
+        emitStore8(ctx, RAX, OFFSET(registers.a));
+    }
+
+    ctx->flagsOp = addition ? FLAGS_ADD : FLAGS_SUB;
+    emitStore8(ctx, RCX, OFFSET(lazyFlags.left));
+    emitStore8(ctx, RDX, OFFSET(lazyFlags.right));
+    emitStore8(ctx, RAX, OFFSET(lazyFlags.result));
+    emitStoreImm8(ctx, OFFSET(lazyFlags.op), ctx->flagsOp);
+    return true;
+}
+
+/**
+ * Emits an INC or DEC of a register.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitIncDec(jitBlock_t *ctx, const instruction_t *instruction) {
+    int reg = getRegister8Offset(instruction->register1);
+    int pair = getRegister16Offset(instruction->register1);
+    if (instruction->mode != AM_R) {
+        return false;
+    }
+
+    // ModR/M reg field selecting inc (0) or dec (1)
+    u8 operation = instruction->type == IN_INC ? 0 : 1 << 3;
+
+    // INC rr and DEC rr don't set flags
+    if (pair >= 0) {
+        EMIT(0x66, 0xFF, 0x43 | operation, pair);  // inc/dec word [rr]
+        chargeAccess(ctx, 1);
+        return true;
+    }
+
+    // The carry flag is kept, so it must be up to date. After INC and DEC,
+    // the last operations, it already is: their flags keep the F register's.
+    if (ctx->flagsOp == FLAGS_UNKNOWN) {
+        EMIT(0x80, 0x7B, OFFSET(lazyFlags.op), FLAGS_INC);  // cmp [op], INC
+        u32 current = emitJump8(ctx, 0x73);                 // jae current
+        emitMaterializeFlags(ctx);
+        patchJump8(ctx, current);
+    } else if (ctx->flagsOp != FLAGS_INC && ctx->flagsOp != FLAGS_DEC) {
+        emitMaterializeFlags(ctx);
+    }
+
+    emitLoad8(ctx, RAX, reg);
+    EMIT(0xFE, 0xC0 | operation);  // inc/dec al
+    emitStore8(ctx, RAX, reg);
+
+    ctx->flagsOp = instruction->type == IN_INC ? FLAGS_INC : FLAGS_DEC;
+    emitStore8(ctx, RAX, OFFSET(lazyFlags.result));
+    emitStoreImm8(ctx, OFFSET(lazyFlags.op), ctx->flagsOp);
+    return true;
+}
+
+/**
+ * Emits a load of the address of a memory operand into EAX.
+ *
+ * @param ctx The block being compiled.
+ * @param registerType The register holding the address.
+ */
+static void emitAddress(jitBlock_t *ctx, registerType_t registerType) {
+    // (C) addresses the I/O registers
+    if (registerType == RT_C) {
+        EMIT(0x0F, 0xB6, 0x43, OFFSET(registers.c));  // movzx eax, [c]
+        EMIT(0x0D);                                   // or eax, 0xFF00
+        emit32(ctx, 0xFF00);
+        return;
+    }
+
+    emitLoad16(ctx, RAX, getRegister16Offset(registerType));
+}
+
+/**
+ * Emits an LD or LDH instruction.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @param address The address of the instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitLoad(jitBlock_t *ctx, const instruction_t *instruction,
+                     u16 address) {
+    gb_t *gb = ctx->gb;
+    int destination = getRegister8Offset(instruction->register1);
+    int source = getRegister8Offset(instruction->register2);
+    int pair = getRegister16Offset(instruction->register1);
+    bool addressRegister = instruction->register2 == RT_C ||
+                           (instruction->register2 >= RT_BC &&
+                            instruction->register2 <= RT_HL);
+    bool addressedByRegister = instruction->register1 == RT_C ||
+                               (instruction->register1 >= RT_BC &&
+                                instruction->register1 <= RT_HL);
+
+    switch (instruction->mode) {
+        // LD r, r
+        case AM_R_R:
+            if (destination < 0 || source < 0) {
+                return false;
+            }
+
+            emitLoad8(ctx, RAX, source);
+            emitStore8(ctx, RAX, destination);
+            return true;
+
+        // LD r, d8
+        case AM_R_D8:
+            if (destination < 0) {
+                return false;
+            }
+
+            emitStoreImm8(ctx, destination, readBus(gb, address + 1));
+            chargeAccess(ctx, 1);
+            return true;
+
+        // LD rr, d16
+        case AM_R_D16:
+            if (pair < 0) {
+                return false;
+            }
+
+            EMIT(0x66, 0xC7, 0x43, pair);  // mov word [rr], d16
+            emit16(ctx, readOperand16(gb, address));
+            chargeAccess(ctx, 2);
+            return true;
+
+        // LD r, (rr) and LD A, (C)
+        case AM_R_MR:
+            if (destination < 0 || !addressRegister) {
+                return false;
+            }
+
+            emitAddress(ctx, instruction->register2);
+            emitRead(ctx);
+            chargeAccess(ctx, 1);
+            emitStore8(ctx, RAX, destination);
+            return true;
+
+        // LD A, (HL+) and LD A, (HL-)
+        case AM_R_HLI:
+        case AM_R_HLD: {
+            emitAddress(ctx, RT_HL);
+            emitRead(ctx);
+            chargeAccess(ctx, 1);
+            emitStore8(ctx, RAX, destination);
+
+            u8 operation = instruction->mode == AM_R_HLI ? 0 : 1 << 3;
+            EMIT(0x66, 0xFF, 0x43 | operation,
+                 OFFSET(registers.hl));  // inc/dec word [hl]
+            return true;
+        }
+
+        // LD (rr), r and LD (C), A
+        case AM_MR_R:
+            if (source < 0 || !addressedByRegister) {
+                return false;
+            }
+
+            emitAddress(ctx, instruction->register1);
+            emitLoad8(ctx, RDX, source);
+            emitWrite(ctx);
+            chargeAccess(ctx, 1);
+            return true;
+
+        // LD (HL+), A and LD (HL-), A
+        case AM_HLI_R:
+        case AM_HLD_R: {
+            emitAddress(ctx, RT_HL);
+            emitLoad8(ctx, RDX, source);
+
+            u8 operation = instruction->mode == AM_HLI_R ? 0 : 1 << 3;
+            EMIT(0x66, 0xFF, 0x43 | operation,
+                 OFFSET(registers.hl));  // inc/dec word [hl]
+
+            emitWrite(ctx);
+            chargeAccess(ctx, 1);
+            return true;
+        }
+
+        // LD (HL), d8
+        case AM_MR_D8:
+            chargeAccess(ctx, 1);
+            emitAddress(ctx, RT_HL);
+            EMIT(0xB2, readBus(gb, address + 1));  // mov dl, d8
+            emitWrite(ctx);
+            chargeAccess(ctx, 1);
+            return true;
+
+        // LD A, (a16) and LDH A, (a8)
+        case AM_R_A16:
+        case AM_R_A8: {
+            bool a8 = instruction->mode == AM_R_A8;
+            chargeAccess(ctx, a8 ? 1 : 2);
+            emitReadConstant(ctx, a8 ? 0xFF00 | readBus(gb, address + 1)
+                                     : readOperand16(gb, address));
+            chargeAccess(ctx, 1);
+            emitStore8(ctx, RAX, destination);
+            return true;
+        }
+
+        // LD (a16), A and LDH (a8), A
+        case AM_A16_R:
+        case AM_A8_R: {
+            if (source < 0) {
+                return false;
+            }
+
+            bool a8 = instruction->mode == AM_A8_R;
+            chargeAccess(ctx, a8 ? 1 : 2);
+            EMIT(0xB8);  // mov eax, imm32
+            emit32(ctx, a8 ? 0xFF00 | readBus(gb, address + 1)
+                           : readOperand16(gb, address));
+            emitLoad8(ctx, RDX, source);
+            emitWrite(ctx);
+            chargeAccess(ctx, 1);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Emits a PUSH or POP of BC, DE or HL. AF goes through its handler, as its
+ * flags must be brought up to date.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitStack(jitBlock_t *ctx, const instruction_t *instruction) {
+    int pair = getRegister16Offset(instruction->register1);
+    if (pair < 0 || instruction->register1 == RT_SP) {
+        return false;
+    }
+
+    // The high byte is pushed first, and popped last
+    if (instruction->type == IN_PUSH) {
+        chargeAccess(ctx, 1);  // 1 cycle for decrementing SP first
+        for (int i = 1; i >= 0; i--) {
+            EMIT(0x66, 0xFF, 0x4B, OFFSET(registers.sp));  // dec word [sp]
+            emitLoad16(ctx, RAX, OFFSET(registers.sp));
+            emitLoad8(ctx, RDX, pair + i);
+            emitWrite(ctx);
+            chargeAccess(ctx, 1);
+        }
+        return true;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        emitLoad16(ctx, RAX, OFFSET(registers.sp));
+        emitRead(ctx);
+        emitStore8(ctx, RAX, pair + i);
+        EMIT(0x66, 0xFF, 0x43, OFFSET(registers.sp));  // inc word [sp]
+        chargeAccess(ctx, 1);
+    }
+    return true;
+}
+
+/**
+ * Emits native code for an instruction. Instructions that aren't supported
+ * are left to the generated opcode handlers.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @param address The address of the instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitInstruction(jitBlock_t *ctx, const instruction_t *instruction,
+                            u16 address) {
+    switch (instruction->type) {
+        case IN_NOP:
+            return true;
+
+        case IN_LD:
+        case IN_LDH:
+            return emitLoad(ctx, instruction, address);
+
+        case IN_INC:
+        case IN_DEC:
+            return emitIncDec(ctx, instruction);
+
+        case IN_ADD:
+        case IN_ADC:
+        case IN_SUB:
+        case IN_SBC:
+        case IN_AND:
+        case IN_XOR:
+        case IN_OR:
+        case IN_CP:
+            return emitALU(ctx, instruction, address);
+
+        case IN_PUSH:
+        case IN_POP:
+            return emitStack(ctx, instruction);
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Emits a jump taken when the condition of a branch isn't met.
+ *
+ * @param ctx The block being compiled.
+ * @param cond The condition.
+ * @return The position of the jump's displacement.
+ */
+static u32 emitConditionCheck(jitBlock_t *ctx, conditionType_t cond) {
+    bool zero = cond == CT_Z || cond == CT_NZ;
+    bool set = cond == CT_Z || cond == CT_C;
+
+    // Every lazily evaluated operation sets the zero flag from its result
+    if (zero && ctx->flagsOp > FLAGS_NONE) {
+        EMIT(0x80, 0x7B, OFFSET(lazyFlags.result), 0);  // cmp [result], 0
+        EMIT(0x0F, set ? 0x85 : 0x84);                  // jne/je not taken
+    } else {
+        emitMaterializeFlags(ctx);
+        EMIT(0xF6, 0x43, OFFSET(registers.f),
+             zero ? 0x80 : 0x10);       // test byte [f], mask
+        EMIT(0x0F, set ? 0x84 : 0x85);  // jz/jnz not taken
+    }
+
+    u32 position = ctx->jit->used;
+    emit32(ctx, 0);
+
+    return position;
+}
+
+/**
+ * Emits a JR or JP to a constant address, which ends its block.
+ *
+ * @param ctx The block being compiled.
+ * @param instruction The instruction.
+ * @param opcode The opcode.
+ * @param address The address of the instruction.
+ * @return Whether the instruction could be compiled.
+ */
+static bool emitBranch(jitBlock_t *ctx, const instruction_t *instruction,
+                       u8 opcode, u16 address) {
+    gb_t *gb = ctx->gb;
+    bool relative = instruction->type == IN_JR;
+    if (!relative && (instruction->type != IN_JP ||
+                      instruction->mode != AM_D16)) {
+        return false;
+    }
+
+    u16 next = address + (relative ? 2 : 3);
+    u16 target = relative ? next + (int8_t)readBus(gb, address + 1)
+                          : readOperand16(gb, address);
+    chargeFetch(ctx, opcode);
+    chargeAccess(ctx, relative ? 1 : 2);
+
+    u32 notTaken = 0;
+    if (instruction->cond != CT_NONE) {
+        notTaken = emitConditionCheck(ctx, instruction->cond);
+    }
+
+    // Taken: 1 cycle for the jump, the cycle table counts it as not taken
+    u32 pending = ctx->pending;
+    chargeAccess(ctx, 1);
+    if (instruction->cond != CT_NONE) {
+        chargeExtra(ctx, 1);
+    }
+    emitStorePC(ctx, target);
+    emitFlush(ctx);
+
+    // Jumping back may close a polling loop, which can be skipped
+    if (target < next && next <= 0x8000) {
+        EMIT(0x4C, 0x89, 0xF7);  // mov rdi, r14
+        EMIT(0xBE);              // mov esi, imm32
+        emit32(ctx, next);
+        emitCall(ctx, (const void *)skipIdleLoop);
+    }
+
+    if (notTaken) {
+        emitExit(ctx, 0);
+
+        u32 displacement = ctx->jit->used - (notTaken + 4);
+        memcpy(&ctx->jit->code[notTaken], &displacement, sizeof(displacement));
+        ctx->pending = pending;
+        emitStorePC(ctx, next);
+        emitFlush(ctx);
+    }
+
+    return true;
+}
+
+/**
+ * Emits a call to the opcode handler of an instruction, as the block core
+ * runs it.
+ *
+ * @param ctx The block being compiled.
+ * @param opcode The opcode.
+ * @param address The address of the instruction.
+ */
+static void emitHandler(jitBlock_t *ctx, u8 opcode, u16 address) {
+    chargeFetch(ctx, opcode);
+    emitFlush(ctx);
+    emitStorePC(ctx, address + 1);
+    emitStoreImm8(ctx, OFFSET(currentOpcode), opcode);
+    EMIT(0x48, 0x89, 0xDF);  // mov rdi, rbx
+    emitCall(ctx, (const void *)getHandlerForOpcode(opcode));
+
+    ctx->called = true;
+    ctx->flagsOp = FLAGS_UNKNOWN;
+}
+
+/**
+ * Changes the protection of the executable memory, which is never writable
+ * and executable at once.
+ *
+ * @param jit The JIT context.
+ * @param start The position of the first byte that changes.
+ * @param size The number of bytes that change.
+ * @param writable Whether the bytes become writable rather than executable.
+ */
+static void protectCode(jitContext_t *jit, u32 start, u32 size,
+                        bool writable) {
+#if JIT_SUPPORTED
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)(jit->code + start) & ~(pageSize - 1);
+    uintptr_t end = (uintptr_t)(jit->code + start + size);
+
+    mprotect((void *)first, end - first,
+             writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+}
+
+/**
+ * Allocates the memory for compiled blocks.
+ *
+ * @param ctx The JIT context.
+ * @return Whether the memory is available.
+ */
+static bool allocateCode(jitContext_t *ctx) {
+#if JIT_SUPPORTED
+    if (!ctx->code && !ctx->failed) {
+        void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            printf("%sERR:%s Failed to allocate JIT memory, using the "
+                   "interpreter.\n",
+                   CRED, CRST);
+            ctx->failed = true;
+        } else {
+            ctx->code = code;
+        }
+    }
+#endif
+
+    return ctx->code != NULL;
+}
+
+// ===== CPU JIT functions =====================================================
+
+/**
+ * Checks whether blocks can be compiled on this platform.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the JIT is available.
+ */
+bool isJITAvailable(gb_t *gb) {
+    return JIT_SUPPORTED && allocateCode(&gb->jit);
+}
+
+/**
+ * Discards all compiled blocks.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetJIT(gb_t *gb) { gb->jit.used = 0; }
+
+/**
+ * Frees the executable memory, once the instance is no longer running.
+ *
+ * @param gb The Game Boy instance.
+ */
+void freeJIT(gb_t *gb) {
+#if JIT_SUPPORTED
+    if (gb->jit.code) {
+        munmap(gb->jit.code, JIT_CODE_SIZE);
+    }
+#endif
+
+    gb->jit.code = NULL;
+    gb->jit.used = 0;
+}
+
+/**
+ * Compiles a block of instructions into native code. Loads, stores, ALU
+ * operations and the final JR or JP are emitted inline, the rest call their
+ * opcode handler. Cycles are added to the ticks before they can be observed,
+ * and the block leaves after any instruction where the block core would, so
+ * both stop at the same tick. Blocks that may not finish within the
+ * runCPUFor() slice return false before running, for the block core to run.
+ *
+ * @param gb The Game Boy instance.
+ * @param pc The address of the first instruction.
+ * @param count The number of instructions in the block.
+ * @param fetchCycles The CPU cycles emulated when fetching each opcode.
+ * @return The compiled block, or NULL if the executable memory is full.
+ */
+JIT_PROC compileJITBlock(gb_t *gb, u16 pc, u8 count, const u8 *fetchCycles) {
+    jitContext_t *jit = &gb->jit;
+    u32 size = JIT_BLOCK_OVERHEAD + count * JIT_INSTRUCTION_SIZE;
+    if (!isJITAvailable(gb) || jit->used + size > JIT_CODE_SIZE) {
+        return NULL;
+    }
+
+    jitBlock_t block = {
+        .jit = jit,
+        .gb = gb,
+        .cycleMode = gb->cpu.cycleMode,
+        .fetchCycles = fetchCycles,
+        .flagsOp = FLAGS_UNKNOWN,
+    };
+    jitBlock_t *ctx = &block;
+    u32 start = jit->used;
+    protectCode(jit, start, size, true);
+
+    // Prologue: RBX holds the CPU context, R12 the invalidation count and
+    // R13D its value on entry, R14 the instance and R15 its ticks. Five
+    // pushes keep the stack 16-byte aligned.
+    EMIT(0x53);                          // push rbx
+    EMIT(0x41, 0x54);                    // push r12
+    EMIT(0x41, 0x55);                    // push r13
+    EMIT(0x41, 0x56);                    // push r14
+    EMIT(0x41, 0x57);                    // push r15
+    EMIT(0x48, 0x89, 0xFB);              // mov rbx, rdi
+    EMIT(0x49, 0x89, 0xF4);              // mov r12, rsi
+    EMIT(0x44, 0x8B, 0x2E);              // mov r13d, [rsi]
+    EMIT(0x4C, 0x8B, 0x73, OFFSET(gb));  // mov r14, [gb]
+    EMIT(0x4D, 0x8D, 0xBE);              // lea r15, [r14 + ticks]
+    emit32(ctx, GB_OFFSET(emu.ticks));
+
+    // Decline the block if the slice may end before its last instruction
+    u32 decline = emitBudgetCheck(ctx, false);
+
+    u16 address = pc;
+    for (u8 i = 0; i < count; i++) {
+        u8 opcode = readBus(gb, address);
+        const instruction_t *instruction = getInstructionFromOpcode(opcode);
+        u8 length = getInstructionLength(instruction);
+        bool last = i + 1 == count;
+        u32 charged = ctx->charged;
+        ctx->called = false;
+
+        if (last && emitBranch(ctx, instruction, opcode, address)) {
+            break;
+        }
+
+        // Instructions check whether they can be compiled before emitting
+        chargeFetch(ctx, opcode);
+        bool compiled = emitInstruction(ctx, instruction, address);
+        if (!compiled) {
+            // Fall back to the handler, as the block core would run it
+            ctx->pending -= ctx->fetchCycles[opcode];
+            ctx->charged = charged;
+            emitHandler(ctx, opcode, address);
+        }
+        address += length;
+
+        // Handlers set the program counter themselves
+        if (last) {
+            emitFlush(ctx);
+            if (compiled) {
+                emitStorePC(ctx, address);
+            }
+        } else if (ctx->called) {
+            closeBudgetCheck(ctx);
+            emitExitChecks(ctx, address);
+        } else {
+            ctx->budgetCycles += ctx->charged - charged;
+        }
+    }
+    closeBudgetCheck(ctx);
+
+    // Epilogue, returning whether the block ran
+    for (u16 i = 0; i < ctx->exitCount; i++) {
+        u32 displacement = jit->used - (ctx->exits[i] + 4);
+        memcpy(&jit->code[ctx->exits[i]], &displacement, sizeof(displacement));
+    }
+    EMIT(0xB8);  // mov eax, 1
+    emit32(ctx, 1);
+    u32 leave = jit->used;
+    EMIT(0x41, 0x5F);  // pop r15
+    EMIT(0x41, 0x5E);  // pop r14
+    EMIT(0x41, 0x5D);  // pop r13
+    EMIT(0x41, 0x5C);  // pop r12
+    EMIT(0x5B);        // pop rbx
+    EMIT(0xC3);        // ret
+
+    u32 displacement = jit->used - (decline + 4);
+    memcpy(&jit->code[decline], &displacement, sizeof(displacement));
+    EMIT(0x31, 0xC0);  // xor eax, eax
+    EMIT(0xE9);        // jmp leave
+    emit32(ctx, leave - (jit->used + 4));
+
+    protectCode(jit, start, size, false);
+    return (JIT_PROC)(jit->code + start);
+}
@@ -1,9 +1,14 @@
 // * Processes CPU instructions.
 
-#include <cpu.h>
-#include <emu.h>
-#include <bus.h>
+#include <gb.h>
+#include <cpuFetch.h>
 #include <stack.h>
+#include <interrupts.h>
+
+// ===== Globals ===============================================================
+
+// Generated handlers for CB-prefixed operations, defined at the end of file
+static IN_PROC cbHandlers[0x100];
 
 // ===== Helper functions ======================================================
 
@@ -11,13 +16,15 @@
  * Checks the condition of the current instruction.
  *
  * @param ctx The CPU context.
+ * @param cond The condition of the instruction.
  * @return Whether the condition is met.
  */
-static bool checkCondition(cpuContext_t *ctx) {
+static ALWAYS_INLINE bool checkCondition(cpuContext_t *ctx,
+                                         conditionType_t cond) {
     bool z = CPUFLAG_ZEROBIT(ctx);
     bool c = CPUFLAG_CARRYBIT(ctx);
 
-    switch (ctx->currentInstruction->cond) {
+    switch (cond) {
         case CT_NONE:
             return true;
         case CT_C:
@@ -42,7 +49,15 @@ static bool checkCondition(cpuContext_t *ctx) {
  * @param h The BCD H flag.
  * @param c The carry flag.
  */
-void setCPUFlags(cpuContext_t *ctx, char z, char n, char h, char c) {
+static ALWAYS_INLINE void setCPUFlags(cpuContext_t *ctx, char z, char n,
+                                      char h, char c) {
+    // Flags that aren't modified must be up to date, the rest are replaced
+    if (z == -1 || n == -1 || h == -1 || c == -1) {
+        materializeCPUFlags(ctx);
+    } else {
+        ctx->lazyFlags.op = FLAGS_NONE;
+    }
+
     // If we don't want to modify flags, we pass in flag = -1
     if (z != -1) {
         ctx->registers.f = SETBIT(ctx->registers.f, 7, z);
@@ -58,26 +73,65 @@ void setCPUFlags(cpuContext_t *ctx, char z, char n, char h, char c) {
     }
 }
 
+/**
+ * Records an ALU operation so that its flags are only computed once they are
+ * observed.
+ *
+ * @param ctx The CPU context.
+ * @param op The operation.
+ * @param left The left operand.
+ * @param right The right operand.
+ * @param carry The carry into the operation.
+ * @param result The result of the operation.
+ */
+static ALWAYS_INLINE void setLazyFlags(cpuContext_t *ctx, lazyFlagsOp_t op,
+                                       u8 left, u8 right, u8 carry,
+                                       u8 result) {
+    ctx->lazyFlags.op = op;
+    ctx->lazyFlags.left = left;
+    ctx->lazyFlags.right = right;
+    ctx->lazyFlags.carry = carry;
+    ctx->lazyFlags.result = result;
+}
+
 /**
  * Pushes the program counter to the stack and jumps to an address.
  * Generic call for other jumping instructions.
  *
  * @param ctx The CPU context.
+ * @param cond The condition to check before jumping.
  * @param address The address to jump to.
  * @param pushPC Whether to push the program counter to the stack.
  */
-static void goToAddress(cpuContext_t *ctx, u16 address, bool pushPC) {
+static ALWAYS_INLINE void goToAddress(cpuContext_t *ctx, conditionType_t cond,
+                                      u16 address, bool pushPC) {
     // If the condition matches...
-    if (checkCondition(ctx)) {
+    if (checkCondition(ctx, cond)) {
+        u16 pc = ctx->registers.pc;
+
         // If pushPC is set, we want to push the PC
         if (pushPC) {
-            pushStack16(ctx->registers.pc);
-            emulateCPUCycles(2);  // 2 cycles for pushing to stack
+            pushStack16(ctx->gb, pc);
+            emulateAccessCycles(ctx, 2);  // 2 cycles for pushing to stack
         }
 
         // Set program counter to the location of our address
         ctx->registers.pc = address;
-        emulateCPUCycles(1);  // Jumps are 1 cycle long
+
+        // Jumps are 1 cycle long, except JP HL which has its address ready
+        if (ctx->currentInstruction->mode != AM_R) {
+            emulateAccessCycles(ctx, 1);
+        }
+
+        // The cycle table counts conditional branches as not taken
+        if (cond != CT_NONE) {
+            emulateExtraCycles(ctx, pushPC ? 3 : 1);
+        }
+
+        // Jumping back may close a polling loop, which can be skipped
+        if (!pushPC && address < pc) {
+            skipIdleLoop(ctx->gb, pc);
+        }
     }
 }
 
@@ -87,20 +141,21 @@ static void goToAddress(cpuContext_t *ctx, u16 address, bool pushPC) {
  * @param registerType The register to check.
  * @return Whether the register is 16-bit.
  */
-static bool is16Bit(registerType_t registerType) {
+static ALWAYS_INLINE bool is16Bit(registerType_t registerType) {
     return registerType >= RT_AF;
 }
 
 // Lookup table for CB instructions register typings
-registerType_t registerTypeLookup[] = {RT_B, RT_C,  RT_D, RT_E,
-                                       RT_H, RT_HL, RT_A};
+static const registerType_t registerTypeLookup[] = {
+    RT_B, RT_C, RT_D, RT_E, RT_H, RT_L, RT_HL, RT_A};
+
 /**
  * Decodes a register value to get the register type.
  * Used only in CB instructions.
  *
  * @param value The register value.
  */
-registerType_t decodeRegisterValue(u8 value) {
+static ALWAYS_INLINE registerType_t decodeRegisterValue(u8 value) {
     if (value > 0b111) {
         return RT_NONE;
     }
@@ -114,7 +169,7 @@ registerType_t decodeRegisterValue(u8 value) {
  *
  * @param ctx The CPU context.
  */
-static void procNone(cpuContext_t *ctx) {
+static void procNONE(cpuContext_t *ctx) {
     printf("%sERR:%s No processor for instruction %s0x%02X%s\n", CRED, CRST,
            CMAG, ctx->currentOpcode, CRST);
     exit(EXIT_FAILURE);
@@ -125,7 +180,7 @@ static void procNone(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procNOP(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procNOP(cpuContext_t *ctx) {
     // NOP doesn't do anything because it's a NOP
     return;
 }
@@ -136,37 +191,43 @@ static void procNOP(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procLD(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procLD(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
     if (ctx->destinationIsMemory) {
         // If a 16-bit register...
-        if (is16Bit(ctx->currentInstruction->register2)) {
-            writeBus16(ctx->memoryDestination, ctx->fetchedData);
-            emulateCPUCycles(1);  // 1 extra cycle for writing to bus
+        if (is16Bit(in->register2)) {
+            writeBus16(ctx->gb, ctx->memoryDestination, ctx->fetchedData);
+            emulateAccessCycles(ctx, 1);  // 1 extra cycle for writing to bus
         } else {
-            writeBus(ctx->memoryDestination, ctx->fetchedData);
+            writeBus(ctx->gb, ctx->memoryDestination, ctx->fetchedData);
         }
-        emulateCPUCycles(1);  // 1 cycle for writing to bus
+        emulateAccessCycles(ctx, 1);  // 1 cycle for writing to bus
         return;
     }
 
-    if (ctx->currentInstruction->mode == AM_HL_SPR) {
-        u8 hflag = (readCPURegister(ctx->currentInstruction->register2) & 0xF) +
+    if (in->mode == AM_HL_SPR) {
+        u8 hflag = (readRegister(ctx, in->register2) & 0xF) +
                        (ctx->fetchedData & 0xF) >=
                    0x10;
-        u8 cflag =
-            (readCPURegister(ctx->currentInstruction->register2) & 0xFF) +
-                (ctx->fetchedData & 0xFF) >=
-            0x100;
+        u8 cflag = (readRegister(ctx, in->register2) & 0xFF) +
+                       (ctx->fetchedData & 0xFF) >=
+                   0x100;
 
         setCPUFlags(ctx, 0, 0, hflag, cflag);
-        setCPURegister(ctx->currentInstruction->register1,
-                       readCPURegister(ctx->currentInstruction->register2) +
-                           (char)ctx->fetchedData);
+        setRegister(ctx, in->register1,
+                    readRegister(ctx, in->register2) + (char)ctx->fetchedData);
+        emulateAccessCycles(ctx, 1);  // 1 cycle for the 16-bit addition
 
         return;
     }
 
-    setCPURegister(ctx->currentInstruction->register1, ctx->fetchedData);
+    // LD SP,HL takes 1 cycle to move 16 bits
+    if (in->mode == AM_R_R && is16Bit(in->register1)) {
+        emulateAccessCycles(ctx, 1);
+    }
+
+    setRegister(ctx, in->register1, ctx->fetchedData);
 }
 
 /**
@@ -175,30 +236,33 @@ static void procLD(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procINC(cpuContext_t *ctx) {
-    u16 value = readCPURegister(ctx->currentInstruction->register1) + 1;
+static ALWAYS_INLINE void procINC(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
 
-    if (is16Bit(ctx->currentInstruction->register1)) {
-        emulateCPUCycles(1);  // Need to add 1 extra cycle
-    }
+    u16 value = readRegister(ctx, in->register1) + 1;
 
-    // Special case for the HL register
-    if (ctx->currentInstruction->register1 == RT_HL &&
-        ctx->currentInstruction->mode == AM_MR) {
-        value = readBus(readCPURegister(RT_HL)) + 1;
-        value &= 0xFF;
-        writeBus(readCPURegister(RT_HL), value);
+    // Special case for the HL register, read by fetchData() a cycle before
+    // the write
+    if (in->register1 == RT_HL && in->mode == AM_MR) {
+        value = (ctx->fetchedData + 1) & 0xFF;
+        writeBus(ctx->gb, ctx->memoryDestination, value);
+        emulateAccessCycles(ctx, 1);  // 1 cycle for writing to bus
     } else {
-        setCPURegister(ctx->currentInstruction->register1, value);
-        value = readCPURegister(ctx->currentInstruction->register1);  // Re-read
+        if (is16Bit(in->register1)) {
+            emulateAccessCycles(ctx, 1);  // Need to add 1 extra cycle
+        }
+        setRegister(ctx, in->register1, value);
+        value = readRegister(ctx, in->register1);  // Re-read
     }
 
-    // If the opcode's bottom 2 are set, skip
-    if ((ctx->currentOpcode & 0x03) == 0x03) {
+    // 16-bit register increments (opcode's bottom 2 set) don't set flags
+    if (in->mode == AM_R && is16Bit(in->register1)) {
         return;
     }
 
-    setCPUFlags(ctx, value == 0, 0, (value & 0xF) == 0, -1);
+    // The carry flag is kept, so it must be up to date
+    materializeCPUFlags(ctx);
+    setLazyFlags(ctx, FLAGS_INC, 0, 0, 0, value);
 }
 
 /**
@@ -207,29 +271,33 @@ static void procINC(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procDEC(cpuContext_t *ctx) {
-    u16 value = readCPURegister(ctx->currentInstruction->register1) - 1;
+static ALWAYS_INLINE void procDEC(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
 
-    if (is16Bit(ctx->currentInstruction->register1)) {
-        emulateCPUCycles(1);  // Need to add 1 extra cycle
-    }
+    u16 value = readRegister(ctx, in->register1) - 1;
 
-    // Special case for the HL register
-    if (ctx->currentInstruction->register1 == RT_HL &&
-        ctx->currentInstruction->mode == AM_MR) {
-        value = readBus(readCPURegister(RT_HL)) - 1;
-        writeBus(readCPURegister(RT_HL), value);
+    // Special case for the HL register, read by fetchData() a cycle before
+    // the write
+    if (in->register1 == RT_HL && in->mode == AM_MR) {
+        value = (ctx->fetchedData - 1) & 0xFF;
+        writeBus(ctx->gb, ctx->memoryDestination, value);
+        emulateAccessCycles(ctx, 1);  // 1 cycle for writing to bus
     } else {
-        setCPURegister(ctx->currentInstruction->register1, value);
-        value = readCPURegister(ctx->currentInstruction->register1);  // Re-read
+        if (is16Bit(in->register1)) {
+            emulateAccessCycles(ctx, 1);  // Need to add 1 extra cycle
+        }
+        setRegister(ctx, in->register1, value);
+        value = readRegister(ctx, in->register1);  // Re-read
     }
 
-    // If the opcode's bottom 2 are set, skip
-    if ((ctx->currentOpcode & 0x0B) == 0x0B) {
+    // 16-bit register decrements (opcode's 0x0B bits set) don't set flags
+    if (in->mode == AM_R && is16Bit(in->register1)) {
         return;
     }
 
-    setCPUFlags(ctx, value == 0, 1, (value & 0x0F) == 0x0F, -1);
+    // The carry flag is kept, so it must be up to date
+    materializeCPUFlags(ctx);
+    setLazyFlags(ctx, FLAGS_DEC, 0, 0, 0, value);
 }
 
 /**
@@ -238,7 +306,7 @@ static void procDEC(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procRLCA(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procRLCA(cpuContext_t *ctx) {
     u8 u = ctx->registers.a;
     bool c = (u >> 7) & 1;
     u = (u << 1) | c;
@@ -253,46 +321,55 @@ static void procRLCA(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procADD(cpuContext_t *ctx) {
-    u32 value =
-        readCPURegister(ctx->currentInstruction->register1) + ctx->fetchedData;
+static ALWAYS_INLINE void procADD(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    u32 value = readRegister(ctx, in->register1) + ctx->fetchedData;
+
+    // 8-bit additions compute their flags lazily
+    if (!is16Bit(in->register1)) {
+        u8 left = readRegister(ctx, in->register1);
+        setRegister(ctx, in->register1, value & 0xFF);
+        setLazyFlags(ctx, FLAGS_ADD, left, ctx->fetchedData, 0, value);
+        return;
+    }
 
     // Set up basic flags
     int z = (value & 0xFF) == 0;
-    int h = (readCPURegister(ctx->currentInstruction->register1) & 0xF) +
+    int h = (readRegister(ctx, in->register1) & 0xF) +
                 (ctx->fetchedData & 0xF) >=
             0x10;
-    int c = (int)(readCPURegister(ctx->currentInstruction->register1) & 0xFF) +
+    int c = (int)(readRegister(ctx, in->register1) & 0xFF) +
                 (int)(ctx->fetchedData & 0xFF) >=
             0x100;
 
     // If 16 bit...
-    if (is16Bit(ctx->currentInstruction->register1)) {
-        emulateCPUCycles(1);  // Need to add 1 extra cycle
+    if (is16Bit(in->register1)) {
+        emulateAccessCycles(ctx, 1);  // Need to add 1 extra cycle
         z = -1;
-        h = (readCPURegister(ctx->currentInstruction->register1) & 0xFFF) +
+        h = (readRegister(ctx, in->register1) & 0xFFF) +
                 (ctx->fetchedData & 0xFFF) >=
             0x1000;
-        u32 n = ((u32)readCPURegister(ctx->currentInstruction->register1)) +
+        u32 n = ((u32)readRegister(ctx, in->register1)) +
                 ((u32)ctx->fetchedData);
         c = n >= 0x10000;
     }
 
     // If SP...
-    if (ctx->currentInstruction->register1 == RT_SP) {
+    if (in->register1 == RT_SP) {
         // For the stack pointer, fetchedData may be negative
-        value = readCPURegister(ctx->currentInstruction->register1) +
-                (char)ctx->fetchedData;
+        value = readRegister(ctx, in->register1) + (char)ctx->fetchedData;
+        emulateAccessCycles(ctx, 1);  // 1 more cycle for the signed offset
         z = 0;
-        h = (readCPURegister(ctx->currentInstruction->register1) & 0xF) +
+        h = (readRegister(ctx, in->register1) & 0xF) +
                 (ctx->fetchedData & 0xF) >=
             0x10;
-        c = (int)(readCPURegister(ctx->currentInstruction->register1) & 0xFF) +
+        c = (int)(readRegister(ctx, in->register1) & 0xFF) +
                 (int)(ctx->fetchedData & 0xFF) >=
             0x100;
     }
 
-    setCPURegister(ctx->currentInstruction->register1, value & 0xFFFF);
+    setRegister(ctx, in->register1, value & 0xFFFF);
     setCPUFlags(ctx, z, 0, h, c);
 }
 
@@ -302,7 +379,7 @@ static void procADD(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procRRCA(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procRRCA(cpuContext_t *ctx) {
     u8 b = ctx->registers.a & 1;
     ctx->registers.a >>= 1;
     ctx->registers.a |= b << 7;
@@ -318,7 +395,7 @@ static void procSTOP(cpuContext_t *ctx) { NO_IMPLEMENTATION("procSTOP()"); }
  *
  * @param ctx The CPU context.
  */
-static void procRLA(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procRLA(cpuContext_t *ctx) {
     u8 u = ctx->registers.a;
     u8 cf = CPUFLAG_CARRYBIT(ctx);
     u8 c = (u >> 7) & 1;
@@ -333,10 +410,12 @@ static void procRLA(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procJR(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procJR(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
     int8_t rel = (char)(ctx->fetchedData & 0xFF);
     u16 addr = ctx->registers.pc + rel;
-    goToAddress(ctx, addr, false);
+    goToAddress(ctx, in->cond, addr, false);
 }
 
 /**
@@ -345,7 +424,7 @@ static void procJR(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procRRA(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procRRA(cpuContext_t *ctx) {
     u8 carry = CPUFLAG_CARRYBIT(ctx);
     u8 newCarry = ctx->registers.a & 1;
 
@@ -361,7 +440,7 @@ static void procRRA(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procDAA(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procDAA(cpuContext_t *ctx) {
     u8 u = 0;
     int fc = 0;
 
@@ -387,7 +466,7 @@ static void procDAA(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procCPL(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procCPL(cpuContext_t *ctx) {
     ctx->registers.a = ~ctx->registers.a;
     setCPUFlags(ctx, -1, 1, 1, -1);
 }
@@ -406,7 +485,7 @@ static void procSCF(cpuContext_t *ctx) { setCPUFlags(ctx, -1, 0, 0, 1); }
  *
  * @param ctx The CPU context.
  */
-static void procCCF(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procCCF(cpuContext_t *ctx) {
     setCPUFlags(ctx, -1, 0, 0, CPUFLAG_CARRYBIT(ctx) ^ 1);
 }
 
@@ -424,15 +503,14 @@ static void procHALT(cpuContext_t *ctx) { ctx->halted = true; }
  *
  * @param ctx The CPU context.
  */
-static void procADC(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procADC(cpuContext_t *ctx) {
     u16 u = ctx->fetchedData;
     u16 a = ctx->registers.a;
     u16 c = CPUFLAG_CARRYBIT(ctx);
 
     ctx->registers.a = (a + u + c) & 0xFF;
 
-    setCPUFlags(ctx, ctx->registers.a == 0, 0, (a & 0xF) + (u & 0xF) + c > 0xF,
-                a + u + c > 0xFF);
+    setLazyFlags(ctx, FLAGS_ADD, a, u, c, ctx->registers.a);
 }
 
 /**
@@ -441,35 +519,25 @@ static void procADC(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procSUB(cpuContext_t *ctx) {
-    u16 value =
-        readCPURegister(ctx->currentInstruction->register1) - ctx->fetchedData;
+static ALWAYS_INLINE void procSUB(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
 
-    int z = value == 0;
-    int h = ((int)readCPURegister(ctx->currentInstruction->register1) & 0xF) -
-                ((int)ctx->fetchedData & 0xF) <
-            0;
-    int c = ((int)readCPURegister(ctx->currentInstruction->register1)) -
-                ((int)ctx->fetchedData) <
-            0;
+    u8 left = readRegister(ctx, in->register1);
+    u8 value = left - ctx->fetchedData;
 
-    setCPURegister(ctx->currentInstruction->register1, value);
-    setCPUFlags(ctx, z, 1, h, c);
+    setRegister(ctx, in->register1, value);
+    setLazyFlags(ctx, FLAGS_SUB, left, ctx->fetchedData, 0, value);
 }
 
-static void procSBC(cpuContext_t *ctx) {
-    u8 value = ctx->fetchedData + CPUFLAG_CARRYBIT(ctx);
+static ALWAYS_INLINE void procSBC(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    u8 carry = CPUFLAG_CARRYBIT(ctx);
+    u8 left = readRegister(ctx, in->register1);
+    u8 value = left - ctx->fetchedData - carry;
 
-    int z = readCPURegister(ctx->currentInstruction->register1) - value == 0;
-    int h = ((int)readCPURegister(ctx->currentInstruction->register1) & 0xF) -
-                ((int)ctx->fetchedData & 0xF) - ((int)CPUFLAG_CARRYBIT(ctx)) <
-            0;
-    int c = ((int)readCPURegister(ctx->currentInstruction->register1)) -
-                ((int)ctx->fetchedData) - ((int)CPUFLAG_CARRYBIT(ctx)) <
-            0;
-    setCPURegister(ctx->currentInstruction->register1,
-                   readCPURegister(ctx->currentInstruction->register1) - value);
-    setCPUFlags(ctx, z, 1, h, c);
+    setRegister(ctx, in->register1, value);
+    setLazyFlags(ctx, FLAGS_SUB, left, ctx->fetchedData, carry, value);
 }
 
 /**
@@ -478,9 +546,9 @@ static void procSBC(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procAND(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procAND(cpuContext_t *ctx) {
     ctx->registers.a &= ctx->fetchedData;
-    setCPUFlags(ctx, ctx->registers.a == 0, 0, 1, 0);
+    setLazyFlags(ctx, FLAGS_AND, 0, 0, 0, ctx->registers.a);
 }
 
 /**
@@ -489,9 +557,9 @@ static void procAND(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procXOR(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procXOR(cpuContext_t *ctx) {
     ctx->registers.a ^= ctx->fetchedData & 0xFF;
-    setCPUFlags(ctx, ctx->registers.a == 0, 0, 0, 0);
+    setLazyFlags(ctx, FLAGS_OR, 0, 0, 0, ctx->registers.a);
 }
 
 /**
@@ -500,9 +568,9 @@ static void procXOR(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procOR(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procOR(cpuContext_t *ctx) {
     ctx->registers.a |= ctx->fetchedData & 0xFF;
-    setCPUFlags(ctx, ctx->registers.a == 0, 0, 0, 0);
+    setLazyFlags(ctx, FLAGS_OR, 0, 0, 0, ctx->registers.a);
 }
 
 /**
@@ -511,12 +579,9 @@ static void procOR(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procCP(cpuContext_t *ctx) {
-    int n = (int)ctx->registers.a - (int)ctx->fetchedData;
-    setCPUFlags(
-        ctx, n == 0, 1,
-        ((int)ctx->registers.a & 0x0F) - ((int)ctx->fetchedData & 0x0F) < 0,
-        n < 0);
+static ALWAYS_INLINE void procCP(cpuContext_t *ctx) {
+    setLazyFlags(ctx, FLAGS_SUB, ctx->registers.a, ctx->fetchedData, 0,
+                 ctx->registers.a - ctx->fetchedData);
 }
 
 /**
@@ -525,20 +590,22 @@ static void procCP(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procPOP(cpuContext_t *ctx) {
+static ALWAYS_INLINE void procPOP(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
     // Separated for cycle accuracy
-    u16 lo = popStack();
-    emulateCPUCycles(1);  // 1 cycle for popping from stack
-    u16 hi = popStack();
-    emulateCPUCycles(1);  // 1 cycle for popping from stack
+    u16 lo = popStack(ctx->gb);
+    emulateAccessCycles(ctx, 1);  // 1 cycle for popping from stack
+    u16 hi = popStack(ctx->gb);
+    emulateAccessCycles(ctx, 1);  // 1 cycle for popping from stack
 
     u16 data = (hi << 8) | lo;
 
     // ! This may be redundant
-    setCPURegister(ctx->currentInstruction->register1, data);
+    setRegister(ctx, in->register1, data);
 
-    if (ctx->currentInstruction->register1 == RT_AF) {
-        setCPURegister(ctx->currentInstruction->register1, data & 0xFFF0);
+    if (in->register1 == RT_AF) {
+        setRegister(ctx, in->register1, data & 0xFFF0);
     }
 }
 
@@ -548,8 +615,10 @@ static void procPOP(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procJP(cpuContext_t *ctx) {
-    goToAddress(ctx, ctx->fetchedData, false);
+static ALWAYS_INLINE void procJP(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    goToAddress(ctx, in->cond, ctx->fetchedData, false);
 }
 
 /**
@@ -558,18 +627,18 @@ static void procJP(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procPUSH(cpuContext_t *ctx) {
-    // Separated for cycle accuracy
-    u16 hi = (readCPURegister(ctx->currentInstruction->register1) >> 8) & 0xFF;
-    emulateCPUCycles(1);  // 1 cycle for reading from register
-    pushStack(hi);
-
-    u16 lo = readCPURegister(ctx->currentInstruction->register1) & 0xFF;
-    emulateCPUCycles(1);  // 1 cycle for reading from register
-    pushStack(lo);
+static ALWAYS_INLINE void procPUSH(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
 
-    // ! Is this extra necessary?
-    emulateCPUCycles(1);  // 1 cycle for pushing to stack
+    // Separated for cycle accuracy
+    u16 hi = (readRegister(ctx, in->register1) >> 8) & 0xFF;
+    emulateAccessCycles(ctx, 1);  // 1 cycle for decrementing SP first
+    pushStack(ctx->gb, hi);
+
+    u16 lo = readRegister(ctx, in->register1) & 0xFF;
+    emulateAccessCycles(ctx, 1);  // 1 cycle for pushing to stack
+    pushStack(ctx->gb, lo);
+    emulateAccessCycles(ctx, 1);  // 1 cycle for pushing to stack
 }
 
 /**
@@ -578,42 +647,69 @@ static void procPUSH(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procRET(cpuContext_t *ctx) {
-    if (ctx->currentInstruction->cond != CT_NONE) {
+static ALWAYS_INLINE void procRET(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    if (in->cond != CT_NONE) {
         // 1 cycle for command execution
-        emulateCPUCycles(1);  // Have to hang here
+        emulateAccessCycles(ctx, 1);  // Have to hang here
     }
 
-    if (checkCondition(ctx)) {
+    if (checkCondition(ctx, in->cond)) {
         // Separated for cycle accuracy
-        u16 lo = popStack();
-        emulateCPUCycles(1);
-        u16 hi = popStack();
-        emulateCPUCycles(1);
+        u16 lo = popStack(ctx->gb);
+        emulateAccessCycles(ctx, 1);
+        u16 hi = popStack(ctx->gb);
+        emulateAccessCycles(ctx, 1);
 
         u16 addr = (hi << 8) | lo;
         ctx->registers.pc = addr;
 
-        emulateCPUCycles(1);  // 1 cycle for checking condition
+        emulateAccessCycles(ctx, 1);  // 1 cycle for checking condition
+
+        // The cycle table counts conditional returns as not taken
+        if (in->cond != CT_NONE) {
+            emulateExtraCycles(ctx, 3);
+        }
     }
 }
 
 /**
- * Processor for CB instructions.
- * Processes CB-prefixed instructions, of which there are many.
+ * Writes back the result of a CB-prefixed operation, charging the cycle for
+ * writing to memory.
  *
  * @param ctx The CPU context.
+ * @param registerType The register, or RT_HL for memory.
+ * @param value The result.
  */
-static void procCB(cpuContext_t *ctx) {
-    // td
-    u8 operation = ctx->fetchedData;
+static ALWAYS_INLINE void writeCBResult(cpuContext_t *ctx,
+                                        registerType_t registerType,
+                                        u8 value) {
+    setRegister8(ctx, registerType, value);
+    if (registerType == RT_HL) {
+        emulateAccessCycles(ctx, 1);  // 1 cycle for writing to bus
+    }
+}
+
+/**
+ * Executes a CB-prefixed operation. Shared by procCB() and the generated CB
+ * handlers, which pass a constant operation.
+ *
+ * @param ctx The CPU context.
+ * @param operation The CB operation (the byte following the prefix).
+ */
+static ALWAYS_INLINE void executeCB(cpuContext_t *ctx, u8 operation) {
     registerType_t registerType = decodeRegisterValue(operation & 0b111);
     u8 bit = (operation >> 3) & 0b111;
     u8 bitOperation = (operation >> 6) & 0b11;
-    u8 registerValue = readCPURegister8(registerType);
+    u8 registerValue = readRegister8(ctx, registerType);
 
+    // 1 cycle for reading from memory, and 1 for writing back unless BIT,
+    // which writeCBResult() charges. The cycle table only counts the cycles
+    // of register operations.
     if (registerType == RT_HL) {
-        emulateCPUCycles(2);  // 2 cycles for reading from memory
+        emulateAccessCycles(ctx, 1);
+        emulateExtraCycles(ctx, bitOperation == 1 ? 1 : 2);
     }
 
     // Handle the various operations
@@ -623,11 +719,11 @@ static void procCB(cpuContext_t *ctx) {
             return;
         case 2:  // RES
             registerValue &= ~(1 << bit);
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             return;
         case 3:  // SET
             registerValue |= (1 << bit);
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             return;
     }
 
@@ -644,7 +740,7 @@ static void procCB(cpuContext_t *ctx) {
                 setC = true;
             }
 
-            setCPURegister8(registerType, result);
+            writeCBResult(ctx, registerType, result);
             setCPUFlags(ctx, result == 0, 0, 0, setC);
             return;
         }
@@ -653,7 +749,7 @@ static void procCB(cpuContext_t *ctx) {
             registerValue >>= 1;
             registerValue |= (old << 7);
 
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             setCPUFlags(ctx, !registerValue, 0, 0, old & 1);
             return;
         }
@@ -662,7 +758,7 @@ static void procCB(cpuContext_t *ctx) {
             registerValue <<= 1;
             registerValue |= flagC;
 
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             setCPUFlags(ctx, !registerValue, 0, 0, !!(old & 0x80));
             return;
         }
@@ -672,7 +768,7 @@ static void procCB(cpuContext_t *ctx) {
 
             registerValue |= (flagC << 7);
 
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             setCPUFlags(ctx, !registerValue, 0, 0, old & 1);
             return;
         }
@@ -680,26 +776,26 @@ static void procCB(cpuContext_t *ctx) {
             u8 old = registerValue;
             registerValue <<= 1;
 
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             setCPUFlags(ctx, !registerValue, 0, 0, !!(old & 0x80));
             return;
         }
         case 5: {  // SRA - Shift right into carry, MSB unchanged
             u8 u = (int8_t)registerValue >> 1;
-            setCPURegister8(registerType, u);
+            writeCBResult(ctx, registerType, u);
             setCPUFlags(ctx, !u, 0, 0, registerValue & 1);
             return;
         }
         case 6: {  // SWAP - Swap nibbles
             registerValue =
                 ((registerValue & 0xF0) >> 4) | ((registerValue & 0xF) << 4);
-            setCPURegister8(registerType, registerValue);
+            writeCBResult(ctx, registerType, registerValue);
             setCPUFlags(ctx, registerValue == 0, 0, 0, 0);
             return;
         }
         case 7: {  // SRL - Shift right into carry, MSB = 0
             u8 u = registerValue >> 1;
-            setCPURegister8(registerType, u);
+            writeCBResult(ctx, registerType, u);
             setCPUFlags(ctx, !u, 0, 0, registerValue & 1);
             return;
         }
@@ -711,14 +807,31 @@ static void procCB(cpuContext_t *ctx) {
     exit(EXIT_FAILURE);
 }
 
+/**
+ * Processor for CB instructions.
+ * Processes CB-prefixed instructions, of which there are many.
+ *
+ * @param ctx The CPU context.
+ */
+static ALWAYS_INLINE void procCB(cpuContext_t *ctx) {
+    if (ctx->core == CORE_TABLE) {
+        cbHandlers[ctx->fetchedData & 0xFF](ctx);
+        return;
+    }
+
+    executeCB(ctx, ctx->fetchedData);
+}
+
 /**
  * Processor for CALL instructions.
  * Calls a subroutine if a condition is met.
  *
  * @param ctx The CPU context.
  */
-static void procCALL(cpuContext_t *ctx) {
-    goToAddress(ctx, ctx->fetchedData, true);
+static ALWAYS_INLINE void procCALL(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    goToAddress(ctx, in->cond, ctx->fetchedData, true);
 }
 
 /**
@@ -727,10 +840,12 @@ static void procCALL(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procRETI(cpuContext_t *ctx) {
-    // Re-enable master interrupt flag
-    ctx->masterInterruptEnabled = true;
+static ALWAYS_INLINE void procRETI(cpuContext_t *ctx) {
     procRET(ctx);
+
+    // Re-enable master interrupt flag, without EI's delay
+    ctx->masterInterruptEnabled = true;
+    updateCPUInterrupts(ctx);
 }
 
 /**
@@ -739,15 +854,17 @@ static void procRETI(cpuContext_t *ctx) {
  *
  * @param ctx The CPU context.
  */
-static void procLDH(cpuContext_t *ctx) {
-    if (ctx->currentInstruction->register1 == RT_A) {
-        setCPURegister(ctx->currentInstruction->register1,
-                       readBus(0xFF00 | ctx->fetchedData));
+static ALWAYS_INLINE void procLDH(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    if (in->register1 == RT_A) {
+        setRegister(ctx, in->register1,
+                       readBus(ctx->gb, 0xFF00 | ctx->fetchedData));
 
     } else {
-        writeBus(ctx->memoryDestination, ctx->registers.a);
+        writeBus(ctx->gb, ctx->memoryDestination, ctx->registers.a);
     }
-    emulateCPUCycles(1);  // 1 cycle for bus reading
+    emulateAccessCycles(ctx, 1);  // 1 cycle for bus reading
 }
 
 static void procJPHL(cpuContext_t *ctx) { NO_IMPLEMENTATION("procJPHL()"); }
@@ -758,7 +875,11 @@ static void procJPHL(cpuContext_t *ctx) { NO_IMPLEMENTATION("procJPHL()"); }
  *
  * @param ctx The CPU context.
  */
-static void procDI(cpuContext_t *ctx) { ctx->masterInterruptEnabled = false; }
+static void procDI(cpuContext_t *ctx) {
+    ctx->masterInterruptEnabled = false;
+    ctx->enablingIME = false;
+    updateCPUInterrupts(ctx);
+}
 
 /**
  * Processor for EI instructions.
@@ -766,7 +887,13 @@ static void procDI(cpuContext_t *ctx) { ctx->masterInterruptEnabled = false; }
  *
  * @param ctx The CPU context.
  */
-static void procEI(cpuContext_t *ctx) { ctx->masterInterruptEnabled = true; }
+static void procEI(cpuContext_t *ctx) {
+    // IME is only set after the next instruction, which stepCPU() runs
+    if (!ctx->masterInterruptEnabled) {
+        ctx->enablingIME = true;
+        limitCPURun(ctx->gb, 0);
+    }
+}
 
 /**
  * Processor for RST instructions.
@@ -774,8 +901,10 @@ static void procEI(cpuContext_t *ctx) { ctx->masterInterruptEnabled = true; }
  *
  * @param ctx The CPU context.
  */
-static void procRST(cpuContext_t *ctx) {
-    goToAddress(ctx, ctx->currentInstruction->param, true);
+static ALWAYS_INLINE void procRST(cpuContext_t *ctx) {
+    const instruction_t *in = ctx->currentInstruction;
+
+    goToAddress(ctx, in->cond, in->param, true);
 }
 
 static void procERR(cpuContext_t *ctx) { NO_IMPLEMENTATION("procERR()"); }
@@ -806,7 +935,7 @@ static void procSET(cpuContext_t *ctx) { NO_IMPLEMENTATION("procSET()"); }
 
 // Array of function pointers for processing instructions
 static IN_PROC processors[] = {
-    [IN_NONE] = procNone, [IN_NOP] = procNOP,   [IN_LD] = procLD,
+    [IN_NONE] = procNONE, [IN_NOP] = procNOP,   [IN_LD] = procLD,
     [IN_INC] = procINC,   [IN_DEC] = procDEC,   [IN_RLCA] = procRLCA,
     [IN_ADD] = procADD,   [IN_RRCA] = procRRCA, [IN_STOP] = procSTOP,
     [IN_RLA] = procRLA,   [IN_JR] = procJR,     [IN_RRA] = procRRA,
@@ -831,4 +960,191 @@ static IN_PROC processors[] = {
  */
 IN_PROC getProcessorForInstructionType(instructionType_t type) {
     return processors[type];
-}
\ No newline at end of file
+}
+
+// ===== Opcode handler tables =================================================
+
+/**
+ * Each handler below is generated from instructions.def. The instruction is a
+ * compile-time constant, so once the fetch and processor functions are inlined
+ * the addressing mode, register and condition switches fold away.
+ *
+ * Note: ctx->currentInstruction is set after fetching, right before the
+ * processor reads it, so that the compiler can forward the constant.
+ */
+#define INSTRUCTION(opcode, type, mode, register1, register2, cond, param, \
+                    cycles)                                                \
+    static void handle##opcode(cpuContext_t *ctx) {                        \
+        static const instruction_t instruction = {                         \
+            IN_##type,     AM_##mode, RT_##register1,                      \
+            RT_##register2, CT_##cond, param};                             \
+                                                                           \
+        fetchOperands(ctx, &instruction, opcode);                          \
+        ctx->currentInstruction = &instruction;                            \
+        proc##type(ctx);                                                   \
+    }
+#include <instructions.def>
+#undef INSTRUCTION
+
+// Array of generated handlers, indexed by opcode
+static IN_PROC handlers[0x100] = {
+#define INSTRUCTION(opcode, type, mode, register1, register2, cond, param, \
+                    cycles)                                                \
+    [opcode] = handle##opcode,
+#include <instructions.def>
+#undef INSTRUCTION
+};
+
+// Expands X for every CB operation in the row 0xh0 - 0xhF
+#define CB_ROW(X, h)                                                         \
+    X(0x##h##0) X(0x##h##1) X(0x##h##2) X(0x##h##3) X(0x##h##4) X(0x##h##5) \
+    X(0x##h##6) X(0x##h##7) X(0x##h##8) X(0x##h##9) X(0x##h##A) X(0x##h##B) \
+    X(0x##h##C) X(0x##h##D) X(0x##h##E) X(0x##h##F)
+
+// Expands X for all 256 CB operations
+#define CB_OPERATIONS(X)                                                      \
+    CB_ROW(X, 0)                                                              \
+    CB_ROW(X, 1)                                                              \
+    CB_ROW(X, 2)                                                              \
+    CB_ROW(X, 3)                                                              \
+    CB_ROW(X, 4)                                                              \
+    CB_ROW(X, 5)                                                              \
+    CB_ROW(X, 6)                                                              \
+    CB_ROW(X, 7)                                                              \
+    CB_ROW(X, 8)                                                              \
+    CB_ROW(X, 9)                                                              \
+    CB_ROW(X, A)                                                              \
+    CB_ROW(X, B)                                                              \
+    CB_ROW(X, C)                                                              \
+    CB_ROW(X, D)                                                              \
+    CB_ROW(X, E)                                                              \
+    CB_ROW(X, F)
+
+#define CB_HANDLER(operation)                          \
+    static void handleCB##operation(cpuContext_t *ctx) { \
+        executeCB(ctx, operation);                       \
+    }
+CB_OPERATIONS(CB_HANDLER)
+#undef CB_HANDLER
+
+// Array of generated CB handlers, indexed by the operation after the prefix
+#define CB_HANDLER(operation) [operation] = handleCB##operation,
+static IN_PROC cbHandlers[0x100] = {CB_OPERATIONS(CB_HANDLER)};
+#undef CB_HANDLER
+
+/**
+ * Gets the generated handler for an opcode. A handler fetches the operands
+ * and executes the instruction in one call, with the addressing mode and
+ * registers resolved at compile time.
+ *
+ * @param opcode The opcode.
+ * @return The handler function pointer.
+ */
+IN_PROC getHandlerForOpcode(u8 opcode) { return handlers[opcode]; }
+
+// ===== Threaded dispatch loop ================================================
+
+/**
+ * Runs the CPU until the emulator reaches ctx->runUntil, which newly scheduled
+ * events, interrupts and EI may bring forward, or until stopCPU() is called.
+ *
+ * @param gb The Game Boy instance.
+ */
+static void runCPUUntil(gb_t *gb) {
+    emuContext_t *emu = &gb->emu;
+    cpuContext_t *ctx = &gb->cpu;
+
+    while (emu->ticks < ctx->runUntil && !isCPUStopping(ctx)) {
+        // Halted CPUs, interrupts, EI's delay, the generic core and tracing
+        // go through stepCPU()
+        if (ctx->halted || ctx->pendingInterrupts || ctx->enablingIME ||
+            ctx->core == CORE_GENERIC || isTraceEnabled(gb)) {
+            stepCPU(gb);
+            continue;
+        }
+
+        if (ctx->core == CORE_BLOCK || ctx->core == CORE_JIT) {
+            executeCPUBlock(gb);
+            continue;
+        }
+
+#if defined(__GNUC__)
+        // Labels-as-values: every handler ends in its own indirect jump, which
+        // gives the branch predictor one history per opcode
+        static void *labels[0x100] = {
+#define INSTRUCTION(opcode, ...) [opcode] = &&label##opcode,
+#include <instructions.def>
+#undef INSTRUCTION
+        };
+
+#define DISPATCH()                                                        \
+    if (emu->ticks >= ctx->runUntil || ctx->halted || isCPUStopping(ctx)) \
+        goto resume;                                                      \
+    ctx->currentOpcode = readBus(gb, ctx->registers.pc++);                \
+    emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));        \
+    goto *labels[ctx->currentOpcode];
+
+        DISPATCH();
+#define INSTRUCTION(opcode, ...) \
+    label##opcode:               \
+    handle##opcode(ctx);         \
+    DISPATCH();
+#include <instructions.def>
+#undef INSTRUCTION
+#undef DISPATCH
+    resume:;
+#else
+        while (emu->ticks < ctx->runUntil && !ctx->halted &&
+               !isCPUStopping(ctx)) {
+            ctx->currentOpcode = readBus(gb, ctx->registers.pc++);
+            emulateCPUCycles(gb, getFetchCycles(ctx, ctx->currentOpcode));
+
+            switch (ctx->currentOpcode) {
+#define INSTRUCTION(opcode, ...) \
+    case opcode:                 \
+        handle##opcode(ctx);     \
+        break;
+#include <instructions.def>
+#undef INSTRUCTION
+            }
+        }
+#endif
+    }
+}
+
+/**
+ * Runs the CPU for a budget of CPU cycles. The table core uses a threaded
+ * dispatch loop and the block core runs cached blocks; the generic core and
+ * tracing step one instruction at a time. The CPU runs freely up to the next
+ * scheduled event, whose handler runs before the CPU continues. Returns early,
+ * after the instruction it is running, once stopCPU() is called.
+ *
+ * @param gb The Game Boy instance.
+ * @param cycles The number of CPU cycles to run for.
+ * @return The number of CPU cycles actually run.
+ */
+u64 runCPUFor(gb_t *gb, u64 cycles) {
+    emuContext_t *emu = &gb->emu;
+    cpuContext_t *ctx = &gb->cpu;
+    u64 start = emu->ticks;
+    u64 end = start + cycles * 4;
+
+    while (emu->ticks < end) {
+        // Handle the events that are due, then run up to the next one
+        runScheduledEvents(gb, emu->ticks);
+
+        // A stop is only cleared once it is honored
+        if (atomic_load_explicit(&ctx->stopping, memory_order_acquire)) {
+            atomic_store_explicit(&ctx->stopping, false, memory_order_relaxed);
+            break;
+        }
+
+        u64 nextEvent = getNextEventTicks(gb);
+        ctx->runUntil = nextEvent < end ? nextEvent : end;
+        runCPUUntil(gb);
+    }
+
+    debugPrint(gb);
+
+    return (emu->ticks - start) / 4;
+}
@@ -1,230 +1,159 @@
 // * Utility functions for the CPU.
 
-#include <cpu.h>
-#include <bus.h>
-
-// ===== Globals ===============================================================
-
-// The CPU context object - contains all CPU state
-extern cpuContext_t ctx;
+#include <gb.h>
+#include <interrupts.h>
 
 // ===== Helper functions ======================================================
 
-/**
- * Reverses the byte order of a 16-bit integer.
- *
- * @param n The 16-bit integer.
- * @return The reversed 16-bit integer.
- */
-u16 reverse(u16 n) { return ((n & 0xFF00) >> 8) | ((n & 0x00FF) << 8); }
-
 /**
  * Reads a CPU register.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  */
-u16 readCPURegister(registerType_t registerType) {
-    switch (registerType) {
-        case RT_A:
-            return ctx.registers.a;
-        case RT_F:
-            return ctx.registers.f;
-        case RT_B:
-            return ctx.registers.b;
-        case RT_C:
-            return ctx.registers.c;
-        case RT_D:
-            return ctx.registers.d;
-        case RT_E:
-            return ctx.registers.e;
-        case RT_H:
-            return ctx.registers.h;
-        case RT_L:
-            return ctx.registers.l;
-
-        case RT_AF:
-            return reverse(*((u16 *)&ctx.registers.a));
-        case RT_BC:
-            return reverse(*((u16 *)&ctx.registers.b));
-        case RT_DE:
-            return reverse(*((u16 *)&ctx.registers.d));
-        case RT_HL:
-            return reverse(*((u16 *)&ctx.registers.h));
-
-        case RT_PC:
-            return ctx.registers.pc;
-        case RT_SP:
-            return ctx.registers.sp;
-        default:
-            return 0;
-    }
+u16 readCPURegister(gb_t *gb, registerType_t registerType) {
+    return readRegister(&gb->cpu, registerType);
 }
 
 /**
  * Writes a value to a CPU register.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @param value The value to write.
  */
-void setCPURegister(registerType_t registerType, u16 value) {
-    switch (registerType) {
-        case RT_A:
-            ctx.registers.a = value & 0xFF;
-            return;
-        case RT_F:
-            ctx.registers.f = value & 0xFF;
-            return;
-        case RT_B:
-            ctx.registers.b = value & 0xFF;
-            return;
-        case RT_C:
-            ctx.registers.c = value & 0xFF;
-            return;
-        case RT_D:
-            ctx.registers.d = value & 0xFF;
-            return;
-        case RT_E:
-            ctx.registers.e = value & 0xFF;
-            return;
-        case RT_H:
-            ctx.registers.h = value & 0xFF;
-            return;
-        case RT_L:
-            ctx.registers.l = value & 0xFF;
-            return;
-
-        case RT_AF:
-            *((u16 *)&ctx.registers.a) = reverse(value);
-            return;
-        case RT_BC:
-            *((u16 *)&ctx.registers.b) = reverse(value);
-            return;
-        case RT_DE:
-            *((u16 *)&ctx.registers.d) = reverse(value);
-            return;
-        case RT_HL:
-            *((u16 *)&ctx.registers.h) = reverse(value);
-            return;
-
-        case RT_PC:
-            ctx.registers.pc = value;
-            return;
-        case RT_SP:
-            ctx.registers.sp = value;
-            return;
-        case RT_NONE:
-            return;
-    }
+void setCPURegister(gb_t *gb, registerType_t registerType, u16 value) {
+    setRegister(&gb->cpu, registerType, value);
 }
 
 /**
  * Gets the registers from the CPU.
  *
+ * @param gb The Game Boy instance.
  * @return The CPU registers.
  */
-cpuRegisters_t *getCPURegisters() { return &ctx.registers; }
+cpuRegisters_t *getCPURegisters(gb_t *gb) {
+    // Debuggers and the UI read the flags directly
+    materializeCPUFlags(&gb->cpu);
+    return &gb->cpu.registers;
+}
 
 /**
  * Reads the CPU Interrupt Enable (IE) register.
  *
+ * @param gb The Game Boy instance.
  * @return The value of the IE register.
  */
-u8 readCPUIERegister() { return ctx.interruptEnableRegister; }
+u8 readCPUIERegister(gb_t *gb) { return gb->cpu.interruptEnableRegister; }
 
 /**
  * Writes a value to the CPU Interrupt Enable (IE) register.
  *
+ * @param gb The Game Boy instance.
  * @param value The value to write.
  */
-void setCPUIERegister(u8 value) { ctx.interruptEnableRegister = value; }
+void setCPUIERegister(gb_t *gb, u8 value) {
+    gb->cpu.interruptEnableRegister = value;
+    updateCPUInterrupts(&gb->cpu);
+}
 
 /**
  * Reads a CPU register of one byte only.
  * Only used for CB operations.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @return The value of the register.
  */
-u8 readCPURegister8(registerType_t registerType) {
-    switch (registerType) {
-        case RT_A:
-            return ctx.registers.a;
-        case RT_F:
-            return ctx.registers.f;
-        case RT_B:
-            return ctx.registers.b;
-        case RT_C:
-            return ctx.registers.c;
-        case RT_D:
-            return ctx.registers.d;
-        case RT_E:
-            return ctx.registers.e;
-        case RT_H:
-            return ctx.registers.h;
-        case RT_L:
-            return ctx.registers.l;
-        case RT_HL:
-            return readBus(readCPURegister(RT_HL));
-        default:
-            printf("%sERR:%s Invalid read for register 8 (type %d).\n", CRED,
-                   CRST, registerType);
-            exit(EXIT_FAILURE);
-    }
+u8 readCPURegister8(gb_t *gb, registerType_t registerType) {
+    return readRegister8(&gb->cpu, registerType);
 }
 
 /**
  * Writes a value to a CPU register of one byte only.
  * Only used for CB operations.
  *
+ * @param gb The Game Boy instance.
  * @param registerType The register type.
  * @param value The value to write.
  */
-void setCPURegister8(registerType_t registerType, u8 value) {
-    switch (registerType) {
-        case RT_A:
-            ctx.registers.a = value & 0xFF;
-            return;
-        case RT_F:
-            ctx.registers.f = value & 0xFF;
-            return;
-        case RT_B:
-            ctx.registers.b = value & 0xFF;
-            return;
-        case RT_C:
-            ctx.registers.c = value & 0xFF;
-            return;
-        case RT_D:
-            ctx.registers.d = value & 0xFF;
-            return;
-        case RT_E:
-            ctx.registers.e = value & 0xFF;
-            return;
-        case RT_H:
-            ctx.registers.h = value & 0xFF;
-            return;
-        case RT_L:
-            ctx.registers.l = value & 0xFF;
-            return;
-        case RT_HL:
-            writeBus(readCPURegister(RT_HL), value);
-            return;
-        default:
-            printf("%sERR:%s Invalid set for register 8 (type %d).\n", CRED,
-                   CRST, registerType);
-            exit(EXIT_FAILURE);
-    }
+void setCPURegister8(gb_t *gb, registerType_t registerType, u8 value) {
+    setRegister8(&gb->cpu, registerType, value);
 }
 
 /**
  * Reads the CPU Interrupt Flags register.
  *
+ * @param gb The Game Boy instance.
  * @return The value of the IF register.
  */
-u8 getCPUInterruptFlags() { return ctx.interruptFlags; }
+u8 getCPUInterruptFlags(gb_t *gb) { return gb->cpu.interruptFlags; }
 
 /**
  * Writes a value to the CPU Interrupt Flags register.
  *
+ * @param gb The Game Boy instance.
  * @param flags The flags to set.
  */
-void setCPUInterruptFlags(u8 flags) { ctx.interruptFlags = flags; }
\ No newline at end of file
+void setCPUInterruptFlags(gb_t *gb, u8 flags) {
+    gb->cpu.interruptFlags = flags;
+    updateCPUInterrupts(&gb->cpu);
+}
+
+// ===== Flag functions ========================================================
+
+/**
+ * Computes the flags of the last lazily evaluated operation into the F
+ * register.
+ *
+ * @param ctx The CPU context.
+ */
+void evaluateLazyFlags(cpuContext_t *ctx) {
+    const lazyFlags_t *lazy = &ctx->lazyFlags;
+    int left = lazy->left;
+    int right = lazy->right;
+    int carry = lazy->carry;
+    u8 flags = lazy->result == 0 ? 0x80 : 0;  // Zero flag
+
+    switch (lazy->op) {
+        case FLAGS_ADD:
+            if ((left & 0xF) + (right & 0xF) + carry > 0xF) {
+                flags |= 0x20;
+            }
+            if (left + right + carry > 0xFF) {
+                flags |= 0x10;
+            }
+            break;
+        case FLAGS_SUB:
+            flags |= 0x40;
+            if ((left & 0xF) - (right & 0xF) - carry < 0) {
+                flags |= 0x20;
+            }
+            if (left - right - carry < 0) {
+                flags |= 0x10;
+            }
+            break;
+        case FLAGS_AND:
+            flags |= 0x20;
+            break;
+        case FLAGS_INC:
+            if ((lazy->result & 0xF) == 0) {
+                flags |= 0x20;
+            }
+            flags |= ctx->registers.f & 0x10;
+            break;
+        case FLAGS_DEC:
+            flags |= 0x40;
+            if ((lazy->result & 0xF) == 0xF) {
+                flags |= 0x20;
+            }
+            flags |= ctx->registers.f & 0x10;
+            break;
+        default:  // OR and XOR only set the zero flag
+            break;
+    }
+
+    // The low nibble of F is left untouched
+    ctx->registers.f = flags | (ctx->registers.f & 0x0F);
+    ctx->lazyFlags.op = FLAGS_NONE;
+}
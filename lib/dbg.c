@@ -1,33 +1,35 @@
 // * Handles debugging functions, used for Blargg tests.
 
 #include <dbg.h>
-#include <bus.h>
-
-// ===== Globals ===============================================================
-
-// Holds the current debug message
-static char debugMessage[1024] = {0};
-static int messageSize = 0;
+#include <gb.h>
 
 // ===== Debug functions =======================================================
 
 /**
- * Updates the debug message with the latest serial data.
+ * Appends a byte received over the serial port to the debug message.
+ *
+ * @param gb The Game Boy instance.
+ * @param c The byte that was received.
  */
-void debugUpdate() {
-    if (readBus(0xFF02) == 0x81) {
-        char c = readBus(0xFF01);
-        debugMessage[messageSize++] = c;
+void debugUpdate(gb_t *gb, u8 c) {
+    dbgContext_t *ctx = &gb->dbg;
 
-        writeBus(0xFF02, 0);
+    // The last character is kept for the null terminator
+    if (ctx->size < (int)sizeof(ctx->message) - 1) {
+        ctx->message[ctx->size++] = c;
     }
 }
 
 /**
- * Prints the current debug message.
+ * Prints the current debug message, if it changed since the last print.
+ *
+ * @param gb The Game Boy instance.
  */
-void debugPrint() {
-    if (debugMessage[0]) {
-        printf("%sDebug:%s %s\n", CYEL, CRST, debugMessage);
+void debugPrint(gb_t *gb) {
+    dbgContext_t *ctx = &gb->dbg;
+
+    if (ctx->size != ctx->printedSize) {
+        printf("%sDebug:%s %s\n", CYEL, CRST, ctx->message);
+        ctx->printedSize = ctx->size;
     }
-}
\ No newline at end of file
+}
@@ -1,12 +1,9 @@
 // * Implementation of main emulator components.
 
 #include <stdio.h>
-#include <emu.h>
-#include <cart.h>
-#include <cpu.h>
-#include <ui.h>
-#include <pthread.h>
-#include <unistd.h>
+#include <gb.h>
+#include <string.h>
+#include <time.h>
 
 /**
  * The emulator has the following major components:
@@ -15,63 +12,209 @@
  * * Address Bus: A central place for read/write functionality.
  * * PPU: Pixel Processing Unit, which generates a video signal.
  * * Timer: Keeps track of time.
+ * * Scheduler: Runs device events once the CPU reaches their tick, instead of
+ *   ticking every device every cycle.
+ * * Pacer: Keeps frames to the Game Boy's frame rate.
  */
 
 // ===== Globals ===============================================================
 
-// Keeps track of the emulator state
-static emuContext_t ctx;
+// CPU cycles in a frame, which are run between checks for pausing and stopping
+static const u64 CPU_FRAME_CYCLES = 17556;
+
+// CPU cycles in a second of real time
+static const u64 CPU_CYCLES_PER_SECOND = 1048576;
 
 // ===== Helper functions ======================================================
 
 /**
- * Gets the emulator's context object.
+ * Handles the commands sent by the UI thread since the last frame.
  *
- * @return The emulator's context object.
+ * @param ctx The emulator context.
+ * @return The longest time a command waited to be handled, in ns.
  */
-emuContext_t *getEMUContext() { return &ctx; }
+static u64 handleCommands(emuContext_t *ctx) {
+    command_t command;
+    u64 latency = 0;
+    while (receiveMessage(&ctx->commands, &command)) {
+        u64 waited = getMonotonicTime() - command.sent;
+        if (waited > latency) {
+            latency = waited;
+        }
+
+        switch (command.type) {
+            case CMD_PAUSE:
+                ctx->paused = true;
+                break;
+            case CMD_RESUME:
+                ctx->paused = false;
+                break;
+            case CMD_STOP:
+                ctx->running = false;
+                break;
+            case CMD_BUTTONS:
+                ctx->buttons = command.buttons;
+                break;
+        }
+    }
+
+    return latency;
+}
 
 /**
- * Separate thread to run the CPU.
+ * Sleeps until the UI thread sends a command. Only a paused CPU thread
+ * sleeps, so sending commands never takes the lock while it runs.
+ *
+ * @param ctx The emulator context.
  */
-void *runCPU(void *ptr) {
-    // Initialize CPU
-    initializeCPU();
+static void waitForCommand(emuContext_t *ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    atomic_store(&ctx->sleeping, true);
 
-    ctx.running = true;
-    ctx.paused = false;
-    ctx.ticks = 0;
+    // Pairs with the fence in sendCommand(): either this sees the command,
+    // or the sender sees that the thread is sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    while (isChannelEmpty(&ctx->commands)) {
+        pthread_cond_wait(&ctx->wake, &ctx->lock);
+    }
 
-    printf("Starting emulation...\n");
+    atomic_store(&ctx->sleeping, false);
+    pthread_mutex_unlock(&ctx->lock);
+}
 
-    // Run loop
-    while (ctx.running) {
-        // Hang processor for paused game
-        if (ctx.paused) {
-            delay(10);
-            continue;
-        }
+/**
+ * Sends a command to the CPU thread, waking it if it sleeps.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The command.
+ * @param buttons The pressed buttons, for CMD_BUTTONS.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+static bool sendCommand(gb_t *gb, commandType_t type, u8 buttons) {
+    emuContext_t *ctx = &gb->emu;
 
-        // Step the CPU
-        stepCPU();
+    command_t command = {
+        .type = type,
+        .buttons = buttons,
+        .sent = getMonotonicTime(),
+    };
+    if (!sendMessage(&ctx->commands, &command)) {
+        return false;
+    }
 
-        ctx.ticks++;
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ctx->sleeping)) {
+        pthread_mutex_lock(&ctx->lock);
+        pthread_cond_signal(&ctx->wake);
+        pthread_mutex_unlock(&ctx->lock);
     }
 
-    return 0;
+    return true;
+}
+
+/**
+ * Gets the number of CPU cycles to run next: a frame, or whatever is left of
+ * the cycle limit.
+ *
+ * @param ctx The emulator context.
+ * @return The number of CPU cycles, or 0 once the limit is reached.
+ */
+static u64 getSliceCycles(emuContext_t *ctx) {
+    if (!ctx->cycleLimit) {
+        return CPU_FRAME_CYCLES;
+    }
+
+    u64 elapsed = ctx->ticks / 4;
+    if (elapsed >= ctx->cycleLimit) {
+        return 0;
+    }
+
+    u64 left = ctx->cycleLimit - elapsed;
+    return left < CPU_FRAME_CYCLES ? left : CPU_FRAME_CYCLES;
+}
+
+/**
+ * Parses the optional arguments, configuring the instance.
+ *
+ * @param gb The Game Boy instance.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return Whether every argument was valid.
+ */
+static bool parseArguments(gb_t *gb, int argc, char **argv) {
+    for (int arg = 2; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--trace") && arg + 1 < argc) {
+            u32 records = strtoul(argv[++arg], NULL, 10);
+            if (!startTrace(gb, records, NULL)) {
+                printf("%sERR:%s Could not trace %s%s%s instructions.\n", CRED,
+                       CRST, CYEL, argv[arg], CRST);
+                return false;
+            }
+            printf("Tracing the last %s%u%s instructions to %s%s%s.\n", CYEL,
+                   records, CRST, CCYN, TRACE_DEFAULT_PATH, CRST);
+        } else if (!strcmp(argv[arg], "--core") && arg + 1 < argc) {
+            arg++;
+            if (!strcmp(argv[arg], "generic")) {
+                setCPUCore(gb, CORE_GENERIC);
+            } else if (!strcmp(argv[arg], "table")) {
+                setCPUCore(gb, CORE_TABLE);
+            } else if (!strcmp(argv[arg], "block")) {
+                setCPUCore(gb, CORE_BLOCK);
+            } else if (!strcmp(argv[arg], "jit")) {
+                setCPUCore(gb, CORE_JIT);
+            } else {
+                printf("%sERR:%s Unknown CPU core: %s%s%s\n", CRED, CRST,
+                       CMAG, argv[arg], CRST);
+                return false;
+            }
+        } else if (!strcmp(argv[arg], "--cycles") && arg + 1 < argc) {
+            arg++;
+            if (!strcmp(argv[arg], "accurate")) {
+                setCPUCycleMode(gb, CYCLES_ACCURATE);
+            } else if (!strcmp(argv[arg], "fast")) {
+                setCPUCycleMode(gb, CYCLES_FAST);
+            } else {
+                printf("%sERR:%s Unknown cycle mode: %s%s%s\n", CRED, CRST,
+                       CMAG, argv[arg], CRST);
+                return false;
+            }
+        } else if (!strcmp(argv[arg], "--rtc") && arg + 1 < argc) {
+            arg++;
+            if (!strcmp(argv[arg], "host")) {
+                setRTCClock(gb, RTC_CLOCK_HOST);
+            } else if (!strcmp(argv[arg], "emulated")) {
+                setRTCClock(gb, RTC_CLOCK_EMULATED);
+            } else {
+                printf("%sERR:%s Unknown RTC clock: %s%s%s\n", CRED, CRST,
+                       CMAG, argv[arg], CRST);
+                return false;
+            }
+        } else if (!strcmp(argv[arg], "--frames") && arg + 1 < argc) {
+            u64 frames = strtoull(argv[++arg], NULL, 10);
+            gb->emu.cycleLimit = frames * CPU_FRAME_CYCLES;
+        } else if (!strcmp(argv[arg], "--max-cycles") && arg + 1 < argc) {
+            gb->emu.cycleLimit = strtoull(argv[++arg], NULL, 10);
+        } else {
+            printf("%sERR:%s Unknown argument: %s%s%s\n", CRED, CRST, CMAG,
+                   argv[arg], CRST);
+            return false;
+        }
+    }
+
+    return true;
 }
 
 // ===== Emulator functions ====================================================
 
 /**
- * Runs the emulator system with the given arguments.
- * Acts as a secondary entry point to the emulator.
+ * Creates an instance from the command line, parsing the optional arguments
+ * and loading the ROM file.
  *
  * @param argc The number of arguments.
  * @param argv The arguments.
- * @return The exit code.
+ * @return The instance, or NULL if the arguments or the ROM file are invalid.
  */
-int runEmulator(int argc, char **argv) {
+gb_t *openEmulator(int argc, char **argv) {
     printf("%s=======================%s\n", CBLU, CRST);
     printf("%s * Game Boy Emulator * %s\n", CMAG, CRST);
     printf("%s=======================%s\n", CBLU, CRST);
@@ -79,49 +222,224 @@ int runEmulator(int argc, char **argv) {
     // Return if the user didn't provide a ROM file
     if (argc < 2) {
         printf("%sERR:%s No ROM file provided!\n", CRED, CRST);
-        printf("Usage: %semu <rom_file>%s\n", CMAG, CRST);
-        return EXIT_FAILURE;
+        printf("Usage: %semu <rom_file> [--core <generic|table|block|jit>] "
+               "[--cycles <accurate|fast>] [--rtc <host|emulated>] "
+               "[--trace <instructions>] [--frames <frames>] "
+               "[--max-cycles <cycles>]%s\n",
+               CMAG, CRST);
+        return NULL;
+    }
+
+    // Every piece of emulator state belongs to the instance
+    gb_t *gb = createGB();
+    if (!gb) {
+        printf("%sERR:%s Failed to create the emulator.\n", CRED, CRST);
+        return NULL;
     }
+
+    // Parse optional arguments
+    if (!parseArguments(gb, argc, argv)) {
+        destroyGB(gb);
+        return NULL;
+    }
+
     // Try loading the cartridge
-    if (!loadCartridge(argv[1])) {
+    if (!loadCartridge(gb, argv[1])) {
         printf("%sERR:%s Failed to load ROM file: %s%s%s\n", CRED, CRST, CCYN,
                argv[1], CRST);
-        return EXIT_FAILURE;
+        destroyGB(gb);
+        return NULL;
     }
 
-    // Initialize UI
-    initializeUI();
+    return gb;
+}
 
-    // Initialize CPU thread
-    pthread_t cpuThread;
-    if (pthread_create(&cpuThread, NULL, runCPU, NULL)) {
-        printf("%sERR:%s Failed to create CPU thread.\n", CRED, CRST);
-        return EXIT_FAILURE;
-    }
+/**
+ * Runs the CPU until the emulator stops running or reaches its cycle limit,
+ * which makes it exit. Handles commands, then publishes and reports each
+ * frame, sleeps while paused and waits for the pacer. Used as the CPU thread
+ * by the windowed emulator.
+ *
+ * @param ptr The Game Boy instance to run.
+ * @return NULL.
+ */
+void *runCPU(void *ptr) {
+    gb_t *gb = ptr;
+    emuContext_t *ctx = &gb->emu;
 
-    // Now simply poll the context to see if it's alive
-    bool stopEarly = false;  // ! DBG
-    int stopI = 10;
-    int i = 0;
-    while (!ctx.die) {
-        // ! DBG
-        if (stopEarly && i++ > stopI) {
+    resetGB(gb);
+    startPacer(gb);
+    ctx->frames = 0;
+
+    printf("Starting emulation...\n");
+
+    // Run loop, a frame at a time
+    while (true) {
+        u64 latency = handleCommands(ctx);
+        if (!ctx->running || isEmulatorExiting(gb)) {
             break;
         }
 
-        usleep(1000);  // Poll every 1ms
-        handleUIEvents();
+        // Sleep while paused, then pace from when the game resumes
+        if (ctx->paused) {
+            waitForCommand(ctx);
+            startPacer(gb);
+            continue;
+        }
+
+        u64 cycles = getSliceCycles(ctx);
+        if (!cycles) {
+            exitEmulator(gb);
+            break;
+        }
+
+        runCPUFor(gb, cycles);
+        publishFrame(gb);
+        waitForFrame(gb);
+
+        // Reports are dropped while the UI thread doesn't keep up
+        frameReport_t report = {
+            .frame = ++ctx->frames,
+            .ticks = ctx->ticks,
+            .time = getMonotonicTime(),
+            .inputLatency = latency,
+        };
+        sendMessage(&ctx->reports, &report);
     }
 
+    return NULL;
+}
+
+/**
+ * Runs the emulator without a window, as fast as the host allows, on the
+ * calling thread. Runs until the cycle limit is reached, if one is given.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int runHeadless(int argc, char **argv) {
+    gb_t *gb = openEmulator(argc, argv);
+    if (!gb) {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    gb->emu.running = true;
+    gb->emu.paused = false;
+    runCPU(gb);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    u64 cycles = gb->emu.ticks / 4;
+    double speed = seconds > 0 ? cycles / (seconds * CPU_CYCLES_PER_SECOND) : 0;
+    printf("Ran %s%llu%s CPU cycles (%.1f frames) in %.3f s, %s%.1fx%s real "
+           "time.\n",
+           CYEL, (unsigned long long)cycles, CRST,
+           (double)cycles / CPU_FRAME_CYCLES, seconds, CGRN, speed, CRST);
+
+    printUnhandledIO(gb);
+    destroyGB(gb);
+
     return EXIT_SUCCESS;
 }
 
+/**
+ * Gets the emulator's context object.
+ *
+ * @param gb The Game Boy instance.
+ * @return The emulator's context object.
+ */
+emuContext_t *getEMUContext(gb_t *gb) { return &gb->emu; }
+
 /**
  * Emulates a given number of CPU cycles.
  * This function is used to emulate elapsed time caused by CPU instructions.
  *
+ * @param gb The Game Boy instance.
  * @param cpuCycles The number of CPU cycles to emulate.
  */
-void emulateCPUCycles(int cpuCycles) {
-    // TODO: Emulate cycle stalling
-}
\ No newline at end of file
+void emulateCPUCycles(gb_t *gb, u64 cpuCycles) {
+    // Devices catch up through scheduled events, see runCPUFor()
+    gb->emu.ticks += cpuCycles * 4;
+}
+
+// ===== Run control functions =================================================
+
+/**
+ * Pauses the CPU thread once it finishes its current frame. It sleeps until
+ * resumed or stopped. Commands are only sent from one (the UI) thread.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool pauseEmulator(gb_t *gb) { return sendCommand(gb, CMD_PAUSE, 0); }
+
+/**
+ * Resumes a paused CPU thread. Frames are paced from the time it resumes.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool resumeEmulator(gb_t *gb) { return sendCommand(gb, CMD_RESUME, 0); }
+
+/**
+ * Stops the CPU thread, cutting its current frame short, even if paused.
+ * Also requests that the emulator exits, which the CPU thread checks after
+ * every frame, so it stops even if the channel is full.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool stopEmulator(gb_t *gb) {
+    exitEmulator(gb);
+    stopCPU(gb);
+
+    return sendCommand(gb, CMD_STOP, 0);
+}
+
+/**
+ * Changes the pressed joypad buttons, from the next frame on.
+ *
+ * @param gb The Game Boy instance.
+ * @param buttons The pressed buttons, a mask of button_t.
+ * @return Whether the command was sent, or false if the channel is full.
+ */
+bool setEmulatorButtons(gb_t *gb, u8 buttons) {
+    return sendCommand(gb, CMD_BUTTONS, buttons);
+}
+
+/**
+ * Receives the oldest report of a frame the CPU thread finished. Only called
+ * by one (the UI) thread.
+ *
+ * @param gb The Game Boy instance.
+ * @param report The report to fill in.
+ * @return Whether there was a report.
+ */
+bool receiveFrameReport(gb_t *gb, frameReport_t *report) {
+    return receiveMessage(&gb->emu.reports, report);
+}
+
+/**
+ * Requests that the emulator exits, e.g. when the window is closed or the
+ * cycle limit is reached.
+ *
+ * @param gb The Game Boy instance.
+ */
+void exitEmulator(gb_t *gb) {
+    atomic_store_explicit(&gb->emu.die, true, memory_order_release);
+}
+
+/**
+ * Checks whether the emulator should exit.
+ *
+ * @param gb The Game Boy instance.
+ * @return Whether exitEmulator() was called.
+ */
+bool isEmulatorExiting(gb_t *gb) {
+    return atomic_load_explicit(&gb->emu.die, memory_order_acquire);
+}
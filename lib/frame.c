@@ -0,0 +1,126 @@
+// * Hands finished frames from the CPU thread to the presenter.
+
+#include <frame.h>
+#include <gb.h>
+
+/**
+ * The three buffers are always split between the sides: one is drawn into by
+ * the core, one is shown by the presenter and one is shared. Swapping the
+ * shared index with an atomic exchange hands a buffer over, with acquire and
+ * release ordering so that its pixels are complete before the other side
+ * sees them. Since a side only ever touches the buffer it holds, frames are
+ * never torn, copied or waited for.
+ */
+
+// Bit of the shared index set while its frame hasn't been taken
+#define FRAME_FRESH 0x80
+
+// ===== Frame exchange functions ==============================================
+
+/**
+ * Blanks the three buffers. Called when the instance is created, before
+ * either side uses them.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeFrames(gb_t *gb) {
+    frameContext_t *ctx = &gb->frames;
+
+    for (int buffer = 0; buffer < 3; buffer++) {
+        for (int i = 0; i < FRAME_HEIGHT * FRAME_WIDTH; i++) {
+            ctx->pixels[buffer][i] = FRAME_BLANK_COLOR;
+        }
+    }
+
+    ctx->drawing = 0;
+    atomic_init(&ctx->shared, 1);
+    ctx->showing = 2;
+    ctx->published = 0;
+    ctx->dropped = 0;
+    ctx->presented = 0;
+    ctx->repeated = 0;
+}
+
+/**
+ * Gets the buffer the core draws the current frame into. Only called by the
+ * CPU thread.
+ *
+ * @param gb The Game Boy instance.
+ * @return The pixels (FRAME_WIDTH * FRAME_HEIGHT, ARGB8888).
+ */
+u32 *getDrawingFrame(gb_t *gb) {
+    frameContext_t *ctx = &gb->frames;
+
+    return ctx->pixels[ctx->drawing];
+}
+
+/**
+ * Publishes the frame that was drawn, then starts drawing into a free buffer.
+ * Only called by the CPU thread.
+ *
+ * @param gb The Game Boy instance.
+ */
+void publishFrame(gb_t *gb) {
+    frameContext_t *ctx = &gb->frames;
+
+    u8 previous = atomic_exchange_explicit(
+        &ctx->shared, ctx->drawing | FRAME_FRESH, memory_order_acq_rel);
+    ctx->drawing = previous & ~FRAME_FRESH;
+    ctx->published++;
+
+    // The presenter never saw the frame that was replaced
+    if (previous & FRAME_FRESH) {
+        ctx->dropped++;
+    }
+}
+
+/**
+ * Takes the newest published frame, or shows the last one again if there is
+ * none. Only called by the presenter thread.
+ *
+ * @param gb The Game Boy instance.
+ * @param fresh Set to whether the frame wasn't shown before, if not NULL.
+ * @return The pixels (FRAME_WIDTH * FRAME_HEIGHT, ARGB8888), which stay
+ * valid until the next call.
+ */
+const u32 *takeFrame(gb_t *gb, bool *fresh) {
+    frameContext_t *ctx = &gb->frames;
+
+    bool isFresh =
+        atomic_load_explicit(&ctx->shared, memory_order_relaxed) & FRAME_FRESH;
+    if (isFresh) {
+        u8 previous = atomic_exchange_explicit(&ctx->shared, ctx->showing,
+                                               memory_order_acq_rel);
+        ctx->showing = previous & ~FRAME_FRESH;
+        ctx->presented++;
+    } else {
+        ctx->repeated++;
+    }
+
+    if (fresh) {
+        *fresh = isFresh;
+    }
+
+    return ctx->pixels[ctx->showing];
+}
+
+/**
+ * Prints how many frames were published, presented, dropped and repeated,
+ * once neither side runs.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printFrameStats(gb_t *gb) {
+    frameContext_t *ctx = &gb->frames;
+
+    if (!ctx->published) {
+        return;
+    }
+
+    printf("Published %s%llu%s frames, presented %s%llu%s (%s%llu%s dropped, "
+           "%s%llu%s repeated).\n",
+           CYEL, (unsigned long long)ctx->published, CRST, CYEL,
+           (unsigned long long)ctx->presented, CRST, CYEL,
+           (unsigned long long)ctx->dropped, CRST, CYEL,
+           (unsigned long long)ctx->repeated, CRST);
+}
@@ -0,0 +1,84 @@
+// * Creates and destroys Game Boy instances.
+
+#include <gb.h>
+
+// ===== Instance functions ====================================================
+
+/**
+ * Creates a Game Boy instance, in its state after the boot ROM and without a
+ * cartridge.
+ *
+ * @return The instance, or NULL if it couldn't be allocated.
+ */
+gb_t *createGB() {
+    gb_t *gb = calloc(1, sizeof(gb_t));
+    if (!gb) {
+        return NULL;
+    }
+
+    gb->cpu.gb = gb;
+    pthread_mutex_init(&gb->emu.lock, NULL);
+    pthread_cond_init(&gb->emu.wake, NULL);
+    if (!createChannel(&gb->emu.commands, EMU_COMMAND_CAPACITY,
+                       sizeof(command_t)) ||
+        !createChannel(&gb->emu.reports, EMU_REPORT_CAPACITY,
+                       sizeof(frameReport_t))) {
+        destroyGB(gb);
+        return NULL;
+    }
+
+    // The presenter may take frames across resets
+    initializeFrames(gb);
+    setCPUCore(gb, CORE_TABLE);
+    setCPUCycleMode(gb, CYCLES_ACCURATE);
+
+    resetGB(gb);
+    return gb;
+}
+
+/**
+ * Resets an instance to its state after the boot ROM, keeping the cartridge
+ * and the selected cores.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetGB(gb_t *gb) {
+    // The clock is brought up to date on the ticks it followed
+    initializeRTC(gb);
+
+    // Initialize scheduler, I/O registers, bank registers, bus, CPU, PPU and
+    // timer
+    gb->emu.ticks = 0;
+    initializeScheduler(gb);
+    initializeIO(gb);
+    resetCartridge(gb);
+    initializeBus(gb);
+    initializeCPU(gb);
+    initializePPU(gb);
+    initializeTimer(gb);
+}
+
+/**
+ * Destroys a Game Boy instance, unloading its cartridge (which flushes
+ * battery-backed RAM) and dumping its trace, if it is tracing.
+ *
+ * @param gb The Game Boy instance, or NULL.
+ */
+void destroyGB(gb_t *gb) {
+    if (!gb) {
+        return;
+    }
+
+    if (isTraceEnabled(gb)) {
+        dumpTrace(gb, NULL);
+    }
+    stopTrace(gb);
+    unloadCartridge(gb);
+    freeJIT(gb);
+
+    destroyChannel(&gb->emu.commands);
+    destroyChannel(&gb->emu.reports);
+    pthread_cond_destroy(&gb->emu.wake);
+    pthread_mutex_destroy(&gb->emu.lock);
+    free(gb);
+}
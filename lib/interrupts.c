@@ -4,58 +4,54 @@
 #include <cpu.h>
 #include <stack.h>
 
-// ===== Helper functions ======================================================
+// Index of the lowest set bit of each 5-bit interrupt mask. Lower bits have
+// priority, and interrupt vectors are 8 bytes apart from 0x40.
+static const u8 LOWEST_INTERRUPT[32] = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+};
 
-/**
- * Handles an interrupt by pushing the current program counter to the stack.
- * The program counter is then set to the interrupt handler address.
- *
- * @param ctx The CPU context.
- * @param address The address of the interrupt handler.
- */
-void interruptHandler(cpuContext_t *ctx, u16 address) {
-    pushStack16(ctx->registers.pc);
-    ctx->registers.pc = address;
-}
+// ===== Interrupt functions ===================================================
 
 /**
- * Checks if an interrupt is enabled and if the interrupt flag is set.
- * If both are true, the interrupt is handled.
+ * Recomputes the mask of interrupts waiting to be serviced. Called whenever
+ * IE, IF or IME change, so the CPU only checks the mask between instructions.
  *
  * @param ctx The CPU context.
- * @param address The address of the interrupt handler.
- * @param interruptType The type of interrupt.
- * @return Whether the interrupt was handled.
  */
-bool checkInterrupt(cpuContext_t *ctx, u16 address,
-                    interruptType_t interruptType) {
-    if (ctx->interruptFlags & interruptType &&
-        ctx->interruptEnableRegister & interruptType) {
-        interruptHandler(ctx, address);
-        ctx->interruptFlags &= ~interruptType;  // Turn off the flag
-        ctx->halted = false;
-        ctx->masterInterruptEnabled = false;
-        return true;
-    }
+void updateCPUInterrupts(cpuContext_t *ctx) {
+    ctx->pendingInterrupts =
+        ctx->masterInterruptEnabled
+            ? ctx->interruptEnableRegister & ctx->interruptFlags & 0x1F
+            : 0;
 
-    return false;
+    // A running runCPUFor() leaves its dispatch loop to service them
+    if (ctx->pendingInterrupts) {
+        limitCPURun(ctx->gb, 0);
+    }
 }
 
-// ===== Interrupt functions ===================================================
-
 /**
- * Handles interrupts for the CPU.
+ * Services the pending interrupt with the highest priority, if there is one.
  *
  * @param ctx The CPU context.
  */
 void handleCPUInterrupt(cpuContext_t *ctx) {
-    // For now, just check all of the interrupts
-    if (checkInterrupt(ctx, 0x40, INT_VBLANK) ||
-        checkInterrupt(ctx, 0x48, INT_LCDSTAT) ||
-        checkInterrupt(ctx, 0x50, INT_TIMER) ||
-        checkInterrupt(ctx, 0x58, INT_SERIAL) ||
-        checkInterrupt(ctx, 0x60, INT_JOYPAD)) {
-        // Note: We don't check multiple - The OR will shortcut
+    if (!ctx->pendingInterrupts) {
         return;
     }
-}
\ No newline at end of file
+
+    u8 index = LOWEST_INTERRUPT[ctx->pendingInterrupts];
+    ctx->interruptFlags &= ~(1 << index);  // Turn off the flag
+    ctx->masterInterruptEnabled = false;
+    ctx->enablingIME = false;
+    ctx->pendingInterrupts = 0;
+    ctx->halted = false;
+
+    // 2 cycles waiting, 2 for pushing the program counter and 1 for jumping
+    emulateCPUCycles(ctx->gb, 2);
+    pushStack16(ctx->gb, ctx->registers.pc);
+    emulateCPUCycles(ctx->gb, 2);
+    ctx->registers.pc = 0x40 + index * 8;
+    emulateCPUCycles(ctx->gb, 1);
+}
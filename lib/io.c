@@ -2,49 +2,172 @@
 
 #include <io.h>
 #include <common.h>
+#include <dbg.h>
+#include <emu.h>
+#include <cpu.h>
+#include <interrupts.h>
+#include <scheduler.h>
+#include <gb.h>
+#include <string.h>
 
-// ===== Globals ===============================================================
+// Ticks to shift out a serial byte with the internal clock (8 bits at 8192 Hz)
+#define SERIAL_TRANSFER_TICKS (8 * 512)
 
-// Holds serial data during reading
-static char serialData[2];
+// ===== Helper functions ======================================================
+
+/**
+ * Completes a serial transfer once the byte has been shifted out, clearing
+ * the transfer flag (SC bit 7).
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick the transfer completed at.
+ */
+static void completeSerialTransfer(gb_t *gb, u64 ticks) {
+    debugUpdate(gb, gb->io.serial[0]);
+    gb->io.serial[1] &= ~0x80;
+    setCPUInterruptFlags(gb, getCPUInterruptFlags(gb) | INT_SERIAL);
+}
+
+/**
+ * Reads a serial register (SB or SC).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from (0xFF01-0xFF02).
+ * @return The value of the register.
+ */
+static u8 readSerial(gb_t *gb, u16 address) {
+    return gb->io.serial[address - 0xFF01];
+}
+
+/**
+ * Writes a serial register (SB or SC). Starting a transfer with the internal
+ * clock sends the byte.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to (0xFF01-0xFF02).
+ * @param value The value to write.
+ */
+static void writeSerial(gb_t *gb, u16 address, u8 value) {
+    gb->io.serial[address - 0xFF01] = value;
+
+    if (address == 0xFF02 && (value & 0x81) == 0x81) {
+        scheduleEvent(gb, EVENT_SERIAL, gb->emu.ticks + SERIAL_TRANSFER_TICKS,
+                      completeSerialTransfer);
+    }
+}
+
+/**
+ * Reads the interrupt flags register (IF).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from (0xFF0F).
+ * @return The value of the register.
+ */
+static u8 readInterruptFlags(gb_t *gb, u16 address) {
+    return getCPUInterruptFlags(gb);
+}
+
+/**
+ * Writes the interrupt flags register (IF).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to (0xFF0F).
+ * @param value The value to write.
+ */
+static void writeInterruptFlags(gb_t *gb, u16 address, u8 value) {
+    setCPUInterruptFlags(gb, value & 0x1F);
+}
 
 // ===== I/O functions =========================================================
 
+/**
+ * Clears the register table and registers the serial port and interrupt
+ * flags. Other modules register their own registers once this has run.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeIO(gb_t *gb) {
+    memset(&gb->io, 0, sizeof(gb->io));
+
+    mapIORegister(gb, 0xFF01, 0x00, readSerial, writeSerial);  // SB
+    mapIORegister(gb, 0xFF02, 0x7E, readSerial, writeSerial);  // SC
+    mapIORegister(gb, 0xFF0F, 0xE0, readInterruptFlags, writeInterruptFlags);
+}
+
+/**
+ * Registers the handlers for an I/O register, replacing any previous ones.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the register (0xFF00 - 0xFF7F).
+ * @param unusedBits The bits that always read as 1.
+ * @param read The read handler, or NULL if the register isn't readable.
+ * @param write The write handler, or NULL if the register isn't writable.
+ */
+void mapIORegister(gb_t *gb, u16 address, u8 unusedBits, IO_READ read,
+                   IO_WRITE write) {
+    gb->io.registers[address & 0x7F] = (ioRegister_t){read, write, unusedBits};
+}
+
+/**
+ * Gets the number of reads and writes of an I/O register without a handler.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address of the register (0xFF00 - 0xFF7F).
+ * @return The number of unhandled accesses.
+ */
+u32 getUnhandledIOCount(gb_t *gb, u16 address) {
+    return gb->io.unhandledReads[address & 0x7F] +
+           gb->io.unhandledWrites[address & 0x7F];
+}
+
+/**
+ * Prints the I/O registers that were accessed without a handler, and how
+ * often.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printUnhandledIO(gb_t *gb) {
+    for (u16 i = 0; i < 0x80; i++) {
+        if (gb->io.unhandledReads[i] || gb->io.unhandledWrites[i]) {
+            printf("%sWARN:%s Unhandled I/O at address %s0x%04X%s: %u reads, "
+                   "%u writes\n",
+                   CYEL, CRST, CMAG, 0xFF00 + i, CRST, gb->io.unhandledReads[i],
+                   gb->io.unhandledWrites[i]);
+        }
+    }
+}
+
 /**
  * Reads a byte from the I/O registers at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the I/O registers.
  */
-u8 readIO(u16 address) {
-    if (address == 0xFF01) {
-        return serialData[0];
-    } else if (address == 0xFF02) {
-        return serialData[1];
+u8 readIO(gb_t *gb, u16 address) {
+    ioRegister_t *reg = &gb->io.registers[address & 0x7F];
+    if (reg->read) {
+        return reg->read(gb, address) | reg->unusedBits;
     }
 
-    printf("%sERR:%s Unhandled I/O read at address 0x%04X\n", CRED, CRST,
-           address);
-    return 0;
+    // Unmapped registers read as all 1s
+    gb->io.unhandledReads[address & 0x7F]++;
+    return 0xFF;
 }
 
 /**
  * Writes a byte to the I/O registers at the given address.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeIO(u16 address, u8 value) {
-    if (address == 0xFF01) {
-        serialData[0] = value;
-        return;
-    }
-
-    if (address == 0xFF02) {
-        serialData[1] = value;
+void writeIO(gb_t *gb, u16 address, u8 value) {
+    ioRegister_t *reg = &gb->io.registers[address & 0x7F];
+    if (reg->write) {
+        reg->write(gb, address, value);
         return;
     }
 
-    printf("%sERR:%s Unhandled I/O write at address 0x%04X\n", CRED, CRST,
-           address);
-}
\ No newline at end of file
+    gb->io.unhandledWrites[address & 0x7F]++;
+}
@@ -0,0 +1,179 @@
+// * Paces emulated frames to the Game Boy's real frame rate.
+
+#include <pacer.h>
+#include <gb.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+// Length of a frame: 17556 CPU cycles at 1048576 Hz, as nanoseconds and a
+// remainder in 2^-20 ns
+#define FRAME_NS_NUMERATOR (17556ull * 1000000000ull)
+#define FRAME_NS (FRAME_NS_NUMERATOR >> 20)
+#define FRAME_NS_REMAINDER (FRAME_NS_NUMERATOR & ((1u << 20) - 1))
+
+// Time spun before each deadline instead of sleeping, in ns
+#define PACER_SPIN_NS 200000
+
+// Frames the pacer may fall behind by before it gives up catching up
+#define PACER_MAX_LAG_FRAMES 3
+
+// ===== Helper functions ======================================================
+
+/**
+ * Sleeps until a monotonic time, even if interrupted by a signal.
+ *
+ * @param ns The time to wake up at, in nanoseconds.
+ */
+static void sleepUntil(u64 ns) {
+    struct timespec until = {
+        .tv_sec = ns / 1000000000ull,
+        .tv_nsec = ns % 1000000000ull,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) ==
+           EINTR) {
+    }
+}
+
+/**
+ * Moves the deadline on by a frame.
+ *
+ * @param ctx The pacer context.
+ */
+static void advanceDeadline(pacerContext_t *ctx) {
+    ctx->deadline += FRAME_NS;
+    ctx->remainder += FRAME_NS_REMAINDER;
+    if (ctx->remainder >> 20) {
+        ctx->deadline++;
+        ctx->remainder &= (1u << 20) - 1;
+    }
+}
+
+// ===== Pacer functions =======================================================
+
+/**
+ * Gets the monotonic time, which frame deadlines are measured in.
+ *
+ * @return The time, in nanoseconds.
+ */
+u64 getMonotonicTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (u64)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/**
+ * Enables or disables pacing frames to real time. Disabled pacers don't wait.
+ *
+ * @param gb The Game Boy instance.
+ * @param enabled Whether to pace frames.
+ */
+void setFramePacing(gb_t *gb, bool enabled) {
+    pacerContext_t *ctx = &gb->pacer;
+
+    *ctx = (pacerContext_t){.enabled = enabled};
+    startPacer(gb);
+}
+
+/**
+ * Starts pacing from now, making the next frame due a frame from now. Called
+ * when the CPU starts running and after it was paused.
+ *
+ * @param gb The Game Boy instance.
+ */
+void startPacer(gb_t *gb) {
+    pacerContext_t *ctx = &gb->pacer;
+
+    ctx->deadline = getMonotonicTime();
+    ctx->remainder = 0;
+    advanceDeadline(ctx);
+}
+
+/**
+ * Waits for the deadline of the frame that was just emulated. Sleeps until
+ * shortly before it, then spins, since sleeps only wake up to the scheduler's
+ * precision.
+ *
+ * @param gb The Game Boy instance.
+ */
+void waitForFrame(gb_t *gb) {
+    pacerContext_t *ctx = &gb->pacer;
+
+    if (!ctx->enabled) {
+        return;
+    }
+
+    u64 now = getMonotonicTime();
+    if (now < ctx->deadline) {
+        if (ctx->deadline - now > PACER_SPIN_NS) {
+            sleepUntil(ctx->deadline - PACER_SPIN_NS);
+        }
+        while ((now = getMonotonicTime()) < ctx->deadline) {
+        }
+    } else {
+        ctx->lateFrames++;
+    }
+
+    u64 jitter = now - ctx->deadline;
+    ctx->frames++;
+    ctx->jitterSum += jitter;
+    ctx->jitterSumSquares += (double)jitter * jitter;
+    if (jitter > ctx->maxJitter) {
+        ctx->maxJitter = jitter;
+    }
+
+    // Late frames are caught up on, unless the host can't keep up at all
+    if (jitter > PACER_MAX_LAG_FRAMES * FRAME_NS) {
+        ctx->resyncs++;
+        startPacer(gb);
+    } else {
+        advanceDeadline(ctx);
+    }
+}
+
+/**
+ * Gets the frame pacing statistics since the pacer was enabled.
+ *
+ * @param gb The Game Boy instance.
+ * @param stats The statistics to fill in.
+ */
+void getPacerStats(gb_t *gb, pacerStats_t *stats) {
+    pacerContext_t *ctx = &gb->pacer;
+
+    *stats = (pacerStats_t){
+        .frames = ctx->frames,
+        .lateFrames = ctx->lateFrames,
+        .resyncs = ctx->resyncs,
+        .maxJitter = ctx->maxJitter / 1000.0,
+    };
+
+    if (ctx->frames) {
+        double mean = ctx->jitterSum / ctx->frames;
+        double variance = ctx->jitterSumSquares / ctx->frames - mean * mean;
+        stats->meanJitter = mean / 1000.0;
+        stats->stdDevJitter = variance > 0 ? sqrt(variance) / 1000.0 : 0;
+    }
+}
+
+/**
+ * Prints the frame pacing statistics, if any frames were paced.
+ *
+ * @param gb The Game Boy instance.
+ */
+void printPacerStats(gb_t *gb) {
+    pacerStats_t stats;
+    getPacerStats(gb, &stats);
+
+    if (!stats.frames) {
+        return;
+    }
+
+    printf("Paced %s%llu%s frames (%s%llu%s late, %s%llu%s resyncs), jitter "
+           "mean %.1f us, std. dev. %.1f us, max %.1f us.\n",
+           CYEL, (unsigned long long)stats.frames, CRST, CYEL,
+           (unsigned long long)stats.lateFrames, CRST, CYEL,
+           (unsigned long long)stats.resyncs, CRST, stats.meanJitter,
+           stats.stdDevJitter, stats.maxJitter);
+}
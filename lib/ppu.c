@@ -1,5 +1,36 @@
 #include <ppu.h>
+#include <gb.h>
 
-void initializePPU() {}
+// ===== PPU functionality =====================================================
 
-void tickPPU() {}
+void initializePPU(gb_t *gb) {}
+
+void tickPPU(gb_t *gb) {}
+
+/**
+ * Gets the video RAM, for mapping it into the bus.
+ *
+ * @param gb The Game Boy instance.
+ * @return The video RAM (0x2000 bytes).
+ */
+u8 *getVideoRAM(gb_t *gb) { return gb->ppu.vram; }
+
+/**
+ * Reads a byte from the given address in the object attribute memory.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from.
+ * @return The byte read from the OAM.
+ */
+u8 readOAM(gb_t *gb, u16 address) { return gb->ppu.oam[address - 0xFE00]; }
+
+/**
+ * Writes a byte to the given address in the object attribute memory.
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to.
+ * @param value The value to write.
+ */
+void writeToOAM(gb_t *gb, u16 address, u8 value) {
+    gb->ppu.oam[address - 0xFE00] = value;
+}
@@ -1,54 +1,62 @@
 // * Handles RAM read/write functionality.
 
 #include <ram.h>
-
-// ===== Globals ===============================================================
-
-// RAM context
-static ramContext_t ctx;
+#include <gb.h>
 
 // ===== RAM functionality =====================================================
 
 /**
  * Reads a byte from the given address in the working RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the working RAM.
  */
-u8 readWorkingRAM(u16 address) {
+u8 readWorkingRAM(gb_t *gb, u16 address) {
     address -= 0xC000;
-    return ctx.wram[address];
+    return gb->ram.wram[address];
 }
 
 /**
  * Writes a byte to the given address in the working RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToWorkingRAM(u16 address, u8 value) {
+void writeToWorkingRAM(gb_t *gb, u16 address, u8 value) {
     address -= 0xC000;
-    ctx.wram[address] = value;
+    gb->ram.wram[address] = value;
 }
 
 /**
  * Reads a byte from the given address in the high RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to read from.
  * @return The byte read from the high RAM.
  */
-u8 readHighRAM(u16 address) {
+u8 readHighRAM(gb_t *gb, u16 address) {
     address -= 0xFF80;
-    return ctx.hram[address];
+    return gb->ram.hram[address];
 }
 
 /**
  * Writes a byte to the given address in the high RAM.
  *
+ * @param gb The Game Boy instance.
  * @param address The address to write to.
  * @param value The value to write.
  */
-void writeToHighRAM(u16 address, u8 value) {
+void writeToHighRAM(gb_t *gb, u16 address, u8 value) {
     address -= 0xFF80;
-    ctx.wram[address] = value;
-}
\ No newline at end of file
+    gb->ram.hram[address] = value;
+}
+
+/**
+ * Gets the working RAM, for mapping it into the bus.
+ *
+ * @param gb The Game Boy instance.
+ * @return The working RAM (0x2000 bytes).
+ */
+u8 *getWorkingRAM(gb_t *gb) { return gb->ram.wram; }
@@ -0,0 +1,309 @@
+// * Emulates the MBC3 real-time clock lazily, from a host or emulated clock.
+
+#include <rtc.h>
+#include <gb.h>
+#include <time.h>
+
+/**
+ * The counter is kept in seconds, as of a reading of the clock it follows.
+ * Registers are only worked out from it when the game latches or writes
+ * them, so nothing runs while the clock ticks. The day counter has 9 bits,
+ * and sets the carry when it overflows.
+ */
+
+// Emulator ticks in a second of emulated time
+#define TICKS_PER_SECOND 4194304
+
+// Microseconds in a second of host time
+#define MICROS_PER_SECOND 1000000
+
+// Seconds until the day counter overflows
+#define RTC_PERIOD (512 * 86400ull)
+
+// Bits of each clock register that can be written
+static const u8 RTC_MASKS[5] = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+
+// ===== Helper functions ======================================================
+
+/**
+ * Gets the number of clock units in a second.
+ *
+ * @param ctx The clock context.
+ * @return The clock units per second.
+ */
+static u64 getUnitsPerSecond(rtcContext_t *ctx) {
+    return ctx->clock == RTC_CLOCK_EMULATED ? TICKS_PER_SECOND
+                                            : MICROS_PER_SECOND;
+}
+
+/**
+ * Reads the clock the counter follows.
+ *
+ * @param gb The Game Boy instance.
+ * @return Emulator ticks, or host microseconds.
+ */
+static u64 readClock(gb_t *gb) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    if (ctx->clock == RTC_CLOCK_EMULATED) {
+        return gb->emu.ticks;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * (u64)MICROS_PER_SECOND + now.tv_nsec / 1000;
+}
+
+/**
+ * Adds seconds to the counter, setting the carry if the days overflow.
+ *
+ * @param ctx The clock context.
+ * @param seconds The seconds to add.
+ */
+static void addSeconds(rtcContext_t *ctx, u64 seconds) {
+    ctx->seconds += seconds;
+    if (ctx->seconds >= RTC_PERIOD) {
+        ctx->carry = true;
+        ctx->seconds %= RTC_PERIOD;
+    }
+}
+
+/**
+ * Brings the counter up to date with the clock, keeping the fraction of a
+ * second that has passed.
+ *
+ * @param gb The Game Boy instance.
+ */
+static void updateRTC(gb_t *gb) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    u64 now = readClock(gb);
+
+    // A halted counter, or a clock that was reset, restarts from now
+    if (ctx->halted || now < ctx->stamp) {
+        ctx->stamp = now;
+        return;
+    }
+
+    u64 unit = getUnitsPerSecond(ctx);
+    u64 elapsed = (now - ctx->stamp) / unit;
+    ctx->stamp += elapsed * unit;
+    addSeconds(ctx, elapsed);
+}
+
+/**
+ * Works out the clock registers from the counter.
+ *
+ * @param ctx The clock context.
+ * @param registers Set to the seconds, minutes, hours, day low and day high.
+ */
+static void getRegisters(rtcContext_t *ctx, u8 *registers) {
+    u64 days = ctx->seconds / 86400;
+
+    registers[0] = ctx->seconds % 60;
+    registers[1] = ctx->seconds / 60 % 60;
+    registers[2] = ctx->seconds / 3600 % 24;
+    registers[3] = days & 0xFF;
+    registers[4] = (days >> 8 & 0x01) | ctx->halted << 6 | ctx->carry << 7;
+}
+
+/**
+ * Sets the counter from clock registers. Out of range values, which the
+ * hardware allows, are carried into the next register.
+ *
+ * @param ctx The clock context.
+ * @param registers The seconds, minutes, hours, day low and day high.
+ */
+static void setRegisters(rtcContext_t *ctx, const u8 *registers) {
+    u64 days = registers[3] | (registers[4] & 0x01) << 8;
+
+    ctx->seconds = 0;
+    ctx->halted = registers[4] & 0x40;
+    ctx->carry = registers[4] & 0x80;
+    addSeconds(ctx, ((days * 24 + registers[2]) * 60 + registers[1]) * 60 +
+               registers[0]);
+}
+
+/**
+ * Reads a little-endian value from a footer.
+ *
+ * @param data The value.
+ * @param size The size of the value in bytes.
+ * @return The value.
+ */
+static u64 readLE(const u8 *data, int size) {
+    u64 value = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        value = value << 8 | data[i];
+    }
+
+    return value;
+}
+
+/**
+ * Writes a little-endian value to a footer.
+ *
+ * @param data The value's place in the footer.
+ * @param value The value.
+ * @param size The size of the value in bytes.
+ */
+static void writeLE(u8 *data, u64 value, int size) {
+    for (int i = 0; i < size; i++) {
+        data[i] = value >> (i * 8);
+    }
+}
+
+// ===== Real-time clock functions =============================================
+
+/**
+ * Sets the clock the real-time clock follows, keeping its current time.
+ *
+ * @param gb The Game Boy instance.
+ * @param clock The clock to follow.
+ */
+void setRTCClock(gb_t *gb, rtcClock_t clock) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    updateRTC(gb);
+    ctx->clock = clock;
+    ctx->stamp = readClock(gb);
+}
+
+/**
+ * Initializes the real-time clock for a reset of the instance, which the
+ * clock runs through on its own battery. Called before the emulator tick is
+ * reset.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeRTC(gb_t *gb) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    if (!gb->cart.hasRTC) {
+        return;
+    }
+
+    // The emulated clock restarts from tick 0, dropping the fraction of a
+    // second that had passed
+    updateRTC(gb);
+    if (ctx->clock == RTC_CLOCK_EMULATED) {
+        ctx->stamp = 0;
+    }
+    ctx->latch = 0xFF;
+}
+
+/**
+ * Resets the real-time clock to day 0, for cartridges without a saved clock.
+ *
+ * @param gb The Game Boy instance.
+ */
+void resetRTC(gb_t *gb) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    ctx->seconds = 0;
+    ctx->stamp = readClock(gb);
+    ctx->halted = false;
+    ctx->carry = false;
+    ctx->latch = 0xFF;
+    for (int i = 0; i < 5; i++) {
+        ctx->latched[i] = 0;
+    }
+}
+
+/**
+ * Loads the real-time clock from a save file footer. With the host clock,
+ * the time since the footer was saved is added.
+ *
+ * @param gb The Game Boy instance.
+ * @param footer The footer (RTC_FOOTER_SIZE bytes).
+ */
+void loadRTC(gb_t *gb, const u8 *footer) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    // Current registers, then latched registers, as 32-bit values
+    u8 registers[5];
+    for (int i = 0; i < 5; i++) {
+        registers[i] = readLE(footer + i * 4, 4) & RTC_MASKS[i];
+        ctx->latched[i] = readLE(footer + 20 + i * 4, 4) & RTC_MASKS[i];
+    }
+
+    setRegisters(ctx, registers);
+    ctx->stamp = readClock(gb);
+    ctx->latch = 0xFF;
+
+    // Then the UNIX time the footer was saved at
+    u64 saved = readLE(footer + 40, 8);
+    u64 now = time(NULL);
+    if (ctx->clock == RTC_CLOCK_HOST && !ctx->halted && now > saved) {
+        addSeconds(ctx, now - saved);
+    }
+}
+
+/**
+ * Saves the real-time clock to a save file footer.
+ *
+ * @param gb The Game Boy instance.
+ * @param footer The footer (RTC_FOOTER_SIZE bytes).
+ */
+void saveRTC(gb_t *gb, u8 *footer) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    updateRTC(gb);
+
+    u8 registers[5];
+    getRegisters(ctx, registers);
+    for (int i = 0; i < 5; i++) {
+        writeLE(footer + i * 4, registers[i], 4);
+        writeLE(footer + 20 + i * 4, ctx->latched[i], 4);
+    }
+    writeLE(footer + 40, time(NULL), 8);
+}
+
+/**
+ * Writes the latch register. Writing 0 then 1 latches the clock registers.
+ *
+ * @param gb The Game Boy instance.
+ * @param value The value to write.
+ */
+void latchRTC(gb_t *gb, u8 value) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    if (ctx->latch == 0x00 && value == 0x01) {
+        updateRTC(gb);
+        getRegisters(ctx, ctx->latched);
+    }
+
+    ctx->latch = value;
+}
+
+/**
+ * Reads a latched clock register.
+ *
+ * @param gb The Game Boy instance.
+ * @param reg The register (0x08 - 0x0C).
+ * @return The value of the register.
+ */
+u8 readRTC(gb_t *gb, u8 reg) { return gb->rtc.latched[reg - 0x08]; }
+
+/**
+ * Writes a clock register, setting the counter.
+ *
+ * @param gb The Game Boy instance.
+ * @param reg The register (0x08 - 0x0C).
+ * @param value The value to write.
+ */
+void writeRTC(gb_t *gb, u8 reg, u8 value) {
+    rtcContext_t *ctx = &gb->rtc;
+
+    updateRTC(gb);
+
+    u8 registers[5];
+    getRegisters(ctx, registers);
+    registers[reg - 0x08] = value & RTC_MASKS[reg - 0x08];
+    setRegisters(ctx, registers);
+
+    // Writing the seconds also resets the fraction of a second
+    if (reg == 0x08) {
+        ctx->stamp = readClock(gb);
+    }
+}
@@ -0,0 +1,199 @@
+// * Schedules device events by emulator tick, so devices aren't ticked every
+// * cycle.
+
+#include <scheduler.h>
+#include <cpu.h>
+#include <gb.h>
+
+// ===== Helper functions ======================================================
+
+/**
+ * Gets the tick the event at a position of the heap is due at.
+ *
+ * @param ctx The scheduler context.
+ * @param index The position in the heap.
+ * @return The tick.
+ */
+static u64 getHeapTicks(schedulerContext_t *ctx, int index) {
+    return ctx->events[ctx->heap[index]].ticks;
+}
+
+/**
+ * Places an event type at a position of the heap.
+ *
+ * @param ctx The scheduler context.
+ * @param index The position in the heap.
+ * @param type The event type.
+ */
+static void setHeap(schedulerContext_t *ctx, int index, eventType_t type) {
+    ctx->heap[index] = type;
+    ctx->events[type].heapIndex = index;
+}
+
+/**
+ * Moves the event at a position of the heap towards the root until its parent
+ * is due no later than it.
+ *
+ * @param ctx The scheduler context.
+ * @param index The position in the heap.
+ */
+static void siftUp(schedulerContext_t *ctx, int index) {
+    eventType_t type = ctx->heap[index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (getHeapTicks(ctx, parent) <= ctx->events[type].ticks) {
+            break;
+        }
+        setHeap(ctx, index, ctx->heap[parent]);
+        index = parent;
+    }
+
+    setHeap(ctx, index, type);
+}
+
+/**
+ * Moves the event at a position of the heap towards the leaves until its
+ * children are due no earlier than it.
+ *
+ * @param ctx The scheduler context.
+ * @param index The position in the heap.
+ */
+static void siftDown(schedulerContext_t *ctx, int index) {
+    eventType_t type = ctx->heap[index];
+
+    while (true) {
+        int child = index * 2 + 1;
+        if (child >= ctx->size) {
+            break;
+        }
+        if (child + 1 < ctx->size &&
+            getHeapTicks(ctx, child + 1) < getHeapTicks(ctx, child)) {
+            child++;
+        }
+        if (ctx->events[type].ticks <= getHeapTicks(ctx, child)) {
+            break;
+        }
+        setHeap(ctx, index, ctx->heap[child]);
+        index = child;
+    }
+
+    setHeap(ctx, index, type);
+}
+
+// ===== Scheduler functions ===================================================
+
+/**
+ * Removes all scheduled events.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeScheduler(gb_t *gb) {
+    schedulerContext_t *ctx = &gb->scheduler;
+
+    ctx->size = 0;
+
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        ctx->events[i].ticks = 0;
+        ctx->events[i].proc = NULL;
+        ctx->events[i].heapIndex = -1;
+    }
+}
+
+/**
+ * Schedules a device's event, replacing its pending event if there is one.
+ * A running runCPUFor() returns to the scheduler by the time the event is due.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device scheduling the event.
+ * @param ticks The emulator tick the event is due at.
+ * @param proc The handler run once the event is due.
+ */
+void scheduleEvent(gb_t *gb, eventType_t type, u64 ticks, EVENT_PROC proc) {
+    schedulerContext_t *ctx = &gb->scheduler;
+    event_t *event = &ctx->events[type];
+
+    event->ticks = ticks;
+    event->proc = proc;
+
+    if (event->heapIndex < 0) {
+        setHeap(ctx, ctx->size++, type);
+    }
+
+    // The event may have moved either way if it was already scheduled
+    siftUp(ctx, event->heapIndex);
+    siftDown(ctx, event->heapIndex);
+
+    limitCPURun(gb, getNextEventTicks(gb));
+}
+
+/**
+ * Removes a device's pending event, if there is one.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device.
+ */
+void cancelEvent(gb_t *gb, eventType_t type) {
+    schedulerContext_t *ctx = &gb->scheduler;
+    int index = ctx->events[type].heapIndex;
+    if (index < 0) {
+        return;
+    }
+
+    ctx->events[type].heapIndex = -1;
+    if (index == --ctx->size) {
+        return;
+    }
+
+    // Fill the gap with the last event and restore the heap order
+    eventType_t last = ctx->heap[ctx->size];
+    setHeap(ctx, index, last);
+    siftUp(ctx, index);
+    siftDown(ctx, ctx->events[last].heapIndex);
+}
+
+/**
+ * Checks whether a device has a pending event.
+ *
+ * @param gb The Game Boy instance.
+ * @param type The device.
+ * @return Whether the event is scheduled.
+ */
+bool isEventScheduled(gb_t *gb, eventType_t type) {
+    schedulerContext_t *ctx = &gb->scheduler;
+
+    return ctx->events[type].heapIndex >= 0;
+}
+
+/**
+ * Gets the tick the earliest pending event is due at.
+ *
+ * @param gb The Game Boy instance.
+ * @return The tick, or UINT64_MAX if no events are scheduled.
+ */
+u64 getNextEventTicks(gb_t *gb) {
+    schedulerContext_t *ctx = &gb->scheduler;
+
+    return ctx->size ? getHeapTicks(ctx, 0) : UINT64_MAX;
+}
+
+/**
+ * Runs the handlers of all events due by the given tick, earliest first.
+ * Handlers may schedule further events, which also run if they are due.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The current emulator tick.
+ */
+void runScheduledEvents(gb_t *gb, u64 ticks) {
+    schedulerContext_t *ctx = &gb->scheduler;
+
+    while (ctx->size && getHeapTicks(ctx, 0) <= ticks) {
+        eventType_t type = ctx->heap[0];
+        event_t *event = &ctx->events[type];
+        u64 due = event->ticks;
+
+        // Unschedule first, so that the handler can schedule the next event
+        cancelEvent(gb, type);
+        event->proc(gb, due);
+    }
+}
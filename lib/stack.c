@@ -3,47 +3,52 @@
 #include <stack.h>
 #include <cpu.h>
 #include <bus.h>
+#include <gb.h>
 
 // ===== Stack manipulation functions ==========================================
 
 /**
  * Pushes a byte onto the stack.
  *
+ * @param gb The Game Boy instance.
  * @param data The data to push.
  */
-void pushStack(u8 data) {
-    cpuRegisters_t *registers = getCPURegisters();
+void pushStack(gb_t *gb, u8 data) {
+    cpuRegisters_t *registers = &gb->cpu.registers;
     // Decrement the stack pointer
     registers->sp--;
     // Write the data to the bus
-    writeBus(getCPURegisters()->sp, data);
+    writeBus(gb, registers->sp, data);
 }
 
 /**
  * Pops a byte from the stack.
  *
+ * @param gb The Game Boy instance.
  * @return The popped value.
  */
-u8 popStack() { return readBus(getCPURegisters()->sp++); }
+u8 popStack(gb_t *gb) { return readBus(gb, gb->cpu.registers.sp++); }
 
 /**
  * Pushes a 16-bit value onto the stack.
  *
+ * @param gb The Game Boy instance.
  * @param data The data to push.
  */
-void pushStack16(u16 data) {
-    pushStack((data >> 8) & 0xFF);
-    pushStack(data & 0xFF);
+void pushStack16(gb_t *gb, u16 data) {
+    pushStack(gb, (data >> 8) & 0xFF);
+    pushStack(gb, data & 0xFF);
 }
 
 /**
  * Pops a 16-bit value from the stack.
  *
+ * @param gb The Game Boy instance.
  * @return The popped value.
  */
-u16 popStack16() {
-    u16 lo = popStack();
-    u16 hi = popStack();
+u16 popStack16(gb_t *gb) {
+    u16 lo = popStack(gb);
+    u16 hi = popStack(gb);
 
     return (hi << 8) | lo;
-}
\ No newline at end of file
+}
@@ -1,5 +1,276 @@
+// * Emulates the timer (DIV, TIMA, TMA and TAC) lazily, from emulator ticks.
+
 #include <timer.h>
+#include <emu.h>
+#include <cpu.h>
+#include <interrupts.h>
+#include <scheduler.h>
+#include <io.h>
+#include <gb.h>
+
+/**
+ * The timer is driven by a 16-bit divider counter, incremented every tick.
+ * DIV is its upper byte, and TIMA is incremented on every falling edge of the
+ * divider bit selected by TAC. Both are worked out from the tick they were
+ * last written at, and only one event is scheduled, for the TIMA reload after
+ * an overflow.
+ */
+
+// Divider bits whose falling edges increment TIMA, by TAC clock select
+static const u8 TIMER_BITS[4] = {9, 3, 5, 7};
+
+// Ticks from a TIMA overflow until it is reloaded from TMA (1 CPU cycle)
+#define TIMER_RELOAD_TICKS 4
+
+// ===== Helper functions ======================================================
+
+/**
+ * Checks whether TIMA is counting.
+ *
+ * @param ctx The timer context.
+ * @return Whether the timer is enabled in TAC.
+ */
+static bool isTimerEnabled(timerContext_t *ctx) { return ctx->tac & 0x04; }
+
+/**
+ * Gets the number of ticks between falling edges of the selected divider bit.
+ *
+ * @param ctx The timer context.
+ * @return The period of TIMA increments, in ticks.
+ */
+static u64 getTimerPeriod(timerContext_t *ctx) {
+    return 2u << TIMER_BITS[ctx->tac & 0x03];
+}
+
+/**
+ * Gets the tick at which TIMA overflows, counting from ctx->timaTicks.
+ *
+ * @param ctx The timer context.
+ * @return The emulator tick of the overflow.
+ */
+static u64 getOverflowTicks(timerContext_t *ctx) {
+    u64 period = getTimerPeriod(ctx);
+    u64 counter = ctx->timaTicks + ctx->divOffset;
+
+    // TIMA overflows on the falling edge taking it past 0xFF
+    return (counter / period + 0x100 - ctx->tima) * period - ctx->divOffset;
+}
+
+/**
+ * Brings TIMA up to date with the given tick, overflowing and reloading it
+ * from TMA (which requests the timer interrupt) as many times as needed.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick.
+ */
+static void updateTimer(gb_t *gb, u64 ticks) {
+    timerContext_t *ctx = &gb->timer;
+
+    while (true) {
+        if (ctx->reloading) {
+            // TIMA reads as 0 for a cycle before it's reloaded
+            if (ticks < ctx->reloadTicks) {
+                return;
+            }
+
+            ctx->tima = ctx->tma;
+            ctx->reloading = false;
+            ctx->timaTicks = ctx->reloadTicks;
+            setCPUInterruptFlags(gb, getCPUInterruptFlags(gb) | INT_TIMER);
+        }
+
+        if (!isTimerEnabled(ctx)) {
+            ctx->timaTicks = ticks;
+            return;
+        }
+
+        // Count the falling edges since TIMA was last brought up to date
+        u64 period = getTimerPeriod(ctx);
+        u64 edges = (ticks + ctx->divOffset) / period -
+                    (ctx->timaTicks + ctx->divOffset) / period;
+        if (ctx->tima + edges <= 0xFF) {
+            ctx->tima += edges;
+            ctx->timaTicks = ticks;
+            return;
+        }
+
+        ctx->timaTicks = getOverflowTicks(ctx);
+        ctx->reloadTicks = ctx->timaTicks + TIMER_RELOAD_TICKS;
+        ctx->reloading = true;
+        ctx->tima = 0;
+    }
+}
+
+/**
+ * Increments TIMA outside of the divider's falling edges. The edge detector
+ * sees a falling edge when a DIV reset or TAC write clears its input.
+ *
+ * @param ctx The timer context.
+ * @param ticks The emulator tick.
+ */
+static void incrementTimer(timerContext_t *ctx, u64 ticks) {
+    if (ctx->reloading) {
+        return;
+    }
+
+    if (ctx->tima == 0xFF) {
+        ctx->tima = 0;
+        ctx->reloading = true;
+        ctx->reloadTicks = ticks + TIMER_RELOAD_TICKS;
+    } else {
+        ctx->tima++;
+    }
+}
+
+/**
+ * Gets the input of the TIMA edge detector: the selected divider bit, if the
+ * timer is enabled.
+ *
+ * @param ctx The timer context.
+ * @param ticks The emulator tick.
+ * @return The input of the edge detector.
+ */
+static bool getTimerInput(timerContext_t *ctx, u64 ticks) {
+    return isTimerEnabled(ctx) &&
+           (((ticks + ctx->divOffset) >> TIMER_BITS[ctx->tac & 0x03]) & 1);
+}
+
+static void handleTimerEvent(gb_t *gb, u64 ticks);
+
+/**
+ * Schedules an event for the next TIMA reload, which requests the timer
+ * interrupt. Called whenever the timer registers change.
+ *
+ * @param gb The Game Boy instance.
+ */
+static void scheduleTimerEvent(gb_t *gb) {
+    timerContext_t *ctx = &gb->timer;
+
+    if (ctx->reloading) {
+        scheduleEvent(gb, EVENT_TIMER, ctx->reloadTicks, handleTimerEvent);
+    } else if (isTimerEnabled(ctx)) {
+        scheduleEvent(gb, EVENT_TIMER,
+                      getOverflowTicks(ctx) + TIMER_RELOAD_TICKS,
+                      handleTimerEvent);
+    } else {
+        cancelEvent(gb, EVENT_TIMER);
+    }
+}
+
+/**
+ * Handles the scheduled TIMA reload.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick the reload was due at.
+ */
+static void handleTimerEvent(gb_t *gb, u64 ticks) {
+    // The event may run late, and TIMA may have been read since it was due
+    updateTimer(gb, gb->emu.ticks);
+    scheduleTimerEvent(gb);
+}
+
+// ===== Timer functions =======================================================
+
+/**
+ * Initializes the timer to its state after the boot ROM and registers its I/O
+ * registers. Called once the emulator tick is reset.
+ *
+ * @param gb The Game Boy instance.
+ */
+void initializeTimer(gb_t *gb) {
+    timerContext_t *ctx = &gb->timer;
+
+    u64 ticks = gb->emu.ticks;
+
+    // The divider counter reads 0xABCC after the boot ROM
+    ctx->divOffset = (0xABCC - ticks) & 0xFFFF;
+    ctx->timaTicks = ticks;
+    ctx->reloadTicks = ticks - TIMER_RELOAD_TICKS;  // As if reloaded long ago
+    ctx->reloading = false;
+    ctx->tima = 0;
+    ctx->tma = 0;
+    ctx->tac = 0;
+
+    cancelEvent(gb, EVENT_TIMER);
+
+    for (u16 address = 0xFF04; address <= 0xFF07; address++) {
+        mapIORegister(gb, address, 0x00, readTimer, writeTimer);
+    }
+}
+
+/**
+ * Reads a timer register (DIV, TIMA, TMA or TAC).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read from (0xFF04-0xFF07).
+ * @return The value of the register.
+ */
+u8 readTimer(gb_t *gb, u16 address) {
+    timerContext_t *ctx = &gb->timer;
+
+    u64 ticks = gb->emu.ticks;
+
+    switch (address) {
+        case 0xFF04:  // DIV
+            return (ticks + ctx->divOffset) >> 8;
+        case 0xFF05:  // TIMA
+            updateTimer(gb, ticks);
+            return ctx->tima;
+        case 0xFF06:  // TMA
+            return ctx->tma;
+        default:  // TAC - Unused bits read as 1
+            return ctx->tac | 0xF8;
+    }
+}
+
+/**
+ * Writes a timer register (DIV, TIMA, TMA or TAC).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to write to (0xFF04-0xFF07).
+ * @param value The value to write.
+ */
+void writeTimer(gb_t *gb, u16 address, u8 value) {
+    timerContext_t *ctx = &gb->timer;
+
+    u64 ticks = gb->emu.ticks;
+    updateTimer(gb, ticks);
+
+    // Whether TIMA was reloaded from TMA during this cycle
+    bool reloaded =
+        !ctx->reloading && ticks - ctx->reloadTicks < TIMER_RELOAD_TICKS;
 
-void initializeTimer() {}
+    switch (address) {
+        case 0xFF04:  // DIV - Any write resets the divider counter
+            if (getTimerInput(ctx, ticks)) {
+                incrementTimer(ctx, ticks);
+            }
+            ctx->divOffset = (0 - ticks) & 0xFFFF;
+            break;
+        case 0xFF05:  // TIMA
+            // Writing during the overflow cycle cancels the reload, and
+            // writing during the reload cycle is ignored
+            if (!reloaded) {
+                ctx->reloading = false;
+                ctx->tima = value;
+            }
+            break;
+        case 0xFF06:  // TMA - Also goes to TIMA during the reload cycle
+            ctx->tma = value;
+            if (reloaded) {
+                ctx->tima = value;
+            }
+            break;
+        default: {  // TAC
+            bool input = getTimerInput(ctx, ticks);
+            ctx->tac = value & 0x07;
+            if (input && !getTimerInput(ctx, ticks)) {
+                incrementTimer(ctx, ticks);
+            }
+            break;
+        }
+    }
 
-void tickTimer() {}
+    ctx->timaTicks = ticks;
+    scheduleTimerEvent(gb);
+}
@@ -0,0 +1,298 @@
+// * Records executed instructions into an in-memory ring for debugging.
+
+#include <gb.h>
+#include <instructions.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Traced instances the exit and crash handlers can dump at once
+#define TRACE_MAX_RINGS 16
+
+// ===== Globals ===============================================================
+
+// Rings of the instances that are tracing, for the exit and crash handlers,
+// which can't be told which instance they are for
+static _Atomic(traceContext_t *) rings[TRACE_MAX_RINGS];
+
+// Installs the exit and crash handlers once per process
+static pthread_once_t handlersOnce = PTHREAD_ONCE_INIT;
+
+// Signals that dump the ring before the emulator dies
+static const int CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+// ===== Helper functions ======================================================
+
+/**
+ * Writes a buffer to a file descriptor, retrying on short writes.
+ *
+ * @param fd The file descriptor.
+ * @param data The data to write.
+ * @param size The number of bytes to write.
+ * @return Whether all bytes were written.
+ */
+static bool writeAll(int fd, const void *data, size_t size) {
+    const u8 *bytes = data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/**
+ * Writes the contents of a ring to a file, oldest record first.
+ * Only uses async-signal-safe calls, so that it can run from a crash handler.
+ *
+ * @param ctx The trace context.
+ * @param path The file to write, or NULL for the path given to startTrace().
+ * @return Whether the dump was written.
+ */
+static bool dumpRing(traceContext_t *ctx, const char *path) {
+    traceRecord_t *ring = ctx->records;
+    if (!ring) {
+        return false;
+    }
+
+    u64 head = atomic_load_explicit(&ctx->head, memory_order_acquire);
+    u64 capacity = (u64)ctx->mask + 1;
+    u64 count = head < capacity ? head : capacity;
+
+    traceFileHeader_t header = {TRACE_MAGIC, TRACE_VERSION,
+                                sizeof(traceRecord_t), count};
+
+    int fd = open(path ? path : ctx->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // The oldest record may sit anywhere in the ring, so write in two parts.
+    // Records written while dumping from another thread may appear torn.
+    u64 oldest = (head - count) & ctx->mask;
+    u64 firstPart = capacity - oldest < count ? capacity - oldest : count;
+    bool ok = writeAll(fd, &header, sizeof(header)) &&
+              writeAll(fd, &ring[oldest], firstPart * sizeof(traceRecord_t)) &&
+              writeAll(fd, ring, (count - firstPart) * sizeof(traceRecord_t));
+
+    close(fd);
+    return ok;
+}
+
+/**
+ * Dumps the ring of every instance that is still tracing.
+ */
+static void dumpAllRings() {
+    for (int i = 0; i < TRACE_MAX_RINGS; i++) {
+        traceContext_t *ctx = atomic_load(&rings[i]);
+        if (ctx) {
+            dumpRing(ctx, NULL);
+        }
+    }
+}
+
+/**
+ * Dumps the rings when the emulator crashes, then lets the signal proceed.
+ *
+ * @param signal The signal received.
+ */
+static void dumpTraceOnCrash(int signal) {
+    dumpAllRings();
+
+    // Restore the default action and re-raise to crash as usual
+    struct sigaction action = {0};
+    action.sa_handler = SIG_DFL;
+    sigaction(signal, &action, NULL);
+    raise(signal);
+}
+
+/**
+ * Installs the exit and crash handlers that dump the rings.
+ */
+static void installHandlers() {
+    atexit(dumpAllRings);
+
+    struct sigaction action = {0};
+    action.sa_handler = dumpTraceOnCrash;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(CRASH_SIGNALS) / sizeof(int); i++) {
+        sigaction(CRASH_SIGNALS[i], &action, NULL);
+    }
+}
+
+/**
+ * Reads a byte of the instruction being recorded without going through the
+ * bus handlers, which may have side effects (e.g. on I/O registers).
+ *
+ * @param gb The Game Boy instance.
+ * @param address The address to read.
+ * @return The byte, or 0 on pages only read through handlers other than
+ * high RAM.
+ */
+static u8 peekBus(gb_t *gb, u16 address) {
+    const u8 *page = gb->bus.readPages[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+
+    // Code often runs from high RAM, which is read without side effects
+    if (address >= 0xFF80 && address < 0xFFFF) {
+        return gb->ram.hram[address - 0xFF80];
+    }
+
+    return 0;
+}
+
+// ===== Trace functions =======================================================
+
+/**
+ * Starts recording instructions into a ring holding the most recent ones.
+ * The ring is dumped to the given path when the instance is destroyed, or if
+ * the emulator crashes or exits first.
+ *
+ * @param gb The Game Boy instance.
+ * @param records The number of instructions to keep (rounded up to a power
+ * of two).
+ * @param path The file to dump the ring to, or NULL for TRACE_DEFAULT_PATH.
+ * @return Whether tracing was started.
+ */
+bool startTrace(gb_t *gb, u32 records, const char *path) {
+    traceContext_t *ctx = &gb->trace;
+
+    if (records == 0 || records > (1u << 31)) {
+        return false;
+    }
+
+    // Round up to a power of two so that wrapping is a mask
+    u32 capacity = 1;
+    while (capacity < records) {
+        capacity <<= 1;
+    }
+
+    traceRecord_t *ring = calloc(capacity, sizeof(traceRecord_t));
+    if (!ring) {
+        return false;
+    }
+
+    stopTrace(gb);
+    snprintf(ctx->path, sizeof(ctx->path), "%s",
+             path ? path : TRACE_DEFAULT_PATH);
+    ctx->mask = capacity - 1;
+    atomic_store(&ctx->head, 0);
+    ctx->records = ring;
+
+    // Past TRACE_MAX_RINGS, rings are only dumped when their instance is
+    pthread_once(&handlersOnce, installHandlers);
+    for (int i = 0; i < TRACE_MAX_RINGS; i++) {
+        traceContext_t *empty = NULL;
+        if (atomic_compare_exchange_strong(&rings[i], &empty, ctx)) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Stops recording instructions and frees the ring.
+ *
+ * @param gb The Game Boy instance.
+ */
+void stopTrace(gb_t *gb) {
+    traceContext_t *ctx = &gb->trace;
+    traceRecord_t *ring = ctx->records;
+
+    for (int i = 0; i < TRACE_MAX_RINGS; i++) {
+        traceContext_t *registered = ctx;
+        atomic_compare_exchange_strong(&rings[i], &registered, NULL);
+    }
+
+    ctx->records = NULL;
+    free(ring);
+}
+
+/**
+ * Records the instruction the CPU is about to execute. Its bytes are read
+ * without side effects, so those on I/O pages are recorded as 0.
+ *
+ * @param cpu The CPU context, before the instruction is fetched.
+ */
+void recordTrace(cpuContext_t *cpu) {
+    gb_t *gb = cpu->gb;
+    traceContext_t *ctx = &gb->trace;
+
+    // Only the CPU thread writes, so the head can be read relaxed
+    u64 head = atomic_load_explicit(&ctx->head, memory_order_relaxed);
+    traceRecord_t *record = &ctx->records[head & ctx->mask];
+    u16 pc = cpu->registers.pc;
+
+    materializeCPUFlags(cpu);
+
+    record->ticks = gb->emu.ticks;
+    record->pc = pc;
+    record->sp = cpu->registers.sp;
+    record->opcode = peekBus(gb, pc);
+    record->operands[0] = peekBus(gb, pc + 1);
+    record->operands[1] = peekBus(gb, pc + 2);
+    record->a = cpu->registers.a;
+    record->f = cpu->registers.f;
+    record->b = cpu->registers.b;
+    record->c = cpu->registers.c;
+    record->d = cpu->registers.d;
+    record->e = cpu->registers.e;
+    record->h = cpu->registers.h;
+    record->l = cpu->registers.l;
+    record->reserved = 0;
+
+    // Publish the record to readers on other threads
+    atomic_store_explicit(&ctx->head, head + 1, memory_order_release);
+}
+
+/**
+ * Writes the contents of the ring to a file, oldest record first.
+ * Only uses async-signal-safe calls, so that it can run from a crash handler.
+ *
+ * @param gb The Game Boy instance.
+ * @param path The file to write, or NULL for the path given to startTrace().
+ * @return Whether the dump was written.
+ */
+bool dumpTrace(gb_t *gb, const char *path) {
+    return dumpRing(&gb->trace, path);
+}
+
+/**
+ * Renders a trace record in the emulator's text trace format.
+ *
+ * @param record The record to render.
+ * @param str The string to write to.
+ * @param size The size of the string buffer.
+ */
+void traceRecordToString(const traceRecord_t *record, char *str, size_t size) {
+    char instruction[32];
+    instructionToString(record->opcode, record->operands, instruction);
+
+    char flags[5];
+    sprintf(flags, "%c%c%c%c", BIT(record->f, 7) ? 'Z' : '-',
+            BIT(record->f, 6) ? 'N' : '-', BIT(record->f, 5) ? 'H' : '-',
+            BIT(record->f, 4) ? 'C' : '-');
+
+    snprintf(str, size,
+             "PC %s%08X%s: %s%-16s%s (%s%02X%s %s%02X %02X%s) | "
+             "A=%s%02X%s BC=%s%02X%02X%s DE=%s%02X%02X%s HL=%s%02X%02X%s "
+             "SP=%s%04X%s | F=%s%02X%s (%s%s%s) | (t=%08llx)",
+             CMAG, record->pc, CRST, CBLU, instruction, CRST, CCYN,
+             record->opcode, CRST, CMAG, record->operands[0],
+             record->operands[1], CRST, CMAG, record->a, CRST, CMAG, record->b,
+             record->c, CRST, CMAG, record->d, record->e, CRST, CMAG,
+             record->h, record->l, CRST, CMAG, record->sp, CRST, CMAG,
+             record->f, CRST, CBLU, flags, CRST,
+             (unsigned long long)record->ticks);
+}
@@ -1,7 +1,8 @@
 // * Handles UI (and rendering).
 
 #include <ui.h>
-#include <emu.h>
+#include <gb.h>
+#include <pthread.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
@@ -12,6 +13,27 @@ SDL_Renderer *sdlRenderer;
 SDL_Texture *sdlTexture;
 SDL_Surface *sdlSurface;
 
+bool uiPaused;          // Whether the UI paused the emulator
+u8 uiButtons;           // Joypad buttons held down
+u64 uiReportFrame;      // Frame of the last report shown in the title
+u64 uiReportTime;       // Time of the last report shown in the title
+u64 uiMaxInputLatency;  // Longest input latency since the title was updated
+
+// Keys mapped to joypad buttons
+static const struct {
+    SDL_Keycode key;
+    button_t button;
+} KEY_BUTTONS[] = {
+    {SDLK_RIGHT, BUTTON_RIGHT},
+    {SDLK_LEFT, BUTTON_LEFT},
+    {SDLK_UP, BUTTON_UP},
+    {SDLK_DOWN, BUTTON_DOWN},
+    {SDLK_x, BUTTON_A},
+    {SDLK_z, BUTTON_B},
+    {SDLK_BACKSPACE, BUTTON_SELECT},
+    {SDLK_RETURN, BUTTON_START},
+};
+
 // ===== Helper functions ======================================================
 
 /**
@@ -21,6 +43,97 @@ SDL_Surface *sdlSurface;
  */
 void delay(u32 ms) { SDL_Delay(ms); }
 
+/**
+ * Handles a key being pressed or released. P pauses and resumes the
+ * emulator, and the joypad buttons are sent to the CPU thread as they change.
+ *
+ * @param gb The Game Boy instance shown by the UI.
+ * @param key The key.
+ * @param pressed Whether the key was pressed.
+ */
+static void handleKey(gb_t *gb, SDL_Keycode key, bool pressed) {
+    if (key == SDLK_p && pressed) {
+        uiPaused = !uiPaused;
+        if (uiPaused) {
+            pauseEmulator(gb);
+        } else {
+            resumeEmulator(gb);
+        }
+        return;
+    }
+
+    for (u32 i = 0; i < sizeof(KEY_BUTTONS) / sizeof(*KEY_BUTTONS); i++) {
+        if (KEY_BUTTONS[i].key == key) {
+            if (pressed) {
+                uiButtons |= KEY_BUTTONS[i].button;
+            } else {
+                uiButtons &= ~KEY_BUTTONS[i].button;
+            }
+            setEmulatorButtons(gb, uiButtons);
+        }
+    }
+}
+
+/**
+ * Presents the newest frame the CPU thread published, or the last one again,
+ * scaled by a whole factor and centered in the window.
+ *
+ * @param gb The Game Boy instance shown by the UI.
+ */
+static void presentFrame(gb_t *gb) {
+    const u32 *pixels = takeFrame(gb, NULL);
+    SDL_UpdateTexture(sdlTexture, NULL, pixels, FRAME_WIDTH * sizeof(u32));
+
+    int scale = SCREEN_WIDTH / FRAME_WIDTH < SCREEN_HEIGHT / FRAME_HEIGHT
+                    ? SCREEN_WIDTH / FRAME_WIDTH
+                    : SCREEN_HEIGHT / FRAME_HEIGHT;
+    SDL_Rect screen = {
+        .x = (SCREEN_WIDTH - FRAME_WIDTH * scale) / 2,
+        .y = (SCREEN_HEIGHT - FRAME_HEIGHT * scale) / 2,
+        .w = FRAME_WIDTH * scale,
+        .h = FRAME_HEIGHT * scale,
+    };
+
+    SDL_RenderClear(sdlRenderer);
+    SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, &screen);
+    SDL_RenderPresent(sdlRenderer);
+}
+
+/**
+ * Shows the frame rate and input latency of the frames reported since the
+ * title was last updated, about once a second.
+ *
+ * @param gb The Game Boy instance shown by the UI.
+ */
+static void handleFrameReports(gb_t *gb) {
+    frameReport_t report;
+    bool received = false;
+    while (receiveFrameReport(gb, &report)) {
+        if (report.inputLatency > uiMaxInputLatency) {
+            uiMaxInputLatency = report.inputLatency;
+        }
+        received = true;
+    }
+
+    if (!received || report.time - uiReportTime < 1000000000ull) {
+        return;
+    }
+
+    // The first report only starts the count
+    if (uiReportTime) {
+        char title[64];
+        snprintf(title, sizeof(title), "gbemu - %.2f FPS, input %.1f ms",
+                 (report.frame - uiReportFrame) * 1e9 /
+                     (report.time - uiReportTime),
+                 uiMaxInputLatency / 1e6);
+        SDL_SetWindowTitle(sdlWindow, title);
+    }
+
+    uiReportFrame = report.frame;
+    uiReportTime = report.time;
+    uiMaxInputLatency = 0;
+}
+
 // ===== UI functions ==========================================================
 
 /**
@@ -53,17 +166,84 @@ void initializeUI() {
     // Initialize window and renderer
     SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, &sdlWindow,
                                 &sdlRenderer);
+
+    // Frames are streamed into a texture the size of the Game Boy's screen
+    sdlTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_ARGB8888,
+                                   SDL_TEXTUREACCESS_STREAMING, FRAME_WIDTH,
+                                   FRAME_HEIGHT);
 }
 
 /**
- * Handles UI events.
+ * Waits for UI events, for up to UI_FRAME_TIMEOUT_MS (or UI_EVENT_TIMEOUT_MS
+ * while paused), and handles them. Then presents the newest frame and handles
+ * the CPU thread's frame reports.
+ *
+ * @param gb The Game Boy instance shown by the UI.
  */
-void handleUIEvents() {
+void handleUIEvents(gb_t *gb) {
     SDL_Event event;
-    while (SDL_PollEvent(&event) > 0) {
-        if (event.type == SDL_WINDOWEVENT &&
-            event.window.event == SDL_WINDOWEVENT_CLOSE) {
-            getEMUContext()->die = true;
-        }
+    int timeout = uiPaused ? UI_EVENT_TIMEOUT_MS : UI_FRAME_TIMEOUT_MS;
+    if (SDL_WaitEventTimeout(&event, timeout)) {
+        do {
+            if (event.type == SDL_WINDOWEVENT &&
+                event.window.event == SDL_WINDOWEVENT_CLOSE) {
+                exitEmulator(gb);
+            } else if ((event.type == SDL_KEYDOWN ||
+                        event.type == SDL_KEYUP) &&
+                       !event.key.repeat) {
+                handleKey(gb, event.key.keysym.sym,
+                          event.type == SDL_KEYDOWN);
+            }
+        } while (SDL_PollEvent(&event) > 0);
     }
-}
\ No newline at end of file
+
+    presentFrame(gb);
+    handleFrameReports(gb);
+}
+
+// ===== Emulator functions ====================================================
+
+/**
+ * Runs the emulator system with the given arguments, in a window.
+ * Acts as a secondary entry point to the emulator.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int runEmulator(int argc, char **argv) {
+    gb_t *gb = openEmulator(argc, argv);
+    if (!gb) {
+        return EXIT_FAILURE;
+    }
+
+    // Initialize UI
+    initializeUI();
+
+    // Initialize CPU thread, which runs at the Game Boy's frame rate
+    pthread_t cpuThread;
+    gb->emu.running = true;
+    gb->emu.paused = false;
+    setFramePacing(gb, true);
+    if (pthread_create(&cpuThread, NULL, runCPU, gb)) {
+        printf("%sERR:%s Failed to create CPU thread.\n", CRED, CRST);
+        destroyGB(gb);
+        return EXIT_FAILURE;
+    }
+
+    // Handle UI events until the window is closed or the CPU exits
+    while (!isEmulatorExiting(gb)) {
+        handleUIEvents(gb);
+    }
+
+    // Stop the CPU before its instance goes away, which flushes the save
+    stopEmulator(gb);
+    pthread_join(cpuThread, NULL);
+
+    printPacerStats(gb);
+    printFrameStats(gb);
+    printUnhandledIO(gb);
+    destroyGB(gb);
+
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,1149 @@
 #include <check.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <emu.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <gb.h>
 
-#include <cpu.h>
+#include <catalog.h>
+#include <interrupts.h>
 
-START_TEST(test_nothing) { stepCPU(); }
+// Directory of the test ROMs, set by the build
+#ifndef ROMS_DIR
+#define ROMS_DIR "roms"
+#endif
+
+START_TEST(test_nothing) {
+    gb_t *gb = createGB();
+    stepCPU(gb);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_handler_table) {
+    for (int opcode = 0; opcode < 0x100; opcode++) {
+        ck_assert_ptr_nonnull(getHandlerForOpcode(opcode));
+    }
+}
+END_TEST
+
+START_TEST(test_lazy_flags) {
+    cpuContext_t cpu = {0};
+
+    // 0x10 - 0x01 borrows from bit 4 only, and keeps the low nibble of F
+    cpu.registers.f = 0x0F;
+    cpu.lazyFlags = (lazyFlags_t){FLAGS_SUB, 0x10, 0x01, 0, 0x0F};
+    ck_assert_uint_eq(readRegister(&cpu, RT_F), 0x6F);
+    ck_assert_uint_eq(cpu.lazyFlags.op, FLAGS_NONE);
+
+    // INC keeps the carry flag
+    cpu.registers.f = 0x10;
+    cpu.lazyFlags = (lazyFlags_t){FLAGS_INC, 0, 0, 0, 0x00};
+    ck_assert_uint_eq(readRegister(&cpu, RT_F), 0xB0);
+}
+END_TEST
+
+// Ticks at which the scheduler test's events ran, in order
+static u64 eventLog[4];
+static int eventCount;
+
+static void logEvent(gb_t *gb, u64 ticks) { eventLog[eventCount++] = ticks; }
+
+START_TEST(test_scheduler) {
+    gb_t *gb = createGB();
+    eventCount = 0;
+
+    scheduleEvent(gb, EVENT_TIMER, 300, logEvent);
+    scheduleEvent(gb, EVENT_PPU, 100, logEvent);
+    scheduleEvent(gb, EVENT_SERIAL, 200, logEvent);
+    scheduleEvent(gb, EVENT_DMA, 50, logEvent);
+    cancelEvent(gb, EVENT_DMA);
+    scheduleEvent(gb, EVENT_TIMER, 150, logEvent);  // Rescheduled earlier
+    ck_assert_uint_eq(getNextEventTicks(gb), 100);
+
+    runScheduledEvents(gb, 199);
+    ck_assert_int_eq(eventCount, 2);
+    ck_assert_uint_eq(eventLog[0], 100);
+    ck_assert_uint_eq(eventLog[1], 150);
+    ck_assert(isEventScheduled(gb, EVENT_SERIAL));
+    ck_assert(!isEventScheduled(gb, EVENT_DMA));
+
+    runScheduledEvents(gb, 1000);
+    ck_assert_int_eq(eventCount, 3);
+    ck_assert_uint_eq(getNextEventTicks(gb), UINT64_MAX);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_timer) {
+    gb_t *gb = createGB();
+    emuContext_t *emu = getEMUContext(gb);
+
+    // DIV counts from 0xABCC after the boot ROM
+    ck_assert_uint_eq(readTimer(gb, 0xFF04), 0xAB);
+    writeTimer(gb, 0xFF04, 0);
+    writeTimer(gb, 0xFF06, 0x10);
+    writeTimer(gb, 0xFF05, 0xFF);
+    writeTimer(gb, 0xFF07, 0x05);  // Enabled, increments every 16 ticks
+
+    // TIMA reads 0 for a cycle after overflowing, then is reloaded from TMA
+    emu->ticks = 16;
+    ck_assert_uint_eq(readTimer(gb, 0xFF05), 0x00);
+    ck_assert_uint_eq(getNextEventTicks(gb), 20);
+    emu->ticks = 20;
+    ck_assert_uint_eq(readTimer(gb, 0xFF05), 0x10);
+    ck_assert_uint_eq(getCPUInterruptFlags(gb), INT_TIMER);
+
+    // Resetting DIV while the selected bit is set increments TIMA
+    emu->ticks = 24;
+    writeTimer(gb, 0xFF04, 0);
+    ck_assert_uint_eq(readTimer(gb, 0xFF05), 0x11);
+    destroyGB(gb);
+}
+END_TEST
+
+// Branches both ways, calls, stack and (HL) operations: 30 CPU cycles in all
+static const u8 CYCLE_PROGRAM[] = {
+    0xAF,              // XOR A          1
+    0x20, 0x00,        // JR NZ,+0       2 (not taken)
+    0x28, 0x00,        // JR Z,+0        3 (taken)
+    0xCD, 0x0A, 0xC0,  // CALL 0xC00A    6
+    0x18, 0xFE,        // JR -2
+    0xCB, 0x46,        // BIT 0,(HL)     3
+    0xC5,              // PUSH BC        4
+    0xC1,              // POP BC         3
+    0xF8, 0x00,        // LD HL,SP+0     3 (clears carry)
+    0xD0,              // RET NC         5 (taken)
+};
+
+/**
+ * Runs the cycle test program in WRAM of an instance with a cycle model.
+ *
+ * @param gb The Game Boy instance, just reset.
+ * @param mode The cycle model.
+ * @return The number of ticks the program took.
+ */
+static u64 runCycleProgram(gb_t *gb, cycleMode_t mode) {
+    emuContext_t *emu = getEMUContext(gb);
+    setCPUCycleMode(gb, mode);
+
+    for (u16 i = 0; i < sizeof(CYCLE_PROGRAM); i++) {
+        writeBus(gb, 0xC000 + i, CYCLE_PROGRAM[i]);
+    }
+    cpuRegisters_t *registers = getCPURegisters(gb);
+    registers->pc = 0xC000;
+    registers->sp = 0xD000;
+    registers->hl = 0xC100;
+
+    for (int i = 0; i < 9; i++) {
+        stepCPU(gb);
+    }
+    ck_assert_uint_eq(registers->pc, 0xC008);
+
+    setCPUCycleMode(gb, CYCLES_ACCURATE);
+    return emu->ticks;
+}
+
+START_TEST(test_cycle_modes) {
+    gb_t *gb = createGB();
+    ck_assert_uint_eq(runCycleProgram(gb, CYCLES_ACCURATE), 30 * 4);
+    resetGB(gb);
+    ck_assert_uint_eq(runCycleProgram(gb, CYCLES_FAST), 30 * 4);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_mem_timing) {
+    const cpuCore_t cores[] = {CORE_TABLE, CORE_BLOCK, CORE_JIT};
+
+    // Reads and writes land on the cycle they take, which the test ROM
+    // checks against the timer
+    for (int i = 0; i < 3; i++) {
+        gb_t *gb = createGB();
+        setCPUCore(gb, cores[i]);
+        ck_assert(loadCartridge(gb, ROMS_DIR "/mem_timing.gb"));
+        mapCartridge(gb);
+
+        // The ROM reports its results over the serial port, ending with
+        // "Passed all tests" or "Failed n tests."
+        for (int frame = 0; frame < 600; frame++) {
+            runCPUFor(gb, 17556);
+            if (strstr(gb->dbg.message, "tests")) {
+                break;
+            }
+        }
+        ck_assert_ptr_nonnull(strstr(gb->dbg.message, "Passed all tests"));
+
+        unloadCartridge(gb);
+        destroyGB(gb);
+    }
+}
+END_TEST
+
+/**
+ * Stops the CPU from a scheduled event.
+ *
+ * @param gb The Game Boy instance.
+ * @param ticks The emulator tick the event ran at.
+ */
+static void stopAtEvent(gb_t *gb, u64 ticks) { stopCPU(gb); }
+
+/**
+ * Stops the CPU from another thread, once it has had time to start running.
+ *
+ * @param gb The Game Boy instance.
+ * @return NULL.
+ */
+static void *stopAfterDelay(void *gb) {
+    usleep(20000);
+    stopCPU(gb);
+    return NULL;
+}
+
+START_TEST(test_cpu_budget) {
+    gb_t *gb = createGB();
+    emuContext_t *emu = getEMUContext(gb);
+
+    writeBus(gb, 0xC000, 0x03);  // INC BC
+    writeBus(gb, 0xC001, 0x18);  // JR -3
+    writeBus(gb, 0xC002, 0xFD);
+    getCPURegisters(gb)->pc = 0xC000;
+
+    // Budgets end with the instruction that spends them
+    ck_assert_uint_eq(runCPUFor(gb, 101), 102);
+    ck_assert_uint_eq(emu->ticks, 102 * 4);
+
+    // A stop made between runs is honored by the next one, then cleared
+    stopCPU(gb);
+    ck_assert_uint_eq(runCPUFor(gb, 100), 0);
+    ck_assert_uint_eq(runCPUFor(gb, 98), 98);
+
+    // Stops made by event handlers return at the event
+    scheduleEvent(gb, EVENT_SERIAL, emu->ticks + 30 * 4, stopAtEvent);
+    ck_assert_uint_eq(runCPUFor(gb, 1000), 30);
+    ck_assert_uint_eq(runCPUFor(gb, 10), 10);
+
+    // Other threads stop every core between instructions, without waiting
+    // for an event
+    const cpuCore_t cores[] = {CORE_TABLE, CORE_BLOCK, CORE_JIT};
+    for (int i = 0; i < 3; i++) {
+        pthread_t thread;
+        setCPUCore(gb, cores[i]);
+        ck_assert_uint_eq(getNextEventTicks(gb), UINT64_MAX);
+        ck_assert_int_eq(pthread_create(&thread, NULL, stopAfterDelay, gb), 0);
+        ck_assert_uint_lt(runCPUFor(gb, 1ull << 40), 1ull << 40);
+        pthread_join(thread, NULL);
+        ck_assert(!atomic_load(&gb->cpu.stopping));
+        ck_assert_uint_ge(getCPURegisters(gb)->pc, 0xC000);
+        ck_assert_uint_le(getCPURegisters(gb)->pc, 0xC002);
+    }
+    destroyGB(gb);
+}
+END_TEST
+
+/**
+ * Writes a ROM whose banks start with their bank number.
+ *
+ * @param path The template for the ROM file name, replaced with the name.
+ * @param banks The number of 16 KiB banks.
+ * @param type The cartridge type.
+ * @param RAMSize The RAM size code.
+ */
+static void writeBankedROM(char *path, u16 banks, u8 type, u8 RAMSize) {
+    int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(ftruncate(fd, banks * 0x4000), 0);
+
+    u8 header[3] = {type, 0, RAMSize};
+    ck_assert_int_eq(pwrite(fd, header, 3, 0x147), 3);
+    for (u16 bank = 1; bank < banks; bank++) {
+        u8 number[2] = {bank & 0xFF, bank >> 8};
+        ck_assert_int_eq(pwrite(fd, number, 2, bank * 0x4000), 2);
+    }
+    close(fd);
+}
+
+/**
+ * Runs the cycle test program on an instance of its own, from a thread.
+ *
+ * @param arg The instance.
+ * @return NULL.
+ */
+static void *runInstance(void *arg) {
+    gb_t *gb = arg;
+    for (int i = 0; i < 1000; i++) {
+        resetGB(gb);
+        ck_assert_uint_eq(runCycleProgram(gb, CYCLES_ACCURATE), 30 * 4);
+    }
+
+    return NULL;
+}
+
+START_TEST(test_instances) {
+    gb_t *gbs[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        gbs[i] = createGB();
+        ck_assert_ptr_nonnull(gbs[i]);
+    }
+
+    // Instances share no state, so they can run on threads of their own
+    setCPUCore(gbs[1], CORE_GENERIC);
+    setCPUCore(gbs[2], CORE_BLOCK);
+    for (int i = 0; i < 4; i++) {
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, runInstance, gbs[i]),
+                         0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    writeBus(gbs[0], 0xC000, 0x12);
+    writeBus(gbs[1], 0xC000, 0x34);
+    ck_assert_uint_eq(readBus(gbs[0], 0xC000), 0x12);
+    ck_assert_uint_eq(readBus(gbs[1], 0xC000), 0x34);
+
+    // Resetting keeps the cartridge, but not the banks it selected
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path, 8, 0x01, 0x00);
+    ck_assert(loadCartridge(gbs[0], path));
+    unlink(path);
+    writeBus(gbs[0], 0x2000, 0x05);
+    ck_assert_uint_eq(readBus(gbs[0], 0x4000), 5);
+    resetGB(gbs[0]);
+    ck_assert_uint_eq(readBus(gbs[0], 0x4000), 1);
+    ck_assert_uint_eq(getCartridgeROMBank(gbs[0], 0x4000), 1);
+
+    for (int i = 0; i < 4; i++) {
+        destroyGB(gbs[i]);
+    }
+}
+END_TEST
+
+// A loop of native and handler instructions for the JIT: 18 CPU cycles a pass
+static const u8 CORE_PROGRAM[] = {
+    0x04,        // INC B
+    0x13,        // INC DE
+    0x78,        // LD A,B
+    0xEE, 0x5A,  // XOR 0x5A
+    0x22,        // LD (HL+),A
+    0xC5,        // PUSH BC
+    0xC1,        // POP BC
+    0x18, 0xF6,  // JR -10
+};
+
+START_TEST(test_cores) {
+    gb_t *gbs[2] = {createGB(), createGB()};
+    setCPUCore(gbs[1], CORE_JIT);
+    for (int i = 0; i < 2; i++) {
+        for (u16 j = 0; j < sizeof(CORE_PROGRAM); j++) {
+            writeBus(gbs[i], 0xC000 + j, CORE_PROGRAM[j]);
+        }
+        cpuRegisters_t *registers = getCPURegisters(gbs[i]);
+        registers->pc = 0xC000;
+        registers->sp = 0xD000;
+        registers->hl = 0xD000;
+    }
+
+    // Budgets that end mid-block stop both cores at the same instruction
+    for (u64 slice = 1; slice < 200; slice++) {
+        for (int i = 0; i < 2; i++) {
+            runCPUFor(gbs[i], slice % 41);
+            materializeCPUFlags(&gbs[i]->cpu);
+        }
+
+        ck_assert_uint_eq(gbs[0]->emu.ticks, gbs[1]->emu.ticks);
+        ck_assert_mem_eq(&gbs[0]->cpu.registers, &gbs[1]->cpu.registers,
+                         sizeof(cpuRegisters_t));
+        ck_assert_int_eq(gbs[0]->cpu.halted, gbs[1]->cpu.halted);
+        ck_assert_int_eq(gbs[0]->cpu.masterInterruptEnabled,
+                         gbs[1]->cpu.masterInterruptEnabled);
+    }
+    for (u16 address = 0xD000; address < 0xD200; address++) {
+        ck_assert_uint_eq(readBus(gbs[0], address), readBus(gbs[1], address));
+    }
+
+    destroyGB(gbs[0]);
+    destroyGB(gbs[1]);
+}
+END_TEST
+
+START_TEST(test_self_modifying) {
+    // The second base has the loop cross a page, and the patch land on the
+    // second page
+    const u16 bases[] = {0xC000, 0xC0FE, 0xFF80};
+    const cpuCore_t cores[] = {CORE_BLOCK, CORE_JIT};
+
+    // Counts D up in a hot loop, then patches the loop to count back down
+    for (int i = 0; i < 6; i++) {
+        gb_t *gb = createGB();
+        setCPUCore(gb, cores[i % 2]);
+        u16 base = bases[i / 2];
+        const u8 program[] = {
+            0x06, 0x28,                                // LD B,40
+            0x14,                                      // INC D, then DEC D
+            0x05,                                      // DEC B
+            0x20, 0xFC,                                // JR NZ,-4
+            0x21, (base + 2) & 0xFF, (base + 2) >> 8,  // LD HL,base+2
+            0x34,                                      // INC (HL)
+            0x0D,                                      // DEC C
+            0x20, 0xF3,                                // JR NZ,-13
+            0x18, 0xFE,                                // JR -2
+        };
+        for (u16 j = 0; j < sizeof(program); j++) {
+            writeBus(gb, base + j, program[j]);
+        }
+        cpuRegisters_t *registers = getCPURegisters(gb);
+        registers->pc = base;
+        registers->bc = 0x0002;
+        registers->de = 0x0000;
+
+        runCPUFor(gb, 2000);
+        ck_assert_uint_eq(registers->pc, base + 13);
+        ck_assert_uint_eq(registers->d, 0);
+        ck_assert_uint_eq(readBus(gb, base + 2), 0x16);
+        destroyGB(gb);
+    }
+}
+END_TEST
+
+static channel_t stressChannel;
+
+/**
+ * Sends a sequence of numbers through the stress channel, from a thread.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *sendSequence(void *arg) {
+    for (u32 i = 0; i < 100000; i++) {
+        while (!sendMessage(&stressChannel, &i)) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST(test_channel) {
+    channel_t ch;
+    ck_assert(createChannel(&ch, 4, sizeof(u32)));
+
+    // Full rings drop messages, and messages arrive in order across the wrap
+    u32 message;
+    for (u32 i = 0; i < 4; i++) {
+        ck_assert(sendMessage(&ch, &i));
+    }
+    ck_assert(!sendMessage(&ch, &message));
+    ck_assert_uint_eq(ch.dropped, 1);
+    for (u32 i = 0; i < 6; i++) {
+        ck_assert(receiveMessage(&ch, &message));
+        ck_assert_uint_eq(message, i);
+        u32 next = i + 4;
+        ck_assert(sendMessage(&ch, &next));
+    }
+    ck_assert(!isChannelEmpty(&ch));
+    destroyChannel(&ch);
+
+    // Nothing is lost or reordered between threads
+    pthread_t thread;
+    ck_assert(createChannel(&stressChannel, 64, sizeof(u32)));
+    ck_assert_int_eq(pthread_create(&thread, NULL, sendSequence, NULL), 0);
+    for (u32 i = 0; i < 100000; i++) {
+        while (!receiveMessage(&stressChannel, &message)) {
+            sched_yield();
+        }
+        ck_assert_uint_eq(message, i);
+    }
+    pthread_join(thread, NULL);
+    ck_assert(isChannelEmpty(&stressChannel));
+    destroyChannel(&stressChannel);
+}
+END_TEST
+
+START_TEST(test_run_control) {
+    gb_t *gb = createGB();
+
+    // A ROM that jumps to itself forever
+    u8 rom[0x200] = {0};
+    rom[0x100] = 0x18;  // JR -2
+    rom[0x101] = 0xFE;
+
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(write(fd, rom, sizeof(rom)), sizeof(rom));
+    close(fd);
+    ck_assert(loadCartridge(gb, path));
+
+    // Started paused, the CPU thread sleeps without running a frame
+    pthread_t thread;
+    frameReport_t report;
+    gb->emu.running = true;
+    gb->emu.cycleLimit = 10 * 17556;
+    ck_assert(pauseEmulator(gb));
+    ck_assert_int_eq(pthread_create(&thread, NULL, runCPU, gb), 0);
+    usleep(20000);
+    ck_assert(!receiveFrameReport(gb, &report));
+
+    // Once resumed, it runs up to the cycle limit and asks to exit
+    ck_assert(setEmulatorButtons(gb, BUTTON_A | BUTTON_START));
+    ck_assert(resumeEmulator(gb));
+    pthread_join(thread, NULL);
+    ck_assert(isEmulatorExiting(gb));
+    ck_assert_uint_eq(gb->emu.buttons, BUTTON_A | BUTTON_START);
+
+    // Every frame was reported, in order
+    for (u64 frame = 1; frame <= 10; frame++) {
+        ck_assert(receiveFrameReport(gb, &report));
+        ck_assert_uint_eq(report.frame, frame);
+    }
+    ck_assert_uint_ge(report.ticks / 4, 10 * 17556);
+    ck_assert(!receiveFrameReport(gb, &report));
+
+    // Stopping wakes a paused CPU thread
+    gb->emu.cycleLimit = 0;
+    atomic_store(&gb->emu.die, false);
+    ck_assert(pauseEmulator(gb));
+    ck_assert_int_eq(pthread_create(&thread, NULL, runCPU, gb), 0);
+    ck_assert(stopEmulator(gb));
+    pthread_join(thread, NULL);
+
+    unloadCartridge(gb);
+    unlink(path);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_pacer) {
+    gb_t *gb = createGB();
+
+    // Disabled pacers don't wait
+    pacerStats_t stats;
+    waitForFrame(gb);
+    getPacerStats(gb, &stats);
+    ck_assert_uint_eq(stats.frames, 0);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    setFramePacing(gb, true);
+    for (int i = 0; i < 5; i++) {
+        waitForFrame(gb);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Frames are 16742706.3 ns apart, and never delivered early
+    u64 elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull +
+                  end.tv_nsec - start.tv_nsec;
+    ck_assert_uint_ge(elapsed, 5 * 16742706ull);
+    getPacerStats(gb, &stats);
+    ck_assert_uint_eq(stats.frames, 5);
+    ck_assert(stats.meanJitter >= 0);
+    ck_assert(stats.maxJitter >= stats.meanJitter);
+    destroyGB(gb);
+}
+END_TEST
+
+/**
+ * Draws and publishes frames filled with their number, from a thread.
+ *
+ * @param arg The instance.
+ * @return NULL.
+ */
+static void *drawFrames(void *arg) {
+    gb_t *gb = arg;
+    for (u32 frame = 3; frame <= 1000; frame++) {
+        u32 *pixels = getDrawingFrame(gb);
+        for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+            pixels[i] = frame;
+        }
+        publishFrame(gb);
+    }
+
+    return NULL;
+}
+
+START_TEST(test_frames) {
+    gb_t *gb = createGB();
+
+    // Until a frame is published, the blank screen is repeated
+    bool fresh;
+    const u32 *pixels = takeFrame(gb, &fresh);
+    ck_assert(!fresh);
+    ck_assert_uint_eq(pixels[0], FRAME_BLANK_COLOR);
+
+    // The presenter only gets the newest frame, then repeats it
+    getDrawingFrame(gb)[0] = 1;
+    publishFrame(gb);
+    getDrawingFrame(gb)[0] = 2;
+    publishFrame(gb);
+    pixels = takeFrame(gb, &fresh);
+    ck_assert(fresh);
+    ck_assert_uint_eq(pixels[0], 2);
+    ck_assert(getDrawingFrame(gb) != pixels);
+    pixels = takeFrame(gb, &fresh);
+    ck_assert(!fresh);
+    ck_assert_uint_eq(pixels[0], 2);
+    ck_assert_uint_eq(gb->frames.dropped, 1);
+    ck_assert_uint_eq(gb->frames.repeated, 2);
+
+    // Frames taken while the core draws are whole, and never go back in time
+    pthread_t thread;
+    ck_assert_int_eq(pthread_create(&thread, NULL, drawFrames, gb), 0);
+    u32 last = 2;
+    while (last < 1000) {
+        pixels = takeFrame(gb, &fresh);
+        if (fresh) {
+            ck_assert_uint_ge(pixels[0], last);
+            for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+                ck_assert_uint_eq(pixels[i], pixels[0]);
+            }
+            last = pixels[0];
+        } else {
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+
+    // Every frame was either presented or dropped
+    frameContext_t *frames = &gb->frames;
+    ck_assert_uint_eq(frames->published, 1000);
+    ck_assert_uint_eq(frames->presented + frames->dropped, frames->published);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_interrupts) {
+    gb_t *gb = createGB();
+    emuContext_t *emu = getEMUContext(gb);
+
+    writeBus(gb, 0xC000, 0xFB);  // EI
+    writeBus(gb, 0xC001, 0x00);  // NOP
+    cpuRegisters_t *registers = getCPURegisters(gb);
+    registers->pc = 0xC000;
+    registers->sp = 0xD000;
+    setCPUIERegister(gb, INT_TIMER | INT_SERIAL);
+    setCPUInterruptFlags(gb, INT_TIMER | INT_SERIAL);
+
+    // IME is only set once the instruction after EI has run
+    stepCPU(gb);
+    stepCPU(gb);
+    ck_assert_uint_eq(registers->pc, 0xC002);
+
+    // The timer has priority over serial, and dispatch takes 5 CPU cycles
+    stepCPU(gb);
+    ck_assert_uint_eq(registers->pc, 0x50);
+    ck_assert_uint_eq(registers->sp, 0xCFFE);
+    ck_assert_uint_eq(readBus16(gb, 0xCFFE), 0xC002);
+    ck_assert_uint_eq(getCPUInterruptFlags(gb), INT_SERIAL);
+    ck_assert_uint_eq(emu->ticks, (2 + 5) * 4);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_halt) {
+    gb_t *gbs[2] = {createGB(), createGB()};
+
+    // HALT with IME off, then NOPs whose PC tells the tick the CPU woke at
+    for (int i = 0; i < 2; i++) {
+        writeBus(gbs[i], 0xC000, 0x76);  // HALT
+        for (u16 address = 0xC001; address < 0xC200; address++) {
+            writeBus(gbs[i], address, 0x00);  // NOP
+        }
+        getCPURegisters(gbs[i])->pc = 0xC000;
+        setCPUIERegister(gbs[i], INT_TIMER);
+        writeTimer(gbs[i], 0xFF05, 0xF0);
+        writeTimer(gbs[i], 0xFF07, 0x05);  // Overflows in 16 * 16 ticks
+    }
+
+    // Fast-forwarding to the timer wakes the CPU on the same tick as running
+    // it one cycle at a time
+    runCPUFor(gbs[0], 200);
+    for (int i = 0; i < 200; i++) {
+        runCPUFor(gbs[1], 1);
+    }
+    ck_assert(!gbs[0]->cpu.halted);
+    ck_assert_uint_eq(gbs[0]->emu.ticks, gbs[1]->emu.ticks);
+    ck_assert_uint_eq(getCPURegisters(gbs[0])->pc,
+                      getCPURegisters(gbs[1])->pc);
+    ck_assert_uint_ge(getCPURegisters(gbs[0])->pc, 0xC001 + 100);
+
+    // Resetting leaves HALT, and the flags of the last instruction, behind
+    gb_t *gb = gbs[0];
+    writeBus(gb, 0xC000, 0x3C);  // INC A
+    writeBus(gb, 0xC001, 0x76);  // HALT
+    getCPURegisters(gb)->pc = 0xC000;
+    setCPUIERegister(gb, 0);
+    runCPUFor(gb, 100);
+    ck_assert(gb->cpu.halted);
+    resetGB(gb);
+    ck_assert(!gb->cpu.halted);
+    ck_assert_int_eq(gb->cpu.lazyFlags.op, FLAGS_NONE);
+    cpuRegisters_t *registers = getCPURegisters(gb);
+    ck_assert_uint_eq(registers->af, 0x01B0);
+    ck_assert_uint_eq(registers->bc, 0x0013);
+    ck_assert_uint_eq(registers->de, 0x00D8);
+    ck_assert_uint_eq(registers->hl, 0x014D);
+    ck_assert_uint_eq(registers->sp, 0xFFFE);
+    ck_assert_uint_eq(registers->pc, 0x0100);
+
+    destroyGB(gbs[0]);
+    destroyGB(gbs[1]);
+}
+END_TEST
+
+START_TEST(test_trace) {
+    gb_t *gb = createGB();
+    char path[] = "/tmp/check_gbe_traceXXXXXX";
+    close(mkstemp(path));
+    ck_assert(startTrace(gb, 6, path));
+
+    // LD B,n 20 times, overfilling a ring rounded up to 8 records
+    for (u8 i = 0; i < 20; i++) {
+        writeBus(gb, 0xC000 + i * 2, 0x06);
+        writeBus(gb, 0xC001 + i * 2, i);
+    }
+    getCPURegisters(gb)->pc = 0xC000;
+    for (int i = 0; i < 20; i++) {
+        stepCPU(gb);
+    }
+    ck_assert(dumpTrace(gb, NULL));
+
+    // Only the newest records are dumped, oldest first
+    FILE *file = fopen(path, "rb");
+    ck_assert_ptr_nonnull(file);
+    traceFileHeader_t header;
+    ck_assert_int_eq(fread(&header, sizeof(header), 1, file), 1);
+    ck_assert_str_eq(header.magic, TRACE_MAGIC);
+    ck_assert_uint_eq(header.version, TRACE_VERSION);
+    ck_assert_uint_eq(header.recordSize, sizeof(traceRecord_t));
+    ck_assert_uint_eq(header.count, 8);
+
+    traceRecord_t records[8];
+    ck_assert_int_eq(fread(records, sizeof(traceRecord_t), 8, file), 8);
+    ck_assert_int_eq(fgetc(file), EOF);
+    fclose(file);
+    for (u8 i = 0; i < 8; i++) {
+        ck_assert_uint_eq(records[i].pc, 0xC000 + (12 + i) * 2);
+        ck_assert_uint_eq(records[i].ticks, (12 + i) * 2 * 4);
+        ck_assert_uint_eq(records[i].opcode, 0x06);
+        ck_assert_uint_eq(records[i].operands[0], 12 + i);
+        ck_assert_uint_eq(records[i].b, 11 + i);
+    }
+
+    char str[256];
+    traceRecordToString(&records[0], str, sizeof(str));
+    ck_assert_ptr_nonnull(strstr(str, "LD B,$0C"));
+
+    // Code in high RAM is recorded, though its page is read through a handler
+    writeBus(gb, 0xFF80, 0x06);
+    writeBus(gb, 0xFF81, 0x42);
+    getCPURegisters(gb)->pc = 0xFF80;
+    stepCPU(gb);
+    traceRecord_t *record = &gb->trace.records[(gb->trace.head - 1) & 7];
+    ck_assert_uint_eq(record->opcode, 0x06);
+    ck_assert_uint_eq(record->operands[0], 0x42);
+
+    stopTrace(gb);
+    unlink(path);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_io) {
+    gb_t *gb = createGB();
+
+    // Registered registers read their unused bits as 1
+    writeIO(gb, 0xFF0F, 0xFF);
+    ck_assert_uint_eq(readIO(gb, 0xFF0F), 0xFF);
+    ck_assert_uint_eq(getCPUInterruptFlags(gb), 0x1F);
+    writeIO(gb, 0xFF02, 0x01);
+    ck_assert_uint_eq(readIO(gb, 0xFF02), 0x7F);
+    writeIO(gb, 0xFF07, 0x05);
+    ck_assert_uint_eq(readIO(gb, 0xFF07), 0xFD);
+
+    // A transfer with the internal clock sends SB, then clears SC bit 7
+    writeBus(gb, 0xC000, 0x18);  // JR -2
+    writeBus(gb, 0xC001, 0xFE);
+    getCPURegisters(gb)->pc = 0xC000;
+    setCPUInterruptFlags(gb, 0);
+    writeIO(gb, 0xFF01, 'A');
+    writeIO(gb, 0xFF02, 0x81);
+    ck_assert_uint_eq(readIO(gb, 0xFF02), 0xFF);
+    runCPUFor(gb, 8 * 128 + 8);
+    ck_assert_uint_eq(gb->dbg.size, 1);
+    ck_assert_int_eq(gb->dbg.message[0], 'A');
+    ck_assert_uint_eq(readIO(gb, 0xFF02), 0x7F);
+    ck_assert(getCPUInterruptFlags(gb) & INT_SERIAL);
+
+    // Unhandled accesses read as 0xFF and are counted
+    ck_assert_uint_eq(readIO(gb, 0xFF4D), 0xFF);
+    writeIO(gb, 0xFF4D, 0x01);
+    ck_assert_uint_eq(getUnhandledIOCount(gb, 0xFF4D), 2);
+    ck_assert_uint_eq(getUnhandledIOCount(gb, 0xFF0F), 0);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_bus) {
+    gb_t *gb = createGB();
+
+    // Echo RAM mirrors 0xC000 - 0xDDFF both ways
+    writeBus(gb, 0xC123, 0x12);
+    ck_assert_uint_eq(readBus(gb, 0xE123), 0x12);
+    writeBus(gb, 0xE456, 0x34);
+    ck_assert_uint_eq(readBus(gb, 0xC456), 0x34);
+    writeBus(gb, 0xFDFF, 0x56);
+    ck_assert_uint_eq(readBus(gb, 0xDDFF), 0x56);
+    writeBus(gb, 0xDDFF, 0x78);
+    ck_assert_uint_eq(readBus(gb, 0xFDFF), 0x78);
+
+    // High RAM sits between the I/O registers and IE
+    writeBus(gb, 0xFF80, 0x9A);
+    writeBus(gb, 0xFFFE, 0xBC);
+    writeBus(gb, 0xFFFF, 0x1F);
+    ck_assert_uint_eq(readBus(gb, 0xFF80), 0x9A);
+    ck_assert_uint_eq(readBus(gb, 0xFFFE), 0xBC);
+    ck_assert_uint_eq(readCPUIERegister(gb), 0x1F);
+    ck_assert_uint_eq(readBus16(gb, 0xFFFE), 0x1FBC);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_cartridge) {
+    gb_t *gb = createGB();
+
+    // A ROM smaller than two banks, with a full-length title
+    u8 rom[0x200] = {0};
+    memset(rom + 0x134, 'A', 16);
+    rom[0x1FF] = 0x42;
+
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(write(fd, rom, sizeof(rom)), sizeof(rom));
+    close(fd);
+
+    ck_assert(loadCartridge(gb, path));
+    ck_assert_uint_eq(readCartridge(gb, 0x01FF), 0x42);
+    ck_assert_uint_eq(readCartridge(gb, 0x7FFF), 0x00);  // Padded with zeroes
+    ck_assert_uint_eq(readCartridge(gb, 0xA000), 0xFF);
+
+    // The header is parsed from a copy, so the title is left as is
+    ck_assert_uint_eq(readCartridge(gb, 0x0143), 'A');
+
+    unloadCartridge(gb);
+    unlink(path);
+    ck_assert(!loadCartridge(gb, path));
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_mappers) {
+    gb_t *gb = createGB();
+
+    // MBC1 with 64 banks and 32 KiB of RAM
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path, 64, 0x03, 0x03);
+    ck_assert(loadCartridge(gb, path));
+    unlink(path);
+    mapCartridge(gb);
+
+    ck_assert_uint_eq(readBus(gb, 0x4000), 1);
+    writeBus(gb, 0x2000, 0x00);  // Bank 0 selects bank 1
+    ck_assert_uint_eq(readBus(gb, 0x4000), 1);
+    writeBus(gb, 0x2000, 0x05);
+    writeBus(gb, 0x4000, 0x01);  // Upper bits
+    ck_assert_uint_eq(readBus(gb, 0x4000), 0x25);
+    ck_assert_uint_eq(getCartridgeROMBank(gb, 0x4000), 0x25);
+    ck_assert_uint_eq(readBus(gb, 0x0000), 0);
+
+    // Mode 1 also switches 0x0000 - 0x3FFF and the RAM bank
+    writeBus(gb, 0x6000, 0x01);
+    ck_assert_uint_eq(readBus(gb, 0x0000), 0x20);
+    ck_assert_uint_eq(getCartridgeROMBank(gb, 0x0000), 0x20);
+
+    // RAM is only mapped once enabled
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0xFF);
+    writeBus(gb, 0x0000, 0x0A);
+    writeBus(gb, 0xA000, 0x12);
+    writeBus(gb, 0x4000, 0x00);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0x00);
+    writeBus(gb, 0x4000, 0x01);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0x12);
+    writeBus(gb, 0x0000, 0x00);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0xFF);
+
+    // MBC5 with 9-bit banks, wrapped to the banks in the ROM
+    char path5[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path5, 8, 0x19, 0x00);
+    ck_assert(loadCartridge(gb, path5));
+    unlink(path5);
+
+    writeBus(gb, 0x2000, 0x00);  // Bank 0 can be selected
+    ck_assert_uint_eq(readBus(gb, 0x4000), 0);
+    writeBus(gb, 0x2000, 0x06);
+    writeBus(gb, 0x3000, 0x01);
+    ck_assert_uint_eq(getCartridgeROMBank(gb, 0x4000), 0x106 % 8);
+    ck_assert_uint_eq(readBus(gb, 0x4000), 6);
+
+    // MBC5 with 128 KiB of RAM, in 16 banks
+    char path5RAM[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path5RAM, 8, 0x1A, 0x04);
+    ck_assert(loadCartridge(gb, path5RAM));
+    unlink(path5RAM);
+
+    writeBus(gb, 0x0000, 0x0A);
+    for (u8 bank = 0; bank < 16; bank++) {
+        writeBus(gb, 0x4000, bank);
+        writeBus(gb, 0xA000, 0x80 | bank);
+    }
+    for (u8 bank = 0; bank < 16; bank++) {
+        writeBus(gb, 0x4000, bank);
+        ck_assert_uint_eq(readBus(gb, 0xA000), 0x80 | bank);
+    }
+
+    // MBC2 RAM holds 4-bit values, repeated over the window
+    char path2[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path2, 4, 0x05, 0x00);
+    ck_assert(loadCartridge(gb, path2));
+    unlink(path2);
+
+    writeBus(gb, 0x2100, 0x03);
+    ck_assert_uint_eq(readBus(gb, 0x4000), 3);
+    writeBus(gb, 0x0000, 0x0A);
+    writeBus(gb, 0xA001, 0x5C);
+    ck_assert_uint_eq(readBus(gb, 0xA201), 0xFC);
+
+    unloadCartridge(gb);
+    ck_assert_uint_eq(readBus(gb, 0x4000), 0xFF);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_idle_loops) {
+    // A ROM waiting for the timer interrupt flag, then running NOPs
+    const u8 program[] = {
+        0xF0, 0x0F,  // LDH A,(IF)
+        0xE6, 0x04,  // AND 0x04
+        0x28, 0xFA,  // JR Z,-6
+    };
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path, 2, 0x00, 0x00);
+    int fd = open(path, O_WRONLY);
+    ck_assert_int_eq(pwrite(fd, program, sizeof(program), 0x100),
+                     sizeof(program));
+    close(fd);
+
+    gb_t *gbs[2] = {createGB(), createGB()};
+    for (int i = 0; i < 2; i++) {
+        ck_assert(loadCartridge(gbs[i], path));
+        writeTimer(gbs[i], 0xFF05, 0xF0);
+        writeTimer(gbs[i], 0xFF07, 0x05);  // Overflows in 16 * 16 ticks
+    }
+    unlink(path);
+
+    // Skipping iterations up to the timer leaves the same state as running
+    // every one of them, which one cycle budgets do
+    runCPUFor(gbs[0], 200);
+    while (gbs[1]->emu.ticks < 200 * 4) {
+        runCPUFor(gbs[1], 1);
+    }
+    ck_assert(gbs[0]->idleLoops.loops[0x100 % IDLE_LOOP_SLOTS].polling);
+    ck_assert_uint_eq(gbs[0]->emu.ticks, gbs[1]->emu.ticks);
+    for (int i = 0; i < 2; i++) {
+        materializeCPUFlags(&gbs[i]->cpu);
+    }
+    ck_assert_mem_eq(&gbs[0]->cpu.registers, &gbs[1]->cpu.registers,
+                     sizeof(cpuRegisters_t));
+    ck_assert_uint_ge(getCPURegisters(gbs[0])->pc, 0x106 + 100);
+
+    for (int i = 0; i < 2; i++) {
+        unloadCartridge(gbs[i]);
+        destroyGB(gbs[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_battery_ram) {
+    gb_t *gb = createGB();
+
+    // MBC1+RAM+BATTERY with 8 KiB of RAM, saved next to the ROM
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path, 4, 0x03, 0x02);
+    char savePath[sizeof(path) + 4];
+    snprintf(savePath, sizeof(savePath), "%s.sav", path);
+
+    ck_assert(loadCartridge(gb, path));
+    mapCartridge(gb);
+    writeBus(gb, 0x0000, 0x0A);
+    writeBus(gb, 0xA000, 0x12);
+    writeBus(gb, 0xBFFF, 0x34);
+    writeBus(gb, 0x0000, 0x00);
+    unloadCartridge(gb);
+
+    int fd = open(savePath, O_RDONLY);
+    ck_assert_int_ne(fd, -1);
+    u8 saved[2];
+    ck_assert_int_eq(pread(fd, &saved[0], 1, 0x0000), 1);
+    ck_assert_int_eq(pread(fd, &saved[1], 1, 0x1FFF), 1);
+    close(fd);
+    ck_assert_uint_eq(saved[0], 0x12);
+    ck_assert_uint_eq(saved[1], 0x34);
+
+    // Loading the ROM again restores the RAM
+    ck_assert(loadCartridge(gb, path));
+    mapCartridge(gb);
+    writeBus(gb, 0x0000, 0x0A);
+    ck_assert_uint_eq(readBus(gb, 0xBFFF), 0x34);
+    unloadCartridge(gb);
+
+    unlink(path);
+    unlink(savePath);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_rtc) {
+    gb_t *gb = createGB();
+    emuContext_t *emu = getEMUContext(gb);
+    setRTCClock(gb, RTC_CLOCK_EMULATED);
+
+    // MBC3+TIMER+RAM+BATTERY with 8 KiB of RAM
+    char path[] = "/tmp/check_gbe_romXXXXXX";
+    writeBankedROM(path, 4, 0x10, 0x02);
+    char savePath[sizeof(path) + 4];
+    snprintf(savePath, sizeof(savePath), "%s.sav", path);
+
+    ck_assert(loadCartridge(gb, path));
+    mapCartridge(gb);
+    writeBus(gb, 0x0000, 0x0A);
+
+    // Registers only change when latched
+    emu->ticks = 4194304ull * (86400 * 300 + 3661);
+    writeBus(gb, 0x4000, 0x08);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0);
+    writeBus(gb, 0x6000, 0x00);
+    writeBus(gb, 0x6000, 0x01);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 1);  // Seconds
+    writeBus(gb, 0x4000, 0x09);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 1);  // Minutes
+    writeBus(gb, 0x4000, 0x0A);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 1);  // Hours
+    writeBus(gb, 0x4000, 0x0B);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 300 & 0xFF);
+    writeBus(gb, 0x4000, 0x0C);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 300 >> 8);
+
+    // Halting stops the counter
+    writeBus(gb, 0xA000, 0x41);
+    emu->ticks += 4194304ull * 10;
+    writeBus(gb, 0x6000, 0x00);
+    writeBus(gb, 0x6000, 0x01);
+    writeBus(gb, 0x4000, 0x08);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 1);
+    unloadCartridge(gb);
+
+    // The clock is saved after the RAM, and restored with it
+    int fd = open(savePath, O_RDONLY);
+    ck_assert_int_ne(fd, -1);
+    ck_assert_int_eq(lseek(fd, 0, SEEK_END), 0x2000 + RTC_FOOTER_SIZE);
+    close(fd);
+
+    ck_assert(loadCartridge(gb, path));
+    mapCartridge(gb);
+    writeBus(gb, 0x0000, 0x0A);
+    writeBus(gb, 0x4000, 0x0C);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 0x41);
+    writeBus(gb, 0xA000, 0x01);  // Resume, then let a day pass
+    emu->ticks += 4194304ull * 86400;
+    writeBus(gb, 0x6000, 0x00);
+    writeBus(gb, 0x6000, 0x01);
+    writeBus(gb, 0x4000, 0x0B);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 301 & 0xFF);
+
+    // The clock keeps running through a reset, which restarts the ticks
+    resetGB(gb);
+    writeBus(gb, 0x0000, 0x0A);
+    emu->ticks += 4194304ull * 86400;
+    writeBus(gb, 0x6000, 0x00);
+    writeBus(gb, 0x6000, 0x01);
+    writeBus(gb, 0x4000, 0x0B);
+    ck_assert_uint_eq(readBus(gb, 0xA000), 302 & 0xFF);
+    unloadCartridge(gb);
+
+    unlink(path);
+    unlink(savePath);
+    destroyGB(gb);
+}
+END_TEST
+
+START_TEST(test_catalog) {
+    char directory[] = "/tmp/check_gbe_catalogXXXXXX";
+    ck_assert_ptr_nonnull(mkdtemp(directory));
+
+    // A ROM with valid checksums, and one with a broken global checksum
+    u8 rom[0x8000] = {0};
+    memcpy(rom + 0x134, "CATALOG", 7);
+    rom[0x147] = 0x01;
+    rom[0x14D] = computeHeaderChecksum(rom);
+    u16 global = computeGlobalChecksum(rom, sizeof(rom));
+    rom[0x14E] = global >> 8;
+    rom[0x14F] = global & 0xFF;
+
+    char good[64], bad[64], catalogPath[64];
+    snprintf(good, sizeof(good), "%s/good.gb", directory);
+    snprintf(bad, sizeof(bad), "%s/bad.gbc", directory);
+    snprintf(catalogPath, sizeof(catalogPath), "%s/catalog.bin", directory);
+    FILE *file = fopen(good, "wb");
+    fwrite(rom, 1, sizeof(rom), file);
+    fclose(file);
+    rom[0x4000] = 1;
+    file = fopen(bad, "wb");
+    fwrite(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    catalog_t catalog = {0};
+    const char *directories[] = {directory};
+    ck_assert_int_eq(scanCatalog(&catalog, directories, 1, 2), 2);
+    ck_assert_uint_eq(catalog.count, 2);
+
+    const catalogEntry_t *entry = findCatalogEntry(&catalog, good);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_str_eq(entry->title, "CATALOG");
+    ck_assert_uint_eq(entry->type, 0x01);
+    ck_assert_uint_eq(entry->flags, CATALOG_HEADER_OK | CATALOG_GLOBAL_OK);
+    entry = findCatalogEntry(&catalog, bad);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_uint_eq(entry->flags, CATALOG_HEADER_OK);
+
+    // A saved catalog only reads files that changed
+    ck_assert(saveCatalog(&catalog, catalogPath));
+    freeCatalog(&catalog);
+    ck_assert(loadCatalog(&catalog, catalogPath));
+    ck_assert_uint_eq(catalog.count, 2);
+    ck_assert_int_eq(scanCatalog(&catalog, directories, 1, 2), 0);
+
+    file = fopen(bad, "ab");
+    fputc(0, file);
+    fclose(file);
+    ck_assert_int_eq(scanCatalog(&catalog, directories, 1, 0), 1);
+    ck_assert_uint_eq(findCatalogEntry(&catalog, bad)->size, 0x8001);
+
+    unlink(good);
+    ck_assert_int_eq(scanCatalog(&catalog, directories, 1, 0), 0);
+    ck_assert_uint_eq(catalog.count, 1);
+    ck_assert_ptr_null(findCatalogEntry(&catalog, good));
+    freeCatalog(&catalog);
+
+    unlink(bad);
+    unlink(catalogPath);
+    rmdir(directory);
+}
 END_TEST
 
 Suite *stack_suite() {
@@ -13,6 +1151,31 @@ Suite *stack_suite() {
     TCase *tc = tcase_create("core");
 
     tcase_add_test(tc, test_nothing);
+    tcase_add_test(tc, test_handler_table);
+    tcase_add_test(tc, test_lazy_flags);
+    tcase_add_test(tc, test_scheduler);
+    tcase_add_test(tc, test_timer);
+    tcase_add_test(tc, test_cycle_modes);
+    tcase_add_test(tc, test_mem_timing);
+    tcase_add_test(tc, test_cpu_budget);
+    tcase_add_test(tc, test_instances);
+    tcase_add_test(tc, test_cores);
+    tcase_add_test(tc, test_self_modifying);
+    tcase_add_test(tc, test_channel);
+    tcase_add_test(tc, test_run_control);
+    tcase_add_test(tc, test_pacer);
+    tcase_add_test(tc, test_frames);
+    tcase_add_test(tc, test_interrupts);
+    tcase_add_test(tc, test_halt);
+    tcase_add_test(tc, test_trace);
+    tcase_add_test(tc, test_io);
+    tcase_add_test(tc, test_bus);
+    tcase_add_test(tc, test_cartridge);
+    tcase_add_test(tc, test_mappers);
+    tcase_add_test(tc, test_idle_loops);
+    tcase_add_test(tc, test_battery_ram);
+    tcase_add_test(tc, test_rtc);
+    tcase_add_test(tc, test_catalog);
     suite_add_tcase(s, tc);
 
     return s;